@@ -3,11 +3,15 @@
 **/
 
 
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include "NeuHashtable.h"
+#include "NeuConcurrentHashtable.h"
+#include "NeuGenericHashtable.h"
+#include "NeuShardedHashtable.h"
 
 
 /**
@@ -28,14 +32,46 @@ void randomized_test(NeuHashtable *hashtable, int n) {
     }
 }
 
+/**
+ * Converts a mode name from the command line into a HashtableMode.
+ * @return true if the name was recognized.
+ */
+bool parse_mode(const char *name, HashtableMode *mode) {
+    if (strcmp(name, "chain") == 0) {
+        *mode = HASHTABLE_MODE_CHAINING;
+    } else if (strcmp(name, "incremental") == 0) {
+        *mode = HASHTABLE_MODE_INCREMENTAL;
+    } else if (strcmp(name, "simd") == 0) {
+        *mode = HASHTABLE_MODE_SIMD;
+    } else if (strcmp(name, "robin") == 0) {
+        *mode = HASHTABLE_MODE_ROBIN_HOOD;
+    } else if (strcmp(name, "cuckoo") == 0) {
+        *mode = HASHTABLE_MODE_CUCKOO;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char *mode_name(HashtableMode mode) {
+    switch (mode) {
+        case HASHTABLE_MODE_INCREMENTAL: return "incremental";
+        case HASHTABLE_MODE_SIMD: return "simd";
+        case HASHTABLE_MODE_ROBIN_HOOD: return "robin";
+        case HASHTABLE_MODE_CACHE: return "cache";
+        case HASHTABLE_MODE_CUCKOO: return "cuckoo";
+        default: return "chain";
+    }
+}
+
 /**
    * creates a hashtable of the initial capacity and adds items to it to N.
    * times the results of adding items to the hashtable, 
    * prints out the time, visualization of the hashtable, and the load factor.
    * @param argc The number items
  */
-void test_hashtable(int n) {
-    NeuHashtable *hashtable = create_hashtable(INITIAL_CAPACITY);
+void test_hashtable(int n, HashtableMode mode) {
+    NeuHashtable *hashtable = create_hashtable_mode(INITIAL_CAPACITY, mode);
     if (hashtable == NULL) {
         fprintf(stderr, "Failed to create hashtable\n");
         return;
@@ -56,28 +92,1455 @@ void test_hashtable(int n) {
     free_hashtable(hashtable);
 }
 
-void simple_test() {
+/**
+ * Benchmarks one engine: inserts n items, then looks up every item (hits)
+ * and n IDs that were never added (misses), both in random order.
+ * Prints one row of the comparison table.
+ */
+void benchmark_mode(int n, HashtableMode mode) {
+    NeuHashtable *hashtable = create_hashtable_mode(INITIAL_CAPACITY, mode);
+    char itemID[16];
+    int *order = (int *)malloc(n * sizeof(int));
+    for (int i = 0; i < n; i++) {
+        order[i] = i;
+    }
+    for (int i = n - 1; i > 0; i--) { // shuffle so lookups do not follow insertion order
+        int j = rand() % (i + 1);
+        int tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+
+    clock_t start_time = clock();
+    randomized_test(hashtable, n);
+    double insert_time = (double)(clock() - start_time) / CLOCKS_PER_SEC;
+
+    int found = 0;
+    start_time = clock();
+    for (int i = 0; i < n; i++) {
+        snprintf(itemID, sizeof(itemID), "F%d", order[i]);
+        found += get_item(hashtable, itemID) != NULL;
+    }
+    double hit_time = (double)(clock() - start_time) / CLOCKS_PER_SEC;
+
+    start_time = clock();
+    for (int i = 0; i < n; i++) {
+        snprintf(itemID, sizeof(itemID), "M%d", order[i]);
+        found += get_item(hashtable, itemID) != NULL;
+    }
+    double miss_time = (double)(clock() - start_time) / CLOCKS_PER_SEC;
+
+    if (found != n) {
+        fprintf(stderr, "%s: expected %d items, found %d\n", mode_name(mode), n, found);
+    }
+    printf("%-12s %12.4f %12.4f %12.4f %8.2f %10zu %10.2f\n", mode_name(mode),
+           insert_time, hit_time, miss_time, get_load_factor(hashtable),
+           get_max_probe_length(hashtable), get_mean_probe_length(hashtable));
+    free(order);
+    free_hashtable(hashtable);
+}
+
+/**
+ * Runs benchmark_mode for every engine so they can be compared side by side.
+ */
+void compare_modes(int n) {
+    srand(time(NULL));
+    printf("Comparing engines with %d items (seconds)\n", n);
+    printf("%-12s %12s %12s %12s %8s %10s %10s\n", "mode", "insert", "get hit", "get miss", "load", "max probe", "mean probe");
+    benchmark_mode(n, HASHTABLE_MODE_CHAINING);
+    benchmark_mode(n, HASHTABLE_MODE_INCREMENTAL);
+    benchmark_mode(n, HASHTABLE_MODE_SIMD);
+    benchmark_mode(n, HASHTABLE_MODE_ROBIN_HOOD);
+    benchmark_mode(n, HASHTABLE_MODE_CUCKOO);
+}
+
+#define CHAIN_HISTOGRAM_BUCKETS 8
+
+/**
+ * Benchmarks one hash function on the chaining engine: inserts the usual
+ * sequential IDs, looks n of them up in random order, and prints how long the chains are.
+ */
+void hash_mode(int n, const char *name, NeuHashFunction hash_function) {
+    NeuHashtable *hashtable = create_hashtable_mode(INITIAL_CAPACITY, HASHTABLE_MODE_CHAINING);
+    set_hash_function(hashtable, hash_function, hash_random_seed());
+    char itemID[16];
+
+    clock_t start_time = clock();
+    randomized_test(hashtable, n);
+    double insert_time = (double)(clock() - start_time) / CLOCKS_PER_SEC;
+    start_time = clock();
+    for (int i = 0; i < n; i++) {
+        snprintf(itemID, sizeof(itemID), "F%d", rand() % n); // random order, so djb2's neighbouring buckets do not help
+        get_item(hashtable, itemID);
+    }
+    double get_time = (double)(clock() - start_time) / CLOCKS_PER_SEC;
+
+    size_t histogram[CHAIN_HISTOGRAM_BUCKETS] = {0};
+    size_t longest = 0;
+    for (size_t i = 0; i < hashtable->capacity; i++) {
+        size_t length = 0;
+        for (NeuNode *node = hashtable->table[i]; node != NULL; node = node->next) {
+            length++;
+        }
+        histogram[length < CHAIN_HISTOGRAM_BUCKETS - 1 ? length : CHAIN_HISTOGRAM_BUCKETS - 1]++;
+        if (length > longest) {
+            longest = length;
+        }
+    }
+
+    printf("%-8s %8.2f %8.2f %6zu", name, n / insert_time / 1e6, n / get_time / 1e6, longest);
+    for (int i = 0; i < CHAIN_HISTOGRAM_BUCKETS; i++) {
+        printf(" %5.1f%%", 100.0 * histogram[i] / hashtable->capacity);
+    }
+    printf("\n");
+    free_hashtable(hashtable);
+}
+
+/**
+ * Runs hash_mode for every built-in hash function.
+ */
+void hash_benchmark(int n) {
+    srand(time(NULL));
+    printf("Hash functions with %d items (M ops/s, share of buckets by chain length)\n", n);
+    printf("%-8s %8s %8s %6s", "hash", "insert", "get", "max");
+    for (int i = 0; i < CHAIN_HISTOGRAM_BUCKETS; i++) {
+        printf(" %5d%s", i, i == CHAIN_HISTOGRAM_BUCKETS - 1 ? "+" : " ");
+    }
+    printf("\n");
+    hash_mode(n, "djb2", hash_djb2);
+    hash_mode(n, "wyhash", hash_wyhash);
+    hash_mode(n, "xxh3", hash_xxh3);
+}
+
+long long now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+int compare_long_long(const void *a, const void *b) {
+    long long x = *(const long long *)a;
+    long long y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Times every single add_item call while inserting n items and prints
+ * the latency percentiles. A stop-the-world resize shows up in the tail.
+ */
+void latency_mode(int n, HashtableMode mode) {
+    NeuHashtable *hashtable = create_hashtable_mode(INITIAL_CAPACITY, mode);
+    long long *samples = (long long *)malloc(n * sizeof(long long));
+    char itemID[16];
+    char itemName[24];
+
+    for (int i = 0; i < n; i++) {
+        snprintf(itemID, sizeof(itemID), "F%d", i);
+        snprintf(itemName, sizeof(itemName), "Item%d", i);
+        long long start = now_ns();
+        add_item(hashtable, itemID, itemName, 1.0, 1);
+        samples[i] = now_ns() - start;
+    }
+
+    qsort(samples, n, sizeof(long long), compare_long_long);
+    printf("%-12s %10lld %10lld %10lld %12lld\n", mode_name(mode),
+           samples[n / 2], samples[(long long)n * 99 / 100],
+           samples[(long long)n * 999 / 1000], samples[n - 1]);
+    free(samples);
+    free_hashtable(hashtable);
+}
+
+/**
+ * Runs latency_mode for every engine.
+ */
+void latency_benchmark(int n) {
+    printf("Insert latency with %d items (nanoseconds)\n", n);
+    printf("%-12s %10s %10s %10s %12s\n", "mode", "p50", "p99", "p999", "max");
+    latency_mode(n, HASHTABLE_MODE_CHAINING);
+    latency_mode(n, HASHTABLE_MODE_INCREMENTAL);
+    latency_mode(n, HASHTABLE_MODE_SIMD);
+    latency_mode(n, HASHTABLE_MODE_ROBIN_HOOD);
+    latency_mode(n, HASHTABLE_MODE_CUCKOO);
+}
+
+#define BATCH_SIZE 4096
+
+/**
+ * Loads n items one add_item at a time and then through add_items_batch,
+ * and looks them up (shuffled) with get_item and get_items_batch.
+ */
+void batch_mode(int n, HashtableMode mode) {
+    char (*ids)[16] = malloc(n * sizeof(*ids));
+    Item *items = (Item *)malloc(n * sizeof(Item));
+    const char **lookups = (const char **)malloc(n * sizeof(char *));
+    Item **results = (Item **)malloc(BATCH_SIZE * sizeof(Item *));
+    for (int i = 0; i < n; i++) {
+        snprintf(ids[i], sizeof(ids[i]), "F%d", i);
+        items[i] = (Item){ids[i], "Item", 1.0, i};
+    }
+    for (int i = 0; i < n; i++) {
+        lookups[i] = ids[rand() % n];
+    }
+
+    NeuHashtable *single = create_hashtable_mode(INITIAL_CAPACITY, mode);
+    long long start = now_ns();
+    for (int i = 0; i < n; i++) {
+        add_item(single, items[i].itemID, items[i].itemName, items[i].itemPrice, items[i].itemQuantity);
+    }
+    double single_add = (now_ns() - start) / 1e9;
+    start = now_ns();
+    int found = 0;
+    for (int i = 0; i < n; i++) {
+        found += get_item(single, lookups[i]) != NULL;
+    }
+    double single_get = (now_ns() - start) / 1e9;
+
+    NeuHashtable *batched = create_hashtable_mode(INITIAL_CAPACITY, mode);
+    start = now_ns();
+    for (int i = 0; i < n; i += BATCH_SIZE) {
+        add_items_batch(batched, items + i, n - i < BATCH_SIZE ? n - i : BATCH_SIZE);
+    }
+    double batch_add = (now_ns() - start) / 1e9;
+    start = now_ns();
+    for (int i = 0; i < n; i += BATCH_SIZE) {
+        found += get_items_batch(batched, lookups + i, n - i < BATCH_SIZE ? n - i : BATCH_SIZE, results);
+    }
+    double batch_get = (now_ns() - start) / 1e9;
+
+    if (found != 2 * n || batched->size != (size_t)n) {
+        fprintf(stderr, "%s: batch results do not match\n", mode_name(mode));
+    }
+    printf("%-12s %10.4f %10.4f %10.4f %10.4f\n", mode_name(mode), single_add, batch_add, single_get, batch_get);
+
+    free_hashtable(single);
+    free_hashtable(batched);
+    free(ids);
+    free(items);
+    free(lookups);
+    free(results);
+}
+
+/**
+ * Runs batch_mode for every engine.
+ */
+void batch_benchmark(int n) {
+    srand(time(NULL));
+    printf("Single vs batched (%d per batch) with %d items (seconds)\n", BATCH_SIZE, n);
+    printf("%-12s %10s %10s %10s %10s\n", "mode", "add", "add batch", "get", "get batch");
+    batch_mode(n, HASHTABLE_MODE_CHAINING);
+    batch_mode(n, HASHTABLE_MODE_INCREMENTAL);
+    batch_mode(n, HASHTABLE_MODE_SIMD);
+    batch_mode(n, HASHTABLE_MODE_ROBIN_HOOD);
+    batch_mode(n, HASHTABLE_MODE_CUCKOO);
+}
+
+#define SNAPSHOT_PATH "hashtableTest.img"
+
+/**
+ * Times rebuilding n items with add_item against mapping a saved image,
+ * then compares random lookups on the mapped and the in-memory table.
+ */
+void snapshot_benchmark(int n) {
+    srand(time(NULL));
+    char itemID[16];
+    long long start = now_ns();
+    NeuHashtable *built = create_hashtable_mode(INITIAL_CAPACITY, HASHTABLE_MODE_CHAINING);
+    randomized_test(built, n);
+    double build_time = (now_ns() - start) / 1e9;
+
+    start = now_ns();
+    if (!save_hashtable(built, SNAPSHOT_PATH)) {
+        perror("save_hashtable");
+        free_hashtable(built);
+        return;
+    }
+    double save_time = (now_ns() - start) / 1e9;
+
+    start = now_ns();
+    NeuHashtable *mapped = open_hashtable_mmap(SNAPSHOT_PATH);
+    double open_time = (now_ns() - start) / 1e9;
+    if (mapped == NULL) {
+        perror("open_hashtable_mmap");
+        free_hashtable(built);
+        return;
+    }
+
+    int found = 0;
+    start = now_ns();
+    for (int i = 0; i < n; i++) {
+        snprintf(itemID, sizeof(itemID), "F%d", rand() % n);
+        found += get_item(built, itemID) != NULL;
+    }
+    double built_get = (now_ns() - start) / 1e9;
+    start = now_ns();
+    for (int i = 0; i < n; i++) {
+        snprintf(itemID, sizeof(itemID), "F%d", rand() % n);
+        found += get_item(mapped, itemID) != NULL;
+    }
+    double mapped_get = (now_ns() - start) / 1e9;
+    if (found != 2 * n) {
+        fprintf(stderr, "snapshot: expected %d hits, found %d\n", 2 * n, found);
+    }
+
+    printf("Snapshot of %d items (seconds)\n", n);
+    printf("build with add_item %10.4f\n", build_time);
+    printf("save_hashtable      %10.4f\n", save_time);
+    printf("open_hashtable_mmap %10.4f\n", open_time);
+    printf("get (in memory)     %10.4f\n", built_get);
+    printf("get (mapped)        %10.4f\n", mapped_get);
+
+    free_hashtable(mapped);
+    free_hashtable(built);
+    remove(SNAPSHOT_PATH);
+}
+
+#define WAL_PATH SNAPSHOT_PATH ".wal"
+
+/**
+ * Times n upserts on a durable table with the given commit interval and
+ * returns the upserts per second. The log is left in place for reopening.
+ */
+double wal_mode(int n, unsigned commit_interval_ms) {
+    char itemID[16];
+    remove(SNAPSHOT_PATH);
+    remove(WAL_PATH);
+    NeuHashtable *durable = open_hashtable_durable(SNAPSHOT_PATH, HASHTABLE_MODE_CHAINING, commit_interval_ms);
+    if (durable == NULL) {
+        perror("open_hashtable_durable");
+        return 0.0;
+    }
+    long long start = now_ns();
+    for (int i = 0; i < n; i++) {
+        snprintf(itemID, sizeof(itemID), "F%d", i);
+        upsert_item(durable, itemID, "Durable", 1.0 + i % 100, i % 50);
+    }
+    sync_hashtable(durable);
+    double seconds = (now_ns() - start) / 1e9;
+    free_hashtable(durable);
+    return n / seconds;
+}
+
+/**
+ * Compares a sync per upsert with group commit, then times recovery by
+ * replaying the log and by mapping a checkpoint.
+ */
+void wal_benchmark(int n, unsigned commit_interval_ms) {
+    int synced_ops = n < 2000 ? n : 2000; // one fdatasync each, so keep it short
+    double synced_rate = wal_mode(synced_ops, 0);
+    double group_rate = wal_mode(n, commit_interval_ms);
+
+    long long start = now_ns();
+    NeuHashtable *durable = open_hashtable_durable(SNAPSHOT_PATH, HASHTABLE_MODE_CHAINING, commit_interval_ms);
+    double replay_time = (now_ns() - start) / 1e9;
+    if (durable == NULL || durable->size != (size_t)n) {
+        fprintf(stderr, "wal: expected %d items after replay\n", n);
+        free_hashtable(durable);
+        return;
+    }
+    start = now_ns();
+    checkpoint_hashtable(durable);
+    double checkpoint_time = (now_ns() - start) / 1e9;
+    free_hashtable(durable);
+    start = now_ns();
+    durable = open_hashtable_durable(SNAPSHOT_PATH, HASHTABLE_MODE_CHAINING, commit_interval_ms);
+    double open_time = (now_ns() - start) / 1e9;
+
+    printf("Write-ahead log, %d upserts\n", n);
+    printf("sync per upsert       %12.0f upserts/s (%d upserts)\n", synced_rate, synced_ops);
+    printf("group commit (%4u ms) %12.0f upserts/s\n", commit_interval_ms, group_rate);
+    printf("replay log            %12.4f s\n", replay_time);
+    printf("checkpoint            %12.4f s\n", checkpoint_time);
+    printf("open after checkpoint %12.4f s\n", open_time);
+    free_hashtable(durable);
+    remove(SNAPSHOT_PATH);
+    remove(WAL_PATH);
+}
+
+/**
+ * Times n lookups, 90% of them misses, on one engine with and without a
+ * Bloom filter, and prints the filter's counters.
+ */
+void bloom_mode(int n, HashtableMode mode, double false_positive_rate) {
+    char itemID[16];
+    double times[2];
+    for (int with_filter = 0; with_filter < 2; with_filter++) {
+        NeuHashtable *hashtable = create_hashtable_mode(INITIAL_CAPACITY, mode);
+        randomized_test(hashtable, n);
+        if (with_filter) {
+            enable_bloom_filter(hashtable, false_positive_rate);
+        }
+        srand(42); // both runs look up the same keys
+        int found = 0;
+        long long start = now_ns();
+        for (int i = 0; i < n; i++) {
+            snprintf(itemID, sizeof(itemID), "%c%d", rand() % 10 == 0 ? 'F' : 'M', rand() % n);
+            found += get_item(hashtable, itemID) != NULL;
+        }
+        times[with_filter] = (now_ns() - start) / 1e9;
+        if (with_filter) {
+            NeuBloomFilter *bloom = hashtable->bloom;
+            size_t misses = bloom->rejected + bloom->false_positives;
+            printf("%-12s %10.4f %10.4f %10zu %10zu %10zu %9.3f%%\n", mode_name(mode), times[0], times[1],
+                   bloom->rejected, bloom->passed, bloom->false_positives,
+                   misses == 0 ? 0.0 : 100.0 * bloom->false_positives / misses);
+        }
+        free_hashtable(hashtable);
+    }
+}
+
+/**
+ * Runs bloom_mode for every engine.
+ */
+void bloom_benchmark(int n, double false_positive_rate) {
+    printf("Miss-heavy lookups with %d items, filter target %.3f%% (seconds)\n", n, false_positive_rate * 100);
+    printf("%-12s %10s %10s %10s %10s %10s %10s\n", "mode", "no filter", "filter", "rejected", "passed", "false pos", "fp rate");
+    bloom_mode(n, HASHTABLE_MODE_CHAINING, false_positive_rate);
+    bloom_mode(n, HASHTABLE_MODE_INCREMENTAL, false_positive_rate);
+    bloom_mode(n, HASHTABLE_MODE_SIMD, false_positive_rate);
+    bloom_mode(n, HASHTABLE_MODE_ROBIN_HOOD, false_positive_rate);
+    bloom_mode(n, HASHTABLE_MODE_CUCKOO, false_positive_rate);
+}
+
+/**
+ * Puts a cache of max_items items in front of a pretend backing store and
+ * runs n skewed lookups over 10 * max_items keys, adding every miss.
+ * Cubing a uniform number makes low keys far more popular than high ones.
+ */
+void cache_mode(int n, size_t max_items) {
+    char itemID[16];
+    NeuHashtable *cache = create_hashtable_mode((int)max_items, HASHTABLE_MODE_CACHE);
+    double keys = (double)max_items * 10;
+    srand(42);
+    long long start = now_ns();
+    for (int i = 0; i < n; i++) {
+        double r = (double)rand() / RAND_MAX;
+        snprintf(itemID, sizeof(itemID), "F%d", (int)(r * r * r * keys));
+        if (get_item(cache, itemID) == NULL) {
+            add_item(cache, itemID, "Fetched", 1.0, 1);
+        }
+    }
+    double seconds = (now_ns() - start) / 1e9;
+    printf("%10zu %10.4f %10zu %10zu %10zu %9.2f%%\n", max_items, seconds, cache->cache_hits, cache->cache_misses,
+           cache->cache_evictions, 100.0 * cache->cache_hits / (cache->cache_hits + cache->cache_misses));
+    free_hashtable(cache);
+}
+
+/**
+ * Runs cache_mode for a few cache sizes.
+ */
+void cache_benchmark(int n) {
+    printf("Read-through cache, %d skewed lookups over 10x the cache size (seconds)\n", n);
+    printf("%10s %10s %10s %10s %10s %10s\n", "items", "time", "hits", "misses", "evictions", "hit rate");
+    for (size_t max_items = 1000; max_items <= (size_t)n; max_items *= 10) {
+        cache_mode(n, max_items);
+    }
+}
+
+#define STATS_SAMPLE 1024
+
+/**
+ * Fills each engine with n items and prints its full statistics as JSON,
+ * with the time a full scan and a sampled scan take.
+ */
+void stats_benchmark(int n) {
+    HashtableMode modes[5] = {HASHTABLE_MODE_CHAINING, HASHTABLE_MODE_INCREMENTAL, HASHTABLE_MODE_SIMD, HASHTABLE_MODE_ROBIN_HOOD,
+                              HASHTABLE_MODE_CUCKOO};
+    NeuHashtableStats stats;
+    for (int m = 0; m < 5; m++) {
+        NeuHashtable *hashtable = create_hashtable_mode(INITIAL_CAPACITY, modes[m]);
+        randomized_test(hashtable, n);
+        long long start = now_ns();
+        hashtable_stats(hashtable, &stats, STATS_SAMPLE);
+        double sampled = (now_ns() - start) / 1e9;
+        start = now_ns();
+        hashtable_stats(hashtable, &stats, 0);
+        double full = (now_ns() - start) / 1e9;
+        fprintf(stderr, "%s: full scan %.4fs, %d position sample %.6fs\n", mode_name(modes[m]), full, STATS_SAMPLE, sampled);
+        hashtable_stats_json(&stats, stdout);
+        free_hashtable(hashtable);
+    }
+}
+
+#define THREAD_BENCH_OPS 1000000 // operations per thread
+#define THREAD_BENCH_READ_PERCENT 90
+
+/**
+ * Fills one engine with n items, removes 99% of them and prints the
+ * capacity and memory after the purge and after hashtable_compact.
+ */
+void purge_mode(int n, HashtableMode mode) {
+    char itemID[16];
+    NeuHashtable *hashtable = create_hashtable_mode(INITIAL_CAPACITY, mode);
+    for (int i = 0; i < n; i++) {
+        snprintf(itemID, sizeof(itemID), "P%d", i);
+        add_item(hashtable, itemID, "Purged", 1.0, i);
+    }
+    NeuHashtableStats stats;
+    hashtable_stats(hashtable, &stats, STATS_SAMPLE);
+    size_t full_capacity = hashtable->capacity;
+    size_t full_bytes = stats.bytes;
+
+    long long start = now_ns();
+    for (int i = 0; i < n; i++) {
+        if (i % 100 != 0) {
+            snprintf(itemID, sizeof(itemID), "P%d", i);
+            remove_item(hashtable, itemID);
+        }
+    }
+    double purge_time = (now_ns() - start) / 1e9;
+    hashtable_stats(hashtable, &stats, STATS_SAMPLE);
+    size_t purged_capacity = hashtable->capacity;
+    size_t purged_bytes = stats.bytes;
+
+    start = now_ns();
+    hashtable_compact(hashtable);
+    double compact_time = (now_ns() - start) / 1e9;
+    hashtable_stats(hashtable, &stats, STATS_SAMPLE);
+    printf("%-12s %10zu %10zu %10zu %10.4f %12zu %12zu %12zu %10.4f\n", mode_name(mode), full_capacity, purged_capacity,
+           hashtable->capacity, purge_time, full_bytes, purged_bytes, stats.bytes, compact_time);
+    free_hashtable(hashtable);
+}
+
+void purge_benchmark(int n) {
+    printf("Removing 99%% of %d items, then compacting (capacity, bytes, seconds)\n", n);
+    printf("%-12s %10s %10s %10s %10s %12s %12s %12s %10s\n", "mode", "full", "purged", "compacted", "purge",
+           "full bytes", "purged", "compacted", "compact");
+    purge_mode(n, HASHTABLE_MODE_CHAINING);
+    purge_mode(n, HASHTABLE_MODE_INCREMENTAL);
+    purge_mode(n, HASHTABLE_MODE_SIMD);
+    purge_mode(n, HASHTABLE_MODE_ROBIN_HOOD);
+    purge_mode(n, HASHTABLE_MODE_CUCKOO);
+}
+
+/**
+ * Arguments for one benchmark thread. Either concurrent is set, or
+ * hashtable is shared behind the global mutex.
+ */
+typedef struct {
+    NeuConcurrentHashtable *concurrent;
+    NeuHashtable *hashtable;
+    pthread_mutex_t *mutex;
+    int keys;
+    unsigned int seed;
+} BenchThread;
+
+/**
+ * Runs a read/write mix: THREAD_BENCH_READ_PERCENT gets, the rest split
+ * evenly between adds and removes of random keys.
+ */
+void *bench_worker(void *arg) {
+    BenchThread *bench = (BenchThread *)arg;
+    char itemID[16];
+    unsigned int seed = bench->seed;
+    for (int i = 0; i < THREAD_BENCH_OPS; i++) {
+        int key = rand_r(&seed) % bench->keys;
+        int op = rand_r(&seed) % 100;
+        snprintf(itemID, sizeof(itemID), "F%d", key);
+        if (bench->concurrent != NULL) {
+            if (op < THREAD_BENCH_READ_PERCENT) {
+                concurrent_read_lock(bench->concurrent);
+                concurrent_get_item(bench->concurrent, itemID);
+                concurrent_read_unlock(bench->concurrent);
+            } else if (op % 2 == 0) {
+                concurrent_add_item(bench->concurrent, itemID, "Item", 1.0, 1);
+            } else {
+                concurrent_remove_item(bench->concurrent, itemID);
+            }
+        } else {
+            pthread_mutex_lock(bench->mutex);
+            if (op < THREAD_BENCH_READ_PERCENT) {
+                get_item(bench->hashtable, itemID);
+            } else if (op % 2 == 0) {
+                if (get_item(bench->hashtable, itemID) == NULL) {
+                    add_item(bench->hashtable, itemID, "Item", 1.0, 1);
+                }
+            } else {
+                remove_item(bench->hashtable, itemID);
+            }
+            pthread_mutex_unlock(bench->mutex);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Runs bench_worker on the given number of threads and returns
+ * the total throughput in millions of operations per second.
+ */
+double run_bench_threads(int threads, NeuConcurrentHashtable *concurrent, NeuHashtable *hashtable, int keys) {
+    pthread_t *ids = (pthread_t *)malloc(threads * sizeof(pthread_t));
+    BenchThread *args = (BenchThread *)malloc(threads * sizeof(BenchThread));
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+    long long start = now_ns();
+    for (int t = 0; t < threads; t++) {
+        args[t] = (BenchThread){concurrent, hashtable, &mutex, keys, (unsigned int)(t + 1) * 7919};
+        pthread_create(&ids[t], NULL, bench_worker, &args[t]);
+    }
+    for (int t = 0; t < threads; t++) {
+        pthread_join(ids[t], NULL);
+    }
+    double seconds = (now_ns() - start) / 1e9;
+
+    free(ids);
+    free(args);
+    return (double)threads * THREAD_BENCH_OPS / seconds / 1e6;
+}
+
+/**
+ * Compares a NeuHashtable behind one global mutex with NeuConcurrentHashtable
+ * on a 90% read mix, doubling the thread count from 1 up to max_threads.
+ */
+void thread_benchmark(int n, int max_threads) {
+    printf("Read/write mix (%d%% reads) over %d keys, %d ops per thread\n", THREAD_BENCH_READ_PERCENT, 2 * n, THREAD_BENCH_OPS);
+    printf("%-8s %14s %14s %10s\n", "threads", "mutex Mops/s", "striped Mops/s", "scaling");
+    double single = 0;
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        NeuHashtable *hashtable = create_hashtable(INITIAL_CAPACITY);
+        NeuConcurrentHashtable *concurrent = create_concurrent_hashtable(INITIAL_CAPACITY);
+        char itemID[16];
+        for (int i = 0; i < n; i++) {
+            snprintf(itemID, sizeof(itemID), "F%d", i * 2); // every other key is present
+            add_item(hashtable, itemID, "Item", 1.0, 1);
+            concurrent_add_item(concurrent, itemID, "Item", 1.0, 1);
+        }
+        double locked = run_bench_threads(threads, NULL, hashtable, 2 * n);
+        double striped = run_bench_threads(threads, concurrent, NULL, 2 * n);
+        if (threads == 1) {
+            single = striped;
+        }
+        printf("%-8d %14.2f %14.2f %9.2fx\n", threads, locked, striped, striped / single);
+        free_hashtable(hashtable);
+        free_concurrent_hashtable(concurrent);
+    }
+}
+
+#define SHARDED_BENCH_SHARDS 64
+
+/**
+ * Compares loading n items one add_item at a time with sharded_bulk_load
+ * on 1..max_threads threads.
+ */
+void sharded_benchmark(int n, int max_threads) {
+    char (*ids)[16] = malloc(n * sizeof(*ids));
+    Item *items = (Item *)malloc(n * sizeof(Item));
+    for (int i = 0; i < n; i++) {
+        snprintf(ids[i], sizeof(ids[i]), "F%d", i);
+        items[i] = (Item){ids[i], "Item", 1.0, i};
+    }
+    printf("Loading %d items into %d shards (seconds)\n", n, SHARDED_BENCH_SHARDS);
+    printf("%-8s %10s %10s\n", "threads", "time", "scaling");
+
+    NeuHashtable *single = create_hashtable(INITIAL_CAPACITY);
+    long long start = now_ns();
+    for (int i = 0; i < n; i++) {
+        add_item(single, items[i].itemID, items[i].itemName, items[i].itemPrice, items[i].itemQuantity);
+    }
+    double baseline = (now_ns() - start) / 1e9;
+    printf("%-8s %10.4f %9.2fx\n", "add_item", baseline, 1.0);
+    free_hashtable(single);
+
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        NeuShardedHashtable *sharded = create_sharded_hashtable(INITIAL_CAPACITY, SHARDED_BENCH_SHARDS, HASHTABLE_MODE_CHAINING);
+        start = now_ns();
+        size_t added = sharded_bulk_load(sharded, items, n, threads);
+        double seconds = (now_ns() - start) / 1e9;
+        if (added != (size_t)n) {
+            fprintf(stderr, "bulk load added %zu of %d items\n", added, n);
+        }
+        printf("%-8d %10.4f %9.2fx\n", threads, seconds, baseline / seconds);
+        free_sharded_hashtable(sharded);
+    }
+    free(ids);
+    free(items);
+}
+
+static void sum_quantity(const Item *item, void *context) {
+    *(long long *)context += item->itemQuantity;
+}
+
+/**
+ * Checks that a parallel bulk load puts every item in the right shard,
+ * skips duplicates and that sharded_for_each visits each item once.
+ */
+void sharded_test() {
+    char ids[1000][16];
+    Item items[1000];
+    for (int i = 0; i < 1000; i++) {
+        snprintf(ids[i], sizeof(ids[i]), "F%d", i % 995); // the last 5 repeat earlier IDs
+        items[i] = (Item){ids[i], "Item", 1.0, i};
+    }
+    NeuShardedHashtable *sharded = create_sharded_hashtable(2, 8, HASHTABLE_MODE_CHAINING);
+    sharded_add_item(sharded, "F5", "Early", 2.0, 0);
+    size_t added = sharded_bulk_load(sharded, items, 1000, 4);
+    sharded_remove_item(sharded, "F6");
+
+    long long total = 0;
+    sharded_for_each(sharded, sum_quantity, &total);
+    Item *early = sharded_get_item(sharded, "F5");
+    Item *late = sharded_get_item(sharded, "F994");
+    // quantities 0..994 except 5 and 6, plus the early F5's 0
+    if (added == 994 && sharded_get_size(sharded) == 994 && total == 994 * 995 / 2 - 5 - 6 &&
+        early != NULL && strcmp(early->itemName, "Early") == 0 && late != NULL && late->itemQuantity == 994 &&
+        sharded_get_item(sharded, "F6") == NULL) {
+        printf("Sharded test passed\n");
+    } else {
+        printf("Sharded test failed\n");
+    }
+    free_sharded_hashtable(sharded);
+}
+
+NEU_HASHTABLE_DECLARE(ItemById, uint64_t, Item, neu_hash_int, neu_equals_int)
+NEU_HASHTABLE_DECLARE(QuantityByName, const char *, int, neu_hash_string, neu_equals_string)
+
+/**
+ * Orders two exported items by ID, for the qsort baseline.
+ */
+int compare_item_ids(const void *a, const void *b) {
+    return strcmp(((const Item *)a)->itemID, ((const Item *)b)->itemID);
+}
+
+int compare_item_prices(const void *a, const void *b) {
+    double x = ((const Item *)a)->itemPrice;
+    double y = ((const Item *)b)->itemPrice;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Fills one engine with n items and times a full hashtable_scan, an export,
+ * and the sorted exports against exporting and sorting with qsort.
+ */
+void export_mode(int n, HashtableMode mode) {
+    NeuHashtable *hashtable = create_hashtable_mode(INITIAL_CAPACITY, mode);
+    randomized_test(hashtable, n);
+    Item *items = (Item *)malloc(n * sizeof(Item));
+    if (items == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    long long total = 0;
+    long long start = now_ns();
+    size_t cursor = 0;
+    do {
+        cursor = hashtable_scan(hashtable, cursor, sum_quantity, &total);
+    } while (cursor != 0);
+    double scan_time = (now_ns() - start) / 1e9;
+
+    start = now_ns();
+    hashtable_export(hashtable, items, n);
+    double export_time = (now_ns() - start) / 1e9;
+
+    double times[4];
+    for (int key = 0; key < 2; key++) {
+        start = now_ns();
+        hashtable_export_sorted(hashtable, items, n, key == 0 ? HASHTABLE_SORT_BY_ID : HASHTABLE_SORT_BY_PRICE);
+        times[key * 2] = (now_ns() - start) / 1e9;
+        start = now_ns();
+        size_t count = hashtable_export(hashtable, items, n);
+        qsort(items, count, sizeof(Item), key == 0 ? compare_item_ids : compare_item_prices);
+        times[key * 2 + 1] = (now_ns() - start) / 1e9;
+    }
+    printf("%-12s %10.4f %10.4f %10.4f %10.4f %10.4f %10.4f\n", mode_name(mode), scan_time, export_time, times[0], times[1],
+           times[2], times[3]);
+    free(items);
+    free_hashtable(hashtable);
+}
+
+void export_benchmark(int n) {
+    printf("Enumerating %d items (seconds)\n", n);
+    printf("%-12s %10s %10s %10s %10s %10s %10s\n", "mode", "scan", "export", "id radix", "id qsort", "price radix",
+           "price qsort");
+    export_mode(n, HASHTABLE_MODE_CHAINING);
+    export_mode(n, HASHTABLE_MODE_INCREMENTAL);
+    export_mode(n, HASHTABLE_MODE_SIMD);
+    export_mode(n, HASHTABLE_MODE_ROBIN_HOOD);
+    export_mode(n, HASHTABLE_MODE_CUCKOO);
+}
+
+/**
+ * Times n adds and n lookups of numeric IDs in NeuIntHashtable against
+ * NeuHashtable, which needs every ID printed into a string first.
+ */
+void int_key_benchmark(int n) {
+    char itemID[16];
+    printf("%d numeric IDs, int keys vs string keys (seconds)\n", n);
+    printf("%-12s %10s %10s\n", "table", "add", "get");
+
+    NeuIntHashtable *ints = NeuIntHashtable_create(INITIAL_CAPACITY);
+    long long start = now_ns();
+    for (int i = 0; i < n; i++) {
+        NeuIntHashtable_put(ints, (uint64_t)i * 7919, i);
+    }
+    double add = (now_ns() - start) / 1e9;
+    srand(42);
+    long long found = 0;
+    start = now_ns();
+    for (int i = 0; i < n; i++) {
+        found += NeuIntHashtable_get(ints, (uint64_t)(rand() % n) * 7919) != NULL;
+    }
+    printf("%-12s %10.4f %10.4f\n", "int", add, (now_ns() - start) / 1e9);
+    NeuIntHashtable_free(ints);
+
+    HashtableMode modes[2] = {HASHTABLE_MODE_CHAINING, HASHTABLE_MODE_ROBIN_HOOD};
+    for (int m = 0; m < 2; m++) {
+        NeuHashtable *strings = create_hashtable_mode(INITIAL_CAPACITY, modes[m]);
+        start = now_ns();
+        for (int i = 0; i < n; i++) {
+            snprintf(itemID, sizeof(itemID), "%d", i * 7919);
+            add_item(strings, itemID, "Item", 1.0, i);
+        }
+        add = (now_ns() - start) / 1e9;
+        srand(42);
+        start = now_ns();
+        for (int i = 0; i < n; i++) {
+            snprintf(itemID, sizeof(itemID), "%d", (rand() % n) * 7919);
+            found += get_item(strings, itemID) != NULL;
+        }
+        printf("%-12s %10.4f %10.4f\n", mode_name(modes[m]), add, (now_ns() - start) / 1e9);
+        free_hashtable(strings);
+    }
+    if (found != 3LL * n) {
+        fprintf(stderr, "int key benchmark lost items\n");
+    }
+}
+
+/**
+ * Checks the macro generated tables: integer to integer through several
+ * grows and removes, integer to struct, and string keys.
+ */
+void generic_test() {
+    NeuIntHashtable *ints = NeuIntHashtable_create(2);
+    for (uint64_t i = 0; i < 1000; i++) {
+        NeuIntHashtable_put(ints, i, (int64_t)i * 2);
+    }
+    NeuIntHashtable_put(ints, 7, -1);
+    for (uint64_t i = 0; i < 1000; i += 2) {
+        NeuIntHashtable_remove(ints, i);
+    }
+    bool ints_ok = ints->size == 500 && !NeuIntHashtable_remove(ints, 4);
+    for (uint64_t i = 1; i < 1000; i += 2) {
+        int64_t *value = NeuIntHashtable_get(ints, i);
+        ints_ok = ints_ok && value != NULL && *value == (i == 7 ? -1 : (int64_t)i * 2);
+        ints_ok = ints_ok && NeuIntHashtable_get(ints, i - 1) == NULL;
+    }
+    NeuIntHashtable_free(ints);
+
+    ItemById *items = ItemById_create(4);
+    ItemById_put(items, 101, (Item){"F101", "Pineapple", 5.99, 10});
+    ItemById_put(items, 102, (Item){"F102", "Mango", 3.99, 20});
+    Item *mango = ItemById_get(items, 102);
+
+    QuantityByName *names = QuantityByName_create(4);
+    QuantityByName_put(names, "Banana", 30);
+    QuantityByName_put(names, "Apple", 40);
+    char key[] = "Apple"; // a different pointer to an equal string
+    int *apples = QuantityByName_get(names, key);
+
+    if (ints_ok && mango != NULL && strcmp(mango->itemName, "Mango") == 0 && ItemById_get(items, 103) == NULL &&
+        apples != NULL && *apples == 40 && QuantityByName_get(names, "Kiwi") == NULL) {
+        printf("Generic test passed\n");
+    } else {
+        printf("Generic test failed\n");
+    }
+    ItemById_free(items);
+    QuantityByName_free(names);
+}
+
+/**
+ * Checks the basic operations of the concurrent hashtable from one thread.
+ */
+void concurrent_test() {
+    NeuConcurrentHashtable *hashtable = create_concurrent_hashtable(2);
+    concurrent_add_item(hashtable, "F101", "Pineapple", 5.99, 10);
+    concurrent_add_item(hashtable, "F102", "Mango", 3.99, 20);
+    bool duplicate = concurrent_add_item(hashtable, "F101", "Pineapple", 5.99, 10);
+    concurrent_remove_item(hashtable, "F102");
+
+    concurrent_read_lock(hashtable);
+    const Item *item = concurrent_get_item(hashtable, "F101");
+    const Item *removed = concurrent_get_item(hashtable, "F102");
+    if (item != NULL && item->itemQuantity == 10 && removed == NULL && !duplicate &&
+        concurrent_get_size(hashtable) == 1) {
+        printf("Concurrent test passed\n");
+    } else {
+        printf("Concurrent test failed\n");
+    }
+    concurrent_read_unlock(hashtable);
+    free_concurrent_hashtable(hashtable);
+}
+
+void *short_reader(void *arg) {
+    NeuConcurrentHashtable *hashtable = (NeuConcurrentHashtable *)arg;
+    concurrent_read_lock(hashtable);
+    const Item *item = concurrent_get_item(hashtable, "F101");
+    concurrent_read_unlock(hashtable);
+    return (void *)item;
+}
+
+/**
+ * Starts more reader threads than there are reader slots, one after the
+ * other, so each has to reuse the slot of one that already exited.
+ */
+void reader_slot_test() {
+    NeuConcurrentHashtable *hashtable = create_concurrent_hashtable(2);
+    concurrent_add_item(hashtable, "F101", "Pineapple", 5.99, 10);
+    bool found = true;
+    for (int i = 0; i < CONCURRENT_MAX_THREADS + 8; i++) {
+        pthread_t id;
+        void *item;
+        pthread_create(&id, NULL, short_reader, hashtable);
+        pthread_join(id, &item);
+        found = found && item != NULL;
+    }
+    if (found) {
+        printf("Reader slot test passed\n");
+    } else {
+        printf("Reader slot test failed\n");
+    }
+    free_concurrent_hashtable(hashtable);
+}
+
+/**
+ * Checks that a reservation on a SIMD table with tombstones covers them
+ * too, so add_items_batch up to the reserved size never rebuilds the table
+ * part way through.
+ */
+void batch_reserve_test() {
+    char ids[2792][16];
+    Item items[1000];
+    NeuHashtable *hashtable = create_hashtable_mode(8, HASHTABLE_MODE_SIMD);
+    for (int i = 0; i < 1792; i++) { // exactly SIMD_MAX_LOAD_FACTOR of 2048 slots
+        snprintf(ids[i], sizeof(ids[i]), "R%d", i);
+        add_item(hashtable, ids[i], "Old", 1.0, i);
+    }
+    for (int i = 0; i < 1000; i++) {
+        remove_item(hashtable, ids[i]); // leaves tombstones in full groups
+    }
+    for (int i = 0; i < 1000; i++) {
+        snprintf(ids[1792 + i], sizeof(ids[1792 + i]), "B%d", i);
+        items[i] = (Item){ids[1792 + i], "New", 2.0, i};
+    }
+    bool tombstones = hashtable->tombstones > 0;
+    hashtable_reserve(hashtable, hashtable->size + 1000);
+    size_t resizes = hashtable->resizes;
+    size_t added = add_items_batch(hashtable, items, 1000);
+
+    Item *results[1000];
+    const char *keys[1000];
+    for (int i = 0; i < 1000; i++) {
+        keys[i] = ids[1792 + i];
+    }
+    size_t found = get_items_batch(hashtable, keys, 1000, results);
+    if (tombstones && added == 1000 && hashtable->resizes == resizes && found == 1000 && hashtable->size == 1792) {
+        printf("Batch reserve test passed\n");
+    } else {
+        printf("Batch reserve test failed\n");
+    }
+    free_hashtable(hashtable);
+}
+
+/**
+ * Checks that a purge shrinks the table, that hashtable_compact gives the
+ * memory back without losing items, and that a reservation holds the
+ * capacity through removes.
+ */
+void shrink_test(HashtableMode mode) {
+    char itemID[16];
+    NeuHashtable *hashtable = create_hashtable_mode(8, mode);
+    for (int i = 0; i < 20000; i++) {
+        snprintf(itemID, sizeof(itemID), "S%d", i);
+        add_item(hashtable, itemID, i % 2 ? "Odd" : "Even", 1.0, i);
+    }
+    size_t full_capacity = hashtable->capacity;
+    for (int i = 100; i < 20000; i++) {
+        snprintf(itemID, sizeof(itemID), "S%d", i);
+        remove_item(hashtable, itemID);
+    }
+    // an incremental shrink finishes over the next few operations
+    for (int i = 0; i < 100; i++) {
+        snprintf(itemID, sizeof(itemID), "S%d", i);
+        get_item(hashtable, itemID);
+        upsert_item(hashtable, itemID, i % 2 ? "Odd" : "Even", 1.0, i);
+    }
+    bool shrunk = hashtable->capacity < full_capacity / 16 && get_load_factor(hashtable) >= SHRINK_LOAD_FACTOR;
+
+    NeuHashtableStats before, after;
+    hashtable_stats(hashtable, &before, 0);
+    hashtable_compact(hashtable);
+    hashtable_stats(hashtable, &after, 0);
+    bool compacted = hashtable->size == 100 && after.bytes < before.bytes;
+    for (int i = 0; i < 100; i++) {
+        snprintf(itemID, sizeof(itemID), "S%d", i);
+        Item *item = get_item(hashtable, itemID);
+        compacted = compacted && item != NULL && item->itemQuantity == i &&
+                    strcmp(item->itemName, i % 2 ? "Odd" : "Even") == 0;
+    }
+
+    hashtable_reserve(hashtable, 50000);
+    size_t reserved_capacity = hashtable->capacity;
+    for (int i = 0; i < 100; i++) {
+        snprintf(itemID, sizeof(itemID), "S%d", i);
+        remove_item(hashtable, itemID);
+    }
+    bool reserved = reserved_capacity >= full_capacity && hashtable->capacity == reserved_capacity && hashtable->size == 0;
+
+    if (shrunk && compacted && reserved) {
+        printf("Shrink test passed (%s)\n", mode_name(mode));
+    } else {
+        printf("Shrink test failed (%s)\n", mode_name(mode));
+    }
+    free_hashtable(hashtable);
+}
+
+typedef struct {
+    bool *seen;
+    size_t visits;
+} ScanCheck;
+
+static void mark_seen(const Item *item, void *context) {
+    ScanCheck *check = (ScanCheck *)context;
+    check->seen[item->itemQuantity] = true;
+    check->visits++;
+}
+
+/**
+ * Checks that hashtable_scan visits every item, for the chaining engines
+ * also while the table grows and shrinks between calls, and that the
+ * exports copy every item in the requested order.
+ */
+void scan_test(HashtableMode mode) {
+    char itemID[32];
+    bool resizable = mode == HASHTABLE_MODE_CHAINING || mode == HASHTABLE_MODE_INCREMENTAL;
+    NeuHashtable *hashtable = create_hashtable_mode(8, mode);
+    for (int i = 0; i < 1000; i++) {
+        // long shared prefixes so sorting by ID needs more than the first 8 bytes
+        snprintf(itemID, sizeof(itemID), i % 2 ? "C%d" : "LONGPREFIX%d", i);
+        add_item(hashtable, itemID, "Scanned", (i * 7919 % 1000) - 500.0, i);
+    }
+
+    bool seen[5000] = {false};
+    ScanCheck check = {seen, 0};
+    size_t cursor = 0;
+    int added = 0;
+    do {
+        cursor = hashtable_scan(hashtable, cursor, mark_seen, &check);
+        for (int i = 0; resizable && i < 8 && added < 4000; i++, added++) {
+            snprintf(itemID, sizeof(itemID), "G%d", added);
+            add_item(hashtable, itemID, "Grown", 0.0, 1000 + added);
+        }
+    } while (cursor != 0);
+    bool grown = true;
+    for (int i = 0; i < 1000; i++) {
+        grown = grown && seen[i];
+    }
+
+    memset(seen, 0, sizeof(seen));
+    int removed = 0;
+    do {
+        cursor = hashtable_scan(hashtable, cursor, mark_seen, &check);
+        for (int i = 0; i < 16 && removed < added; i++, removed++) {
+            snprintf(itemID, sizeof(itemID), "G%d", removed);
+            remove_item(hashtable, itemID);
+        }
+    } while (cursor != 0);
+    bool shrunk = hashtable->size == 1000;
+    for (int i = 0; i < 1000; i++) {
+        shrunk = shrunk && seen[i];
+    }
+
+    Item items[1000];
+    bool exported = hashtable_export(hashtable, items, 1000) == 1000 && hashtable_export(hashtable, items, 10) == 10;
+    for (int i = 0; i < 1000; i++) {
+        Item *item = get_item(hashtable, items[i].itemID);
+        exported = exported && item != NULL && item->itemQuantity == items[i].itemQuantity;
+    }
+
+    Item first[5];
+    bool sorted = hashtable_export_sorted(hashtable, items, 1000, HASHTABLE_SORT_BY_ID) == 1000 &&
+                  hashtable_export_sorted(hashtable, first, 5, HASHTABLE_SORT_BY_ID) == 5;
+    for (int i = 1; i < 1000; i++) {
+        sorted = sorted && strcmp(items[i - 1].itemID, items[i].itemID) < 0;
+    }
+    for (int i = 0; i < 5; i++) {
+        sorted = sorted && strcmp(first[i].itemID, items[i].itemID) == 0;
+    }
+    sorted = sorted && hashtable_export_sorted(hashtable, items, 1000, HASHTABLE_SORT_BY_PRICE) == 1000;
+    for (int i = 1; i < 1000; i++) {
+        sorted = sorted && items[i - 1].itemPrice <= items[i].itemPrice;
+    }
+    sorted = sorted && items[0].itemPrice == -500.0 && items[999].itemPrice == 499.0;
+
+    if (grown && shrunk && exported && sorted) {
+        printf("Scan test passed (%s)\n", mode_name(mode));
+    } else {
+        printf("Scan test failed (%s)\n", mode_name(mode));
+    }
+    free_hashtable(hashtable);
+}
+
+/**
+ * Checks upsert_item and adjust_quantity against one engine.
+ */
+void upsert_test(HashtableMode mode) {
+    NeuHashtable *hashtable = create_hashtable_mode(2, mode);
+    UpsertResult first = upsert_item(hashtable, "F101", "Pineapple", 5.99, 10);
+    UpsertResult second = upsert_item(hashtable, "F101", "Golden Pineapple", 6.49, 12);
+    UpsertResult adjusted = adjust_quantity(hashtable, "F101", -5);
+    UpsertResult missing = adjust_quantity(hashtable, "F999", 1);
+
+    Item *item = get_item(hashtable, "F101");
+    if (first == ITEM_INSERTED && second == ITEM_UPDATED && adjusted == ITEM_UPDATED &&
+        missing == ITEM_NOT_FOUND && hashtable->size == 1 && item != NULL &&
+        item->itemQuantity == 7 && item->itemPrice == 6.49 && strcmp(item->itemName, "Golden Pineapple") == 0) {
+        printf("Upsert test passed (%s)\n", mode_name(mode));
+    } else {
+        printf("Upsert test failed (%s)\n", mode_name(mode));
+    }
+    free_hashtable(hashtable);
+}
+
+/**
+ * Saves a small table of one engine, maps it back and checks that lookups
+ * work on the image and that the first write promotes it.
+ */
+void snapshot_test(HashtableMode mode) {
+    NeuHashtable *hashtable = create_hashtable_mode(2, mode);
+    add_item(hashtable, "F101", "Pineapple", 5.99, 10);
+    add_item(hashtable, "F102", "Mango", 3.99, 20);
+    add_item(hashtable, "F103", "Banana", 1.99, 30);
+    bool saved = save_hashtable(hashtable, SNAPSHOT_PATH);
+    free_hashtable(hashtable);
+
+    NeuHashtable *mapped = saved ? open_hashtable_mmap(SNAPSHOT_PATH) : NULL;
+    remove(SNAPSHOT_PATH); // the mapping stays valid after the file is removed
+    if (mapped == NULL) {
+        printf("Snapshot test failed (%s)\n", mode_name(mode));
+        return;
+    }
+    Item *item = get_item(mapped, "F102");
+    bool read_ok = mapped->mode == HASHTABLE_MODE_MAPPED && mapped->size == 3 && item != NULL &&
+                   item->itemQuantity == 20 && strcmp(item->itemName, "Mango") == 0 &&
+                   get_item(mapped, "F999") == NULL;
+    remove_item(mapped, "F999"); // a miss does not promote
+    bool still_mapped = mapped->mode == HASHTABLE_MODE_MAPPED;
+    adjust_quantity(mapped, "F101", 5);
+    item = get_item(mapped, "F101");
+    bool promoted = mapped->mode == mode && item != NULL && item->itemQuantity == 15 && mapped->size == 3;
+
+    if (read_ok && still_mapped && promoted) {
+        printf("Snapshot test passed (%s)\n", mode_name(mode));
+    } else {
+        printf("Snapshot test failed (%s)\n", mode_name(mode));
+    }
+    free_hashtable(mapped);
+}
+
+/**
+ * Checks that a durable table comes back from its log, from a checkpoint
+ * plus a short log, from a log with a torn last record, and that writes to
+ * a table reopened from a checkpoint alone are still logged.
+ */
+void wal_test(HashtableMode mode) {
+    remove(SNAPSHOT_PATH);
+    remove(WAL_PATH);
+    NeuHashtable *durable = open_hashtable_durable(SNAPSHOT_PATH, mode, 5);
+    add_item(durable, "F101", "Pineapple", 5.99, 10);
+    add_item(durable, "F102", "Mango", 3.99, 20);
+    add_item(durable, "F103", "Banana", 1.99, 30);
+    upsert_item(durable, "F102", "Ripe Mango", 4.49, 25);
+    adjust_quantity(durable, "F101", 5);
+    remove_item(durable, "F103");
+    free_hashtable(durable);
+
+    durable = open_hashtable_durable(SNAPSHOT_PATH, mode, 5);
+    Item *item = get_item(durable, "F102");
+    bool replayed = durable->size == 2 && item != NULL && strcmp(item->itemName, "Ripe Mango") == 0 &&
+                    item->itemQuantity == 25 && get_item(durable, "F101")->itemQuantity == 15 &&
+                    get_item(durable, "F103") == NULL;
+
+    bool checkpointed = checkpoint_hashtable(durable);
+    FILE *log = fopen(WAL_PATH, "rb");
+    fseek(log, 0, SEEK_END);
+    checkpointed = checkpointed && ftell(log) == 0;
+    fclose(log);
+    add_item(durable, "F104", "Kiwi", 0.99, 40);
+    free_hashtable(durable);
+
+    log = fopen(WAL_PATH, "ab"); // half a record, as a crash in the middle of a write leaves it
+    fwrite("\x01\x02\x03\x04\x01\x04", 6, 1, log);
+    fclose(log);
+    durable = open_hashtable_durable(SNAPSHOT_PATH, mode, 5);
+    item = get_item(durable, "F104");
+    bool recovered = durable->size == 3 && item != NULL && item->itemQuantity == 40 &&
+                     get_item(durable, "F101")->itemQuantity == 15;
+    add_item(durable, "F105", "Lime", 0.49, 50); // lands after the cut off tail
+    free_hashtable(durable);
+    durable = open_hashtable_durable(SNAPSHOT_PATH, mode, 5);
+    recovered = recovered && durable->size == 4 && get_item(durable, "F105") != NULL;
+    checkpoint_hashtable(durable);
+    free_hashtable(durable);
+
+    // with an empty log the snapshot stays mapped, and the first write promotes it
+    durable = open_hashtable_durable(SNAPSHOT_PATH, mode, 5);
+    bool mapped = durable->mode == HASHTABLE_MODE_MAPPED;
+    add_item(durable, "F106", "Plum", 0.79, 60);
+    remove_item(durable, "F101");
+    free_hashtable(durable);
+    durable = open_hashtable_durable(SNAPSHOT_PATH, mode, 5);
+    item = get_item(durable, "F106");
+    bool promoted = mapped && durable->size == 4 && item != NULL && item->itemQuantity == 60 &&
+                    get_item(durable, "F101") == NULL;
+    free_hashtable(durable);
+    remove(SNAPSHOT_PATH);
+    remove(WAL_PATH);
+
+    if (replayed && checkpointed && recovered && promoted) {
+        printf("WAL test passed (%s)\n", mode_name(mode));
+    } else {
+        printf("WAL test failed (%s)\n", mode_name(mode));
+    }
+}
+
+/**
+ * Checks that a Bloom filter never hides an item, survives resizes,
+ * short-circuits lookups of absent keys and counts false positives the same
+ * for single and batched lookups.
+ */
+void bloom_test(HashtableMode mode) {
+    NeuHashtable *hashtable = create_hashtable_mode(2, mode);
+    enable_bloom_filter(hashtable, 0.01);
+    randomized_test(hashtable, 1000); // grows the table several times
+    remove_item(hashtable, "F7");
+
+    int found = 0;
+    char itemID[16];
+    for (int i = 0; i < 1000; i++) {
+        snprintf(itemID, sizeof(itemID), "F%d", i);
+        found += get_item(hashtable, itemID) != NULL;
+    }
+    for (int i = 0; i < 1000; i++) {
+        snprintf(itemID, sizeof(itemID), "M%d", i);
+        found += get_item(hashtable, itemID) != NULL;
+    }
+    NeuBloomFilter *bloom = hashtable->bloom;
+    bool counted = found == 999 && bloom->rejected > 900 && bloom->false_positives <= 1000 - bloom->rejected + 1;
+
+    // the same lookups batched must count the same way: every passed query
+    // is either a hit or a false positive
+    char ids[2000][16];
+    const char *keys[2000];
+    Item *results[2000];
+    for (int i = 0; i < 2000; i++) {
+        snprintf(ids[i], sizeof(ids[i]), "%c%d", i < 1000 ? 'F' : 'M', i % 1000);
+        keys[i] = ids[i];
+    }
+    size_t hits = bloom->passed - bloom->false_positives;
+    size_t batch_found = get_items_batch(hashtable, keys, 2000, results);
+    if (counted && batch_found == 999 && bloom->passed - bloom->false_positives == hits + 999) {
+        printf("Bloom test passed (%s)\n", mode_name(mode));
+    } else {
+        printf("Bloom test failed (%s)\n", mode_name(mode));
+    }
+    free_hashtable(hashtable);
+}
+
+/**
+ * Checks that a full cache evicts the item that was not used since the
+ * clock hand last passed it, and keeps its counters.
+ */
+void cache_test() {
+    NeuHashtable *cache = create_hashtable_mode(3, HASHTABLE_MODE_CACHE);
+    add_item(cache, "F101", "Pineapple", 5.99, 10);
+    add_item(cache, "F102", "Mango", 3.99, 20);
+    add_item(cache, "F103", "Banana", 1.99, 30);
+    get_item(cache, "F101");
+    add_item(cache, "F104", "Apple", 2.99, 40); // F101 gets a second chance, F102 goes
+    upsert_item(cache, "F103", "Plantain", 2.49, 31);
+    remove_item(cache, "F104");
+    add_item(cache, "F105", "Kiwi", 0.99, 50);
+
+    Item *renamed = get_item(cache, "F103");
+    if (get_item(cache, "F102") == NULL && get_item(cache, "F101") != NULL && get_item(cache, "F105") != NULL &&
+        renamed != NULL && strcmp(renamed->itemName, "Plantain") == 0 && cache->size == 3 &&
+        cache->cache_evictions == 1 && cache->cache_hits == 4 && cache->cache_misses == 1) {
+        printf("Cache test passed\n");
+    } else {
+        printf("Cache test failed\n");
+    }
+    free_hashtable(cache);
+}
+
+static size_t constant_hash(const char *key, size_t length, uint64_t seed) {
+    return 42;
+}
+
+/**
+ * Fills a cuckoo table past the point where inserts must move residents,
+ * then checks that every item is still found within two buckets and that
+ * removes leave the rest reachable.
+ */
+void cuckoo_test() {
+    char itemID[16];
+    NeuHashtable *hashtable = create_hashtable_mode(8, HASHTABLE_MODE_CUCKOO);
+    for (int i = 0; i < 50000; i++) {
+        snprintf(itemID, sizeof(itemID), "C%d", i);
+        add_item(hashtable, itemID, "Cuckoo", 1.0, i);
+    }
+    bool filled = hashtable->size == 50000 && get_load_factor(hashtable) > 0.35 &&
+                  get_max_probe_length(hashtable) <= (hashtable->stash_size > 0 ? 3 : 2);
+    for (int i = 0; i < 50000; i += 2) {
+        snprintf(itemID, sizeof(itemID), "C%d", i);
+        remove_item(hashtable, itemID);
+    }
+    bool found = hashtable->size == 25000;
+    for (int i = 0; i < 50000; i++) {
+        snprintf(itemID, sizeof(itemID), "C%d", i);
+        Item *item = get_item(hashtable, itemID);
+        found = found && (i % 2 == 0 ? item == NULL : item != NULL && item->itemQuantity == i);
+    }
+    free_hashtable(hashtable);
+
+    // every key in the same two buckets: only the stash can take the rest
+    hashtable = create_hashtable_mode(8, HASHTABLE_MODE_CUCKOO);
+    set_hash_function(hashtable, constant_hash, 0);
+    for (int i = 0; i < 100; i++) {
+        snprintf(itemID, sizeof(itemID), "C%d", i);
+        add_item(hashtable, itemID, "Cuckoo", 1.0, i);
+    }
+    bool colliding = hashtable->size == 100 && hashtable->capacity < 1024;
+    for (int i = 0; i < 100; i++) {
+        snprintf(itemID, sizeof(itemID), "C%d", i);
+        Item *item = get_item(hashtable, itemID);
+        colliding = colliding && item != NULL && item->itemQuantity == i;
+    }
+    if (filled && found && colliding) {
+        printf("Cuckoo test passed\n");
+    } else {
+        printf("Cuckoo test failed\n");
+    }
+    free_hashtable(hashtable);
+}
+
+/**
+ * Checks that a full hashtable_stats scan agrees with the probe length
+ * functions, that its histogram covers the table, and that a sample stays
+ * within its budget.
+ */
+void stats_test(HashtableMode mode) {
+    NeuHashtable *hashtable = create_hashtable_mode(2, mode);
+    randomized_test(hashtable, 5000);
+    NeuHashtableStats stats;
+    hashtable_stats(hashtable, &stats, 0);
+    size_t histogram_total = 0;
+    for (int i = 0; i < STATS_HISTOGRAM_BUCKETS; i++) {
+        histogram_total += stats.histogram[i];
+    }
+    // chaining counts buckets, open addressing counts items
+    size_t expected_total = mode == HASHTABLE_MODE_SIMD || mode == HASHTABLE_MODE_ROBIN_HOOD ? hashtable->size : stats.positions;
+    bool full_ok = histogram_total == expected_total && stats.sampled == stats.positions &&
+                   stats.max_hit_probes == get_max_probe_length(hashtable) &&
+                   stats.mean_hit_probes > get_mean_probe_length(hashtable) - 1e-9 &&
+                   stats.mean_hit_probes < get_mean_probe_length(hashtable) + 1e-9 &&
+                   stats.resizes > 0 && stats.bytes_per_entry > sizeof(Item);
+    hashtable_stats(hashtable, &stats, 64);
+    if (full_ok && stats.sampled >= 64 && stats.sampled <= 128 && stats.mean_miss_probes >= 0.0) {
+        printf("Stats test passed (%s)\n", mode_name(mode));
+    } else {
+        printf("Stats test failed (%s)\n", mode_name(mode));
+    }
+    free_hashtable(hashtable);
+}
+
+void simple_test(HashtableMode mode) {
     // Create a new hashtable
-    NeuHashtable* hashtable = create_hashtable(2);
+    NeuHashtable* hashtable = create_hashtable_mode(2, mode);
     add_item(hashtable, "F101", "Pineapple", 5.99, 10);
     add_item(hashtable, "F102", "Mango", 3.99, 20);
     add_item(hashtable, "F103", "Banana", 1.99, 30);
     add_item(hashtable, "F104", "Apple", 2.99, 40);
+    remove_item(hashtable, "F102");
 
     // Print the hashtable
-    printf("Hashtable contents:\n");
+    printf("Hashtable contents (%s):\n", mode_name(mode));
     print_hashtable(hashtable);
     print_table_visual(hashtable);
     printf("Load factor: %.2f\n", get_load_factor(hashtable));
+    printf("Probe length: max %zu, mean %.2f\n", get_max_probe_length(hashtable), get_mean_probe_length(hashtable));
 
     // Free the hashtable
     free_hashtable(hashtable);
     
 }
 
+/**
+ * Usage:
+ *   hashtableTest.out               runs the simple test for every engine
+ *   hashtableTest.out N [chain|incremental|simd|robin|cuckoo] adds N random items with one engine
+ *   hashtableTest.out N compare  benchmarks every engine side by side
+ *   hashtableTest.out N latency  prints p50/p99/p999 insert latency per engine
+ *   hashtableTest.out N hashes   throughput and chain lengths per hash function
+ *   hashtableTest.out N snapshot rebuild vs save + mmap startup time
+ *   hashtableTest.out N wal [MS]  sync per upsert vs group commit every MS ms (default 10), replay and checkpoint time
+ *   hashtableTest.out N bloom [P] miss-heavy lookups with and without a Bloom filter (target rate P, default 0.01)
+ *   hashtableTest.out N cache    hit rate and evictions of bounded caches under a skewed read-through load
+ *   hashtableTest.out N stats    hashtable_stats of every engine as JSON, full scan vs sample
+ *   hashtableTest.out N purge    capacity and memory after removing 99% of the items, and after hashtable_compact
+ *   hashtableTest.out N export   full scan, export and radix sorted exports vs qsort per engine
+ *   hashtableTest.out N batch    single vs batched adds and gets per engine
+ *   hashtableTest.out N threads [T]  read/write mix on 1..T threads, mutex vs striped
+ *   hashtableTest.out N intkeys  NeuIntHashtable vs NeuHashtable with numeric IDs
+ *   hashtableTest.out N sharded [T]  add_item vs sharded_bulk_load on 1..T threads
+ */
 int main(int argc, char *argv[]) {
     if (argc < 2) {
-        simple_test();
+        simple_test(HASHTABLE_MODE_CHAINING);
+        simple_test(HASHTABLE_MODE_INCREMENTAL);
+        simple_test(HASHTABLE_MODE_SIMD);
+        simple_test(HASHTABLE_MODE_ROBIN_HOOD);
+        simple_test(HASHTABLE_MODE_CUCKOO);
+        upsert_test(HASHTABLE_MODE_CHAINING);
+        upsert_test(HASHTABLE_MODE_INCREMENTAL);
+        upsert_test(HASHTABLE_MODE_SIMD);
+        upsert_test(HASHTABLE_MODE_ROBIN_HOOD);
+        upsert_test(HASHTABLE_MODE_CUCKOO);
+        shrink_test(HASHTABLE_MODE_CHAINING);
+        shrink_test(HASHTABLE_MODE_INCREMENTAL);
+        shrink_test(HASHTABLE_MODE_SIMD);
+        shrink_test(HASHTABLE_MODE_ROBIN_HOOD);
+        shrink_test(HASHTABLE_MODE_CUCKOO);
+        scan_test(HASHTABLE_MODE_CHAINING);
+        scan_test(HASHTABLE_MODE_INCREMENTAL);
+        scan_test(HASHTABLE_MODE_SIMD);
+        scan_test(HASHTABLE_MODE_ROBIN_HOOD);
+        scan_test(HASHTABLE_MODE_CUCKOO);
+        snapshot_test(HASHTABLE_MODE_CHAINING);
+        snapshot_test(HASHTABLE_MODE_INCREMENTAL);
+        snapshot_test(HASHTABLE_MODE_SIMD);
+        snapshot_test(HASHTABLE_MODE_ROBIN_HOOD);
+        snapshot_test(HASHTABLE_MODE_CUCKOO);
+        wal_test(HASHTABLE_MODE_CHAINING);
+        wal_test(HASHTABLE_MODE_INCREMENTAL);
+        wal_test(HASHTABLE_MODE_SIMD);
+        wal_test(HASHTABLE_MODE_ROBIN_HOOD);
+        wal_test(HASHTABLE_MODE_CUCKOO);
+        bloom_test(HASHTABLE_MODE_CHAINING);
+        bloom_test(HASHTABLE_MODE_INCREMENTAL);
+        bloom_test(HASHTABLE_MODE_SIMD);
+        bloom_test(HASHTABLE_MODE_ROBIN_HOOD);
+        bloom_test(HASHTABLE_MODE_CUCKOO);
+        stats_test(HASHTABLE_MODE_CHAINING);
+        stats_test(HASHTABLE_MODE_INCREMENTAL);
+        stats_test(HASHTABLE_MODE_SIMD);
+        stats_test(HASHTABLE_MODE_ROBIN_HOOD);
+        stats_test(HASHTABLE_MODE_CUCKOO);
+        cuckoo_test();
+        cache_test();
+        sharded_test();
+        generic_test();
+        concurrent_test();
+        reader_slot_test();
+        batch_reserve_test();
     }
     else {
         int n = atoi(argv[1]);
@@ -85,9 +1548,59 @@ int main(int argc, char *argv[]) {
             fprintf(stderr, "Invalid number of items: %s\n", argv[1]);
             return 1;
         }
-        test_hashtable(n);
+        HashtableMode mode = HASHTABLE_MODE_CHAINING;
+        if (argc > 2 && strcmp(argv[2], "compare") == 0) {
+            compare_modes(n);
+        }
+        else if (argc > 2 && strcmp(argv[2], "latency") == 0) {
+            latency_benchmark(n);
+        }
+        else if (argc > 2 && strcmp(argv[2], "hashes") == 0) {
+            hash_benchmark(n);
+        }
+        else if (argc > 2 && strcmp(argv[2], "snapshot") == 0) {
+            snapshot_benchmark(n);
+        }
+        else if (argc > 2 && strcmp(argv[2], "wal") == 0) {
+            wal_benchmark(n, argc > 3 ? (unsigned)atoi(argv[3]) : 10);
+        }
+        else if (argc > 2 && strcmp(argv[2], "bloom") == 0) {
+            bloom_benchmark(n, argc > 3 ? atof(argv[3]) : 0.01);
+        }
+        else if (argc > 2 && strcmp(argv[2], "stats") == 0) {
+            stats_benchmark(n);
+        }
+        else if (argc > 2 && strcmp(argv[2], "cache") == 0) {
+            cache_benchmark(n);
+        }
+        else if (argc > 2 && strcmp(argv[2], "purge") == 0) {
+            purge_benchmark(n);
+        }
+        else if (argc > 2 && strcmp(argv[2], "export") == 0) {
+            export_benchmark(n);
+        }
+        else if (argc > 2 && strcmp(argv[2], "batch") == 0) {
+            batch_benchmark(n);
+        }
+        else if (argc > 2 && strcmp(argv[2], "intkeys") == 0) {
+            int_key_benchmark(n);
+        }
+        else if (argc > 2 && strcmp(argv[2], "sharded") == 0) {
+            int max_threads = argc > 3 ? atoi(argv[3]) : 8;
+            sharded_benchmark(n, max_threads > 0 ? max_threads : 1);
+        }
+        else if (argc > 2 && strcmp(argv[2], "threads") == 0) {
+            int max_threads = argc > 3 ? atoi(argv[3]) : 8;
+            thread_benchmark(n, max_threads > 0 ? max_threads : 1);
+        }
+        else if (argc > 2 && !parse_mode(argv[2], &mode)) {
+            fprintf(stderr, "Unknown mode: %s\n", argv[2]);
+            return 1;
+        }
+        else {
+            test_hashtable(n, mode);
+        }
     }
 
     return 0;
-}
-
+}
\ No newline at end of file
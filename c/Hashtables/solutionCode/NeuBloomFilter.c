@@ -0,0 +1,111 @@
+/**
+ * Blocked Bloom filter used in front of NeuHashtable lookups.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "NeuBloomFilter.h"
+
+/**
+ * Remixes the table's hash (murmur3 finalizer), so a weak table hash still
+ * gives independent looking block and bit positions.
+ */
+static inline uint64_t __bloom_mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+/**
+ * Maps the high 32 bits of the hash onto [0, num_blocks) with a multiply
+ * instead of a modulo, so the block count need not be a power of two.
+ */
+static inline size_t __bloom_block(const NeuBloomFilter* filter, uint64_t mixed) {
+    return (size_t)(((mixed >> 32) * (uint64_t)filter->num_blocks) >> 32);
+}
+
+/**
+ * Gets the stride between the bits of one key. It is odd, so the probes
+ * cycle through every bit of the block before repeating.
+ */
+static inline uint32_t __bloom_step(uint64_t mixed) {
+    return (uint32_t)((mixed * 0x9E3779B97F4A7C15ULL) >> 32) | 1;
+}
+
+/**
+ * Sizes the filter for expected_items keys at the given false positive rate.
+ * @param filter The filter to initialize.
+ * @param expected_items How many keys the filter is expected to hold.
+ * @param false_positive_rate The target, for example 0.01 for 1%.
+ */
+void bloom_init(NeuBloomFilter* filter, size_t expected_items, double false_positive_rate) {
+    memset(filter, 0, sizeof(NeuBloomFilter));
+    if (false_positive_rate <= 0.0 || false_positive_rate >= 1.0) {
+        false_positive_rate = 0.01;
+    }
+    if (expected_items == 0) {
+        expected_items = 1;
+    }
+    // optimal bits per key for a classic filter, plus a quarter for blocking
+    double bits_per_item = -log(false_positive_rate) / (M_LN2 * M_LN2) * 1.25;
+    int num_hashes = (int)lround(bits_per_item / 1.25 * M_LN2);
+    filter->num_hashes = num_hashes < 1 ? 1 : (num_hashes > BLOOM_MAX_HASHES ? BLOOM_MAX_HASHES : num_hashes);
+
+    size_t num_blocks = (size_t)ceil(bits_per_item * expected_items / BLOOM_BLOCK_BITS);
+    if (num_blocks == 0) {
+        num_blocks = 1;
+    }
+    filter->blocks = (uint64_t*)aligned_alloc(64, num_blocks * BLOOM_BLOCK_WORDS * sizeof(uint64_t));
+    if (filter->blocks == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    memset(filter->blocks, 0, num_blocks * BLOOM_BLOCK_WORDS * sizeof(uint64_t));
+    filter->num_blocks = num_blocks;
+    filter->false_positive_rate = false_positive_rate;
+}
+
+void bloom_free(NeuBloomFilter* filter) {
+    free(filter->blocks);
+    filter->blocks = NULL;
+    filter->num_blocks = 0;
+}
+
+/**
+ * Adds a key by its hash.
+ */
+void bloom_add(NeuBloomFilter* filter, uint64_t hash) {
+    uint64_t mixed = __bloom_mix(hash);
+    uint64_t* block = filter->blocks + __bloom_block(filter, mixed) * BLOOM_BLOCK_WORDS;
+    uint32_t h1 = (uint32_t)mixed;
+    uint32_t h2 = __bloom_step(mixed);
+    for (int i = 0; i < filter->num_hashes; i++) {
+        uint32_t bit = (h1 + i * h2) & (BLOOM_BLOCK_BITS - 1);
+        block[bit >> 6] |= 1ULL << (bit & 63);
+    }
+}
+
+/**
+ * Checks whether a key may have been added.
+ * @return false if the key was definitely never added.
+ */
+bool bloom_may_contain(NeuBloomFilter* filter, uint64_t hash) {
+    uint64_t mixed = __bloom_mix(hash);
+    const uint64_t* block = filter->blocks + __bloom_block(filter, mixed) * BLOOM_BLOCK_WORDS;
+    uint32_t h1 = (uint32_t)mixed;
+    uint32_t h2 = __bloom_step(mixed);
+    for (int i = 0; i < filter->num_hashes; i++) {
+        uint32_t bit = (h1 + i * h2) & (BLOOM_BLOCK_BITS - 1);
+        if ((block[bit >> 6] & (1ULL << (bit & 63))) == 0) {
+            filter->rejected++;
+            return false;
+        }
+    }
+    filter->passed++;
+    return true;
+}
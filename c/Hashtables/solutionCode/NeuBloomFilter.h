@@ -0,0 +1,37 @@
+#ifndef NEU_BLOOM_FILTER_H
+#define NEU_BLOOM_FILTER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define BLOOM_BLOCK_BITS 512 // one 64 byte cache line per block
+#define BLOOM_BLOCK_WORDS (BLOOM_BLOCK_BITS / 64)
+#define BLOOM_MAX_HASHES 16
+
+/**
+ * A blocked Bloom filter over precomputed key hashes.
+ *
+ * Each key sets all of its bits inside a single cache line sized block, so
+ * a query costs one cache miss no matter how many bits it checks. The
+ * price is a slightly higher false positive rate than a classic filter of
+ * the same size, which bloom_init pays back by sizing the filter generously.
+ *
+ * Keys cannot be removed; the filter is rebuilt from the table instead.
+ */
+typedef struct {
+    uint64_t* blocks;
+    size_t num_blocks;
+    int num_hashes;           // bits set per key
+    double false_positive_rate;
+    size_t rejected;          // queries answered "absent" without touching the table
+    size_t passed;            // queries that had to check the table
+    size_t false_positives;   // passed queries that still missed, counted by the caller
+} NeuBloomFilter;
+
+void bloom_init(NeuBloomFilter* filter, size_t expected_items, double false_positive_rate);
+void bloom_free(NeuBloomFilter* filter);
+void bloom_add(NeuBloomFilter* filter, uint64_t hash);
+bool bloom_may_contain(NeuBloomFilter* filter, uint64_t hash);
+
+#endif /* NEU_BLOOM_FILTER_H */
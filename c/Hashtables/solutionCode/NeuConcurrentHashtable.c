@@ -0,0 +1,392 @@
+/**
+ * Thread safe hashtable with lock striped writers and epoch protected,
+ * lock free readers.
+ *
+ * Readers call concurrent_read_lock, which copies the global epoch into the
+ * reader's slot. Writers never free memory directly, they retire it with
+ * the epoch it was unlinked in. The global epoch only moves forward once
+ * every active reader has seen the current one, so after two moves no
+ * reader can still hold a pointer to the retired memory.
+ *
+ * Each reader thread claims one of CONCURRENT_MAX_THREADS slots the first
+ * time it reads and gives it back when it exits, so threads may come and go
+ * freely as long as no more than that many read at the same time.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "NeuConcurrentHashtable.h"
+#include "NeuHashtableInternal.h"
+
+static atomic_bool __reader_slot_used[CONCURRENT_MAX_THREADS];
+static atomic_int __next_reader_slot = 0; // one past the highest slot ever claimed
+static _Thread_local int __reader_slot = -1;
+static pthread_key_t __reader_slot_key;
+static pthread_once_t __reader_slot_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Gives a thread's reader slot back when the thread exits. The key's value
+ * is the slot plus one, so it is never NULL and the destructor always runs.
+ */
+static void __release_reader_slot(void* value) {
+    atomic_store(&__reader_slot_used[(intptr_t)value - 1], false);
+}
+
+static void __create_reader_slot_key() {
+    if (pthread_key_create(&__reader_slot_key, __release_reader_slot) != 0) {
+        fprintf(stderr, "Could not create the reader slot key\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * Gets this thread's reader slot, claiming a free one on first use. Slots
+ * are shared by every concurrent hashtable in the process and are freed
+ * when their thread exits, so only CONCURRENT_MAX_THREADS readers may be
+ * alive at once, however many come and go.
+ */
+static int __get_reader_slot() {
+    if (__reader_slot >= 0) {
+        return __reader_slot;
+    }
+    pthread_once(&__reader_slot_once, __create_reader_slot_key);
+    for (int i = 0; i < CONCURRENT_MAX_THREADS; i++) {
+        bool expected = false;
+        if (!atomic_load_explicit(&__reader_slot_used[i], memory_order_relaxed) &&
+            atomic_compare_exchange_strong(&__reader_slot_used[i], &expected, true)) {
+            __reader_slot = i;
+            break;
+        }
+    }
+    if (__reader_slot < 0) {
+        fprintf(stderr, "More than %d reader threads\n", CONCURRENT_MAX_THREADS);
+        exit(EXIT_FAILURE);
+    }
+    pthread_setspecific(__reader_slot_key, (void*)(intptr_t)(__reader_slot + 1));
+    int highest = atomic_load(&__next_reader_slot);
+    while (highest <= __reader_slot && !atomic_compare_exchange_weak(&__next_reader_slot, &highest, __reader_slot + 1)) {
+    }
+    return __reader_slot;
+}
+
+static NeuConcurrentBuckets* __create_buckets(size_t capacity) {
+    NeuConcurrentBuckets* buckets = (NeuConcurrentBuckets*)calloc(1, sizeof(NeuConcurrentBuckets) + capacity * sizeof(NeuConcurrentNode*));
+    if (buckets == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    buckets->capacity = capacity;
+    return buckets;
+}
+
+/**
+ * Allocates a node with room for its strings right after it.
+ */
+static NeuConcurrentNode* __create_concurrent_node(size_t hash, const char* itemID, const char* itemName, double itemPrice, int itemQuantity) {
+    size_t id_size = strlen(itemID) + 1;
+    size_t name_size = strlen(itemName) + 1;
+    NeuConcurrentNode* node = (NeuConcurrentNode*)malloc(sizeof(NeuConcurrentNode) + id_size + name_size);
+    if (node == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    char* strings = (char*)(node + 1);
+    memcpy(strings, itemID, id_size);
+    memcpy(strings + id_size, itemName, name_size);
+    node->hash = hash;
+    node->data.itemID = strings;
+    node->data.itemName = strings + id_size;
+    node->data.itemPrice = itemPrice;
+    node->data.itemQuantity = itemQuantity;
+    atomic_init(&node->next, NULL);
+    return node;
+}
+
+static void __free_bucket_nodes(NeuConcurrentBuckets* buckets) {
+    for (size_t i = 0; i < buckets->capacity; i++) {
+        NeuConcurrentNode* current = atomic_load_explicit(&buckets->buckets[i], memory_order_relaxed);
+        while (current != NULL) {
+            NeuConcurrentNode* next = atomic_load_explicit(&current->next, memory_order_relaxed);
+            free(current);
+            current = next;
+        }
+    }
+    free(buckets);
+}
+
+static void __free_retired(NeuRetired* retired) {
+    if (retired->buckets != NULL) {
+        __free_bucket_nodes(retired->buckets);
+    } else {
+        free(retired->node);
+    }
+    free(retired);
+}
+
+/**
+ * Moves the global epoch forward if every active reader has caught up with it.
+ * Called with retire_lock held.
+ */
+static void __try_advance_epoch(NeuConcurrentHashtable* hashtable) {
+    uint64_t epoch = atomic_load(&hashtable->global_epoch);
+    int slots = atomic_load(&__next_reader_slot);
+    if (slots > CONCURRENT_MAX_THREADS) {
+        slots = CONCURRENT_MAX_THREADS;
+    }
+    for (int i = 0; i < slots; i++) {
+        uint64_t reader_epoch = atomic_load(&hashtable->readers[i].epoch);
+        if (reader_epoch != 0 && reader_epoch != epoch) {
+            return; // a reader is still in an older epoch
+        }
+    }
+    atomic_store(&hashtable->global_epoch, epoch + 1);
+}
+
+/**
+ * Hands memory to the reclaimer and frees everything that was retired at
+ * least two epochs ago.
+ */
+static void __retire(NeuConcurrentHashtable* hashtable, NeuConcurrentNode* node, NeuConcurrentBuckets* buckets) {
+    NeuRetired* retired = (NeuRetired*)malloc(sizeof(NeuRetired));
+    if (retired == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    retired->node = node;
+    retired->buckets = buckets;
+
+    pthread_mutex_lock(&hashtable->retire_lock);
+    retired->retire_epoch = atomic_load(&hashtable->global_epoch);
+    retired->next = hashtable->retired;
+    hashtable->retired = retired;
+
+    __try_advance_epoch(hashtable);
+    uint64_t epoch = atomic_load(&hashtable->global_epoch);
+    NeuRetired** link = &hashtable->retired;
+    while (*link != NULL) {
+        NeuRetired* current = *link;
+        if (current->retire_epoch + 2 <= epoch) {
+            *link = current->next;
+            __free_retired(current);
+        } else {
+            link = &current->next;
+        }
+    }
+    pthread_mutex_unlock(&hashtable->retire_lock);
+}
+
+/**
+ * Creates a new concurrent hashtable.
+ * The capacity is rounded up to a power of two, and to at least CONCURRENT_LOCK_STRIPES
+ * so that every bucket is covered by exactly one stripe lock.
+ *
+ * @param capacity The initial capacity of the hashtable.
+ * @return A pointer to the newly created hashtable.
+ */
+NeuConcurrentHashtable* create_concurrent_hashtable(int capacity) {
+    size_t new_capacity = CONCURRENT_LOCK_STRIPES;
+    while (new_capacity < (size_t)capacity) {
+        new_capacity <<= 1;
+    }
+    NeuConcurrentHashtable* hashtable = (NeuConcurrentHashtable*)calloc(1, sizeof(NeuConcurrentHashtable));
+    if (hashtable == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    atomic_init(&hashtable->buckets, __create_buckets(new_capacity));
+    atomic_init(&hashtable->size, 0);
+    hashtable->seed = hash_random_seed();
+    atomic_init(&hashtable->global_epoch, 1); // 0 marks an idle reader
+    for (int i = 0; i < CONCURRENT_LOCK_STRIPES; i++) {
+        pthread_mutex_init(&hashtable->stripes[i], NULL);
+    }
+    pthread_mutex_init(&hashtable->retire_lock, NULL);
+    return hashtable;
+}
+
+/**
+ * Frees the hashtable and all retired memory.
+ * No other thread may be using the hashtable.
+ * @param hashtable A pointer to the hashtable to free.
+ */
+void free_concurrent_hashtable(NeuConcurrentHashtable* hashtable) {
+    if (hashtable == NULL) {
+        return;
+    }
+    __free_bucket_nodes(atomic_load(&hashtable->buckets));
+    NeuRetired* retired = hashtable->retired;
+    while (retired != NULL) {
+        NeuRetired* next = retired->next;
+        __free_retired(retired);
+        retired = next;
+    }
+    for (int i = 0; i < CONCURRENT_LOCK_STRIPES; i++) {
+        pthread_mutex_destroy(&hashtable->stripes[i]);
+    }
+    pthread_mutex_destroy(&hashtable->retire_lock);
+    free(hashtable);
+}
+
+/**
+ * Starts a read section. Items returned by concurrent_get_item stay valid
+ * until the matching concurrent_read_unlock. Read sections may be nested.
+ * @param hashtable A pointer to the hashtable.
+ */
+void concurrent_read_lock(NeuConcurrentHashtable* hashtable) {
+    NeuReaderSlot* slot = &hashtable->readers[__get_reader_slot()];
+    if (slot->depth++ == 0) {
+        atomic_store(&slot->epoch, atomic_load(&hashtable->global_epoch));
+        atomic_thread_fence(memory_order_seq_cst); // announce before reading any bucket
+    }
+}
+
+/**
+ * Ends a read section started with concurrent_read_lock.
+ * @param hashtable A pointer to the hashtable.
+ */
+void concurrent_read_unlock(NeuConcurrentHashtable* hashtable) {
+    NeuReaderSlot* slot = &hashtable->readers[__get_reader_slot()];
+    if (--slot->depth == 0) {
+        atomic_store_explicit(&slot->epoch, 0, memory_order_release);
+    }
+}
+
+/**
+ * Gets an item without taking any lock.
+ * Must be called between concurrent_read_lock and concurrent_read_unlock.
+ * @param hashtable A pointer to the hashtable.
+ * @param itemID The ID of the item to retrieve.
+ * @return A pointer to the item, valid until the read section ends, or NULL if not found.
+ */
+const Item* concurrent_get_item(NeuConcurrentHashtable* hashtable, const char* itemID) {
+    size_t hash = hash_wyhash(itemID, strlen(itemID), hashtable->seed);
+    NeuConcurrentBuckets* buckets = atomic_load_explicit(&hashtable->buckets, memory_order_acquire);
+    NeuConcurrentNode* current = atomic_load_explicit(&buckets->buckets[hash & (buckets->capacity - 1)], memory_order_acquire);
+    while (current != NULL) {
+        if (current->hash == hash && strcmp(current->data.itemID, itemID) == 0) {
+            return &current->data;
+        }
+        current = atomic_load_explicit(&current->next, memory_order_acquire);
+    }
+    return NULL;
+}
+
+static pthread_mutex_t* __stripe_lock(NeuConcurrentHashtable* hashtable, size_t hash) {
+    return &hashtable->stripes[hash & (CONCURRENT_LOCK_STRIPES - 1)];
+}
+
+/**
+ * Doubles the bucket array. Every stripe lock is taken so no writer is
+ * active, then each node is copied into the new array. The old array and
+ * its nodes are left untouched for readers and retired as a whole.
+ */
+static void __concurrent_resize(NeuConcurrentHashtable* hashtable) {
+    for (int i = 0; i < CONCURRENT_LOCK_STRIPES; i++) {
+        pthread_mutex_lock(&hashtable->stripes[i]);
+    }
+    NeuConcurrentBuckets* old_buckets = atomic_load(&hashtable->buckets);
+    NeuConcurrentBuckets* replaced = NULL;
+    // another writer may have resized while we waited for the locks
+    if ((double)atomic_load(&hashtable->size) / old_buckets->capacity > LOAD_FACTOR) {
+        size_t new_capacity = old_buckets->capacity * SCALE_FACTOR;
+        NeuConcurrentBuckets* new_buckets = __create_buckets(new_capacity);
+        for (size_t i = 0; i < old_buckets->capacity; i++) {
+            NeuConcurrentNode* current = atomic_load_explicit(&old_buckets->buckets[i], memory_order_relaxed);
+            while (current != NULL) {
+                NeuConcurrentNode* copy = __create_concurrent_node(current->hash, current->data.itemID, current->data.itemName,
+                                                                   current->data.itemPrice, current->data.itemQuantity);
+                size_t index = copy->hash & (new_capacity - 1);
+                atomic_store_explicit(&copy->next, atomic_load_explicit(&new_buckets->buckets[index], memory_order_relaxed), memory_order_relaxed);
+                atomic_store_explicit(&new_buckets->buckets[index], copy, memory_order_relaxed);
+                current = atomic_load_explicit(&current->next, memory_order_relaxed);
+            }
+        }
+        atomic_store_explicit(&hashtable->buckets, new_buckets, memory_order_release);
+        replaced = old_buckets;
+    }
+    for (int i = CONCURRENT_LOCK_STRIPES - 1; i >= 0; i--) {
+        pthread_mutex_unlock(&hashtable->stripes[i]);
+    }
+    if (replaced != NULL) {
+        __retire(hashtable, NULL, replaced);
+    }
+}
+
+/**
+ * Adds an item to the hashtable.
+ * @param hashtable A pointer to the hashtable.
+ * @param itemID The ID of the item.
+ * @param itemName The name of the item.
+ * @param itemPrice The price of the item.
+ * @param itemQuantity The quantity of the item.
+ * @return true if the item was added, false if the ID already exists.
+ */
+bool concurrent_add_item(NeuConcurrentHashtable* hashtable, const char* itemID, const char* itemName, double itemPrice, int itemQuantity) {
+    size_t hash = hash_wyhash(itemID, strlen(itemID), hashtable->seed);
+    pthread_mutex_t* lock = __stripe_lock(hashtable, hash);
+    pthread_mutex_lock(lock);
+
+    // holding a stripe lock means no resize can run, so buckets is stable
+    NeuConcurrentBuckets* buckets = atomic_load_explicit(&hashtable->buckets, memory_order_relaxed);
+    _Atomic(NeuConcurrentNode*)* head = &buckets->buckets[hash & (buckets->capacity - 1)];
+    for (NeuConcurrentNode* current = atomic_load_explicit(head, memory_order_relaxed); current != NULL;
+         current = atomic_load_explicit(&current->next, memory_order_relaxed)) {
+        if (current->hash == hash && strcmp(current->data.itemID, itemID) == 0) {
+            pthread_mutex_unlock(lock);
+            return false;
+        }
+    }
+    NeuConcurrentNode* node = __create_concurrent_node(hash, itemID, itemName, itemPrice, itemQuantity);
+    atomic_store_explicit(&node->next, atomic_load_explicit(head, memory_order_relaxed), memory_order_relaxed);
+    atomic_store_explicit(head, node, memory_order_release); // publish the fully built node
+    size_t size = atomic_fetch_add(&hashtable->size, 1) + 1;
+    size_t capacity = buckets->capacity;
+    pthread_mutex_unlock(lock);
+
+    if ((double)size / capacity > LOAD_FACTOR) {
+        __concurrent_resize(hashtable);
+    }
+    return true;
+}
+
+/**
+ * Removes an item from the hashtable. The node is unlinked right away,
+ * but freed only once no reader can still be looking at it.
+ * @param hashtable A pointer to the hashtable.
+ * @param itemID The ID of the item to remove.
+ * @return true if the item was found and removed.
+ */
+bool concurrent_remove_item(NeuConcurrentHashtable* hashtable, const char* itemID) {
+    size_t hash = hash_wyhash(itemID, strlen(itemID), hashtable->seed);
+    pthread_mutex_t* lock = __stripe_lock(hashtable, hash);
+    pthread_mutex_lock(lock);
+
+    NeuConcurrentBuckets* buckets = atomic_load_explicit(&hashtable->buckets, memory_order_relaxed);
+    _Atomic(NeuConcurrentNode*)* link = &buckets->buckets[hash & (buckets->capacity - 1)];
+    NeuConcurrentNode* current = atomic_load_explicit(link, memory_order_relaxed);
+    while (current != NULL) {
+        if (current->hash == hash && strcmp(current->data.itemID, itemID) == 0) {
+            // readers already on this node can still follow its next pointer
+            atomic_store_explicit(link, atomic_load_explicit(&current->next, memory_order_relaxed), memory_order_release);
+            atomic_fetch_sub(&hashtable->size, 1);
+            pthread_mutex_unlock(lock);
+            __retire(hashtable, current, NULL);
+            return true;
+        }
+        link = &current->next;
+        current = atomic_load_explicit(link, memory_order_relaxed);
+    }
+    pthread_mutex_unlock(lock);
+    return false;
+}
+
+/**
+ * Gets the number of items in the hashtable.
+ * @param hashtable A pointer to the hashtable.
+ */
+size_t concurrent_get_size(NeuConcurrentHashtable* hashtable) {
+    return atomic_load(&hashtable->size);
+}
@@ -0,0 +1,79 @@
+#ifndef NEU_CONCURRENT_HASHTABLE_H
+#define NEU_CONCURRENT_HASHTABLE_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "NeuHashtable.h"
+
+#define CONCURRENT_LOCK_STRIPES 64   // writer locks, also the smallest capacity
+#define CONCURRENT_MAX_THREADS 128   // threads that may ever read the table
+
+/**
+ * A chaining node. The item's strings are allocated in the same block,
+ * right after the node, so a node is freed with a single free().
+ */
+typedef struct NeuConcurrentNode {
+    _Atomic(struct NeuConcurrentNode*) next;
+    size_t hash;
+    Item data;
+} NeuConcurrentNode;
+
+typedef struct {
+    size_t capacity;
+    _Atomic(NeuConcurrentNode*) buckets[];
+} NeuConcurrentBuckets;
+
+/**
+ * Memory that was unlinked by a writer but may still be seen by a reader.
+ * It is freed once every reader has moved two epochs past retire_epoch.
+ */
+typedef struct NeuRetired {
+    struct NeuRetired* next;
+    uint64_t retire_epoch;
+    NeuConcurrentNode* node;        // a single removed node, or
+    NeuConcurrentBuckets* buckets;  // a replaced bucket array and all its nodes
+} NeuRetired;
+
+typedef struct {
+    _Alignas(64) _Atomic uint64_t epoch; // 0 when the thread is not reading
+    int depth;                           // nesting of concurrent_read_lock calls
+} NeuReaderSlot;
+
+/**
+ * A hashtable that is safe to share between threads.
+ *
+ * Writers lock one of CONCURRENT_LOCK_STRIPES mutexes, picked by the low
+ * bits of the hash. Readers take no lock at all: they announce the current
+ * epoch, walk the chains with atomic loads, and memory removed by writers
+ * is only freed once no reader can still be looking at it.
+ *
+ * Resizing takes every stripe lock, copies the nodes into a new bucket array
+ * and publishes it with one atomic store. Readers that are still walking the
+ * old array see a complete, unchanged copy of the table.
+ */
+typedef struct {
+    _Atomic(NeuConcurrentBuckets*) buckets;
+    atomic_size_t size;
+    uint64_t seed;  // hash_wyhash seed, random per table
+    pthread_mutex_t stripes[CONCURRENT_LOCK_STRIPES];
+
+    _Atomic uint64_t global_epoch;
+    NeuReaderSlot readers[CONCURRENT_MAX_THREADS];
+    pthread_mutex_t retire_lock;
+    NeuRetired* retired;
+} NeuConcurrentHashtable;
+
+NeuConcurrentHashtable* create_concurrent_hashtable(int capacity);
+void free_concurrent_hashtable(NeuConcurrentHashtable* hashtable);
+bool concurrent_add_item(NeuConcurrentHashtable* hashtable, const char* itemID, const char* itemName, double itemPrice, int itemQuantity);
+bool concurrent_remove_item(NeuConcurrentHashtable* hashtable, const char* itemID);
+void concurrent_read_lock(NeuConcurrentHashtable* hashtable);
+void concurrent_read_unlock(NeuConcurrentHashtable* hashtable);
+const Item* concurrent_get_item(NeuConcurrentHashtable* hashtable, const char* itemID);
+size_t concurrent_get_size(NeuConcurrentHashtable* hashtable);
+
+#endif /* NEU_CONCURRENT_HASHTABLE_H */
@@ -0,0 +1,207 @@
+#ifndef NEU_GENERIC_HASHTABLE_H
+#define NEU_GENERIC_HASHTABLE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "NeuHashFunctions.h"
+
+#define GENERIC_MIN_CAPACITY 8
+#define GENERIC_MAX_LOAD_FACTOR 0.9
+
+/**
+ * Multiplicative (Fibonacci) hash for integer keys: one multiply by 2^64/phi.
+ * The generic tables take the slot from the high bits, which this mixes well.
+ */
+static inline uint64_t neu_hash_int(uint64_t key) {
+    return key * 0x9E3779B97F4A7C15ULL;
+}
+
+static inline bool neu_equals_int(uint64_t a, uint64_t b) {
+    return a == b;
+}
+
+/**
+ * wyhash of a '\0' terminated key, for tables keyed by C strings.
+ * The strings are not copied; they must outlive the table.
+ */
+static inline uint64_t neu_hash_string(const char* key) {
+    return hash_wyhash(key, strlen(key), 0);
+}
+
+static inline bool neu_equals_string(const char* a, const char* b) {
+    return strcmp(a, b) == 0;
+}
+
+/**
+ * Declares a hashtable type `name` mapping K to V, and its functions:
+ *
+ *   name*  name_create(size_t capacity);
+ *   void   name_free(name* table);
+ *   V*     name_get(name* table, K key);           NULL if the key is missing
+ *   V*     name_put(name* table, K key, V value);  adds or overwrites
+ *   bool   name_remove(name* table, K key);
+ *
+ * hash(K) must return a uint64_t whose high bits are well mixed, and
+ * equals(K, K) must return true for equal keys. Both are called directly,
+ * so the compiler inlines them into every function of the instantiation.
+ *
+ * The table is the same Robin Hood linear probing scheme as
+ * HASHTABLE_MODE_ROBIN_HOOD: keys and values sit in one flat array with a
+ * probe distance per slot, and removes shift the following entries back
+ * instead of leaving tombstones. Pointers returned by get and put are only
+ * valid until the next put or remove.
+ *
+ * Use it once per key/value pair in a header or source file, for example
+ *   NEU_HASHTABLE_DECLARE(PriceById, uint64_t, double, neu_hash_int, neu_equals_int)
+ */
+#define NEU_HASHTABLE_DECLARE(name, K, V, hash, equals)                                          \
+    typedef struct {                                                                             \
+        K key;                                                                                   \
+        V value;                                                                                 \
+    } name##Entry;                                                                               \
+                                                                                                 \
+    typedef struct {                                                                             \
+        name##Entry* entries;                                                                    \
+        uint32_t* distances; /* probe distance + 1 per slot, 0 when empty */                     \
+        size_t size;                                                                             \
+        size_t capacity;     /* a power of two */                                                \
+        int shift;           /* 64 - log2(capacity), the slot is hash >> shift */                \
+    } name;                                                                                      \
+                                                                                                 \
+    static inline void name##__alloc(name* table, size_t capacity) {                             \
+        table->entries = (name##Entry*)malloc(capacity * sizeof(name##Entry));                   \
+        table->distances = (uint32_t*)calloc(capacity, sizeof(uint32_t));                         \
+        if (table->entries == NULL || table->distances == NULL) {                                \
+            fprintf(stderr, "Memory allocation failed\n");                                       \
+            exit(EXIT_FAILURE);                                                                  \
+        }                                                                                        \
+        table->capacity = capacity;                                                              \
+        table->shift = 64 - __builtin_ctzll(capacity);                                           \
+    }                                                                                            \
+                                                                                                 \
+    static inline name* name##_create(size_t capacity) {                                         \
+        name* table = (name*)calloc(1, sizeof(name));                                            \
+        if (table == NULL) {                                                                     \
+            fprintf(stderr, "Memory allocation failed\n");                                       \
+            exit(EXIT_FAILURE);                                                                  \
+        }                                                                                        \
+        size_t slots = GENERIC_MIN_CAPACITY;                                                     \
+        while (slots < capacity) {                                                               \
+            slots <<= 1;                                                                         \
+        }                                                                                        \
+        name##__alloc(table, slots);                                                             \
+        return table;                                                                            \
+    }                                                                                            \
+                                                                                                 \
+    static inline void name##_free(name* table) {                                                \
+        if (table != NULL) {                                                                     \
+            free(table->entries);                                                                \
+            free(table->distances);                                                              \
+            free(table);                                                                         \
+        }                                                                                        \
+    }                                                                                            \
+                                                                                                 \
+    static inline size_t name##__home(const name* table, K key) {                                \
+        return (size_t)((uint64_t)hash(key) >> table->shift);                                    \
+    }                                                                                            \
+                                                                                                 \
+    /* carries entry forward from slot, swapping it with every resident that */                  \
+    /* is closer to home, until something lands in an empty slot */                              \
+    static inline void name##__place(name* table, size_t slot, uint32_t distance, name##Entry entry) { \
+        size_t mask = table->capacity - 1;                                                       \
+        while (table->distances[slot] != 0) {                                                    \
+            if (table->distances[slot] < distance) {                                             \
+                name##Entry displaced = table->entries[slot];                                    \
+                uint32_t displaced_distance = table->distances[slot];                            \
+                table->entries[slot] = entry;                                                    \
+                table->distances[slot] = distance;                                               \
+                entry = displaced;                                                               \
+                distance = displaced_distance;                                                   \
+            }                                                                                    \
+            slot = (slot + 1) & mask;                                                            \
+            distance++;                                                                          \
+        }                                                                                        \
+        table->entries[slot] = entry;                                                            \
+        table->distances[slot] = distance;                                                       \
+    }                                                                                            \
+                                                                                                 \
+    static inline void name##__grow(name* table) {                                               \
+        name old = *table;                                                                       \
+        name##__alloc(table, old.capacity * 2);                                                  \
+        for (size_t i = 0; i < old.capacity; i++) {                                              \
+            if (old.distances[i] != 0) {                                                         \
+                name##__place(table, name##__home(table, old.entries[i].key), 1, old.entries[i]); \
+            }                                                                                    \
+        }                                                                                        \
+        free(old.entries);                                                                       \
+        free(old.distances);                                                                     \
+    }                                                                                            \
+                                                                                                 \
+    static inline V* name##_get(name* table, K key) {                                            \
+        size_t mask = table->capacity - 1;                                                       \
+        size_t slot = name##__home(table, key);                                                  \
+        for (uint32_t distance = 1; table->distances[slot] >= distance; distance++) {            \
+            if (equals(table->entries[slot].key, key)) {                                         \
+                return &table->entries[slot].value;                                              \
+            }                                                                                    \
+            slot = (slot + 1) & mask;                                                            \
+        }                                                                                        \
+        return NULL;                                                                             \
+    }                                                                                            \
+                                                                                                 \
+    static inline V* name##_put(name* table, K key, V value) {                                   \
+        size_t mask = table->capacity - 1;                                                       \
+        size_t slot = name##__home(table, key);                                                  \
+        uint32_t distance = 1;                                                                   \
+        for (; table->distances[slot] >= distance; distance++) {                                 \
+            if (equals(table->entries[slot].key, key)) {                                         \
+                table->entries[slot].value = value;                                              \
+                return &table->entries[slot].value;                                              \
+            }                                                                                    \
+            slot = (slot + 1) & mask;                                                            \
+        }                                                                                        \
+        if ((double)(table->size + 1) > table->capacity * GENERIC_MAX_LOAD_FACTOR) {             \
+            name##__grow(table);                                                                 \
+            mask = table->capacity - 1;                                                          \
+            slot = name##__home(table, key);                                                     \
+            for (distance = 1; table->distances[slot] >= distance; distance++) {                 \
+                slot = (slot + 1) & mask;                                                        \
+            }                                                                                    \
+        }                                                                                        \
+        name##Entry entry = {key, value};                                                        \
+        name##__place(table, slot, distance, entry);                                             \
+        table->size++;                                                                           \
+        return &table->entries[slot].value; /* the new entry stays in the first slot */          \
+    }                                                                                            \
+                                                                                                 \
+    static inline bool name##_remove(name* table, K key) {                                       \
+        V* value = name##_get(table, key);                                                       \
+        if (value == NULL) {                                                                     \
+            return false;                                                                        \
+        }                                                                                        \
+        size_t mask = table->capacity - 1;                                                       \
+        size_t slot = (size_t)((name##Entry*)((char*)value - offsetof(name##Entry, value)) - table->entries); \
+        size_t next = (slot + 1) & mask;                                                         \
+        while (table->distances[next] > 1) {                                                     \
+            table->entries[slot] = table->entries[next];                                         \
+            table->distances[slot] = table->distances[next] - 1;                                 \
+            slot = next;                                                                         \
+            next = (next + 1) & mask;                                                            \
+        }                                                                                        \
+        table->distances[slot] = 0;                                                              \
+        table->size--;                                                                           \
+        return true;                                                                             \
+    }
+
+/**
+ * The integer key table: uint64_t IDs to int64_t values, with no string
+ * conversion and no strcmp.
+ */
+NEU_HASHTABLE_DECLARE(NeuIntHashtable, uint64_t, int64_t, neu_hash_int, neu_equals_int)
+
+#endif /* NEU_GENERIC_HASHTABLE_H */
@@ -0,0 +1,216 @@
+/**
+ * String hash functions for the hashtables.
+ *
+ * djb2 reads one byte at a time and mixes poorly: keys that differ only in
+ * their last character land in neighbouring buckets. The other two read the
+ * key eight bytes at a time and finish with a 64x64->128 bit multiply, so
+ * every input bit affects every output bit.
+ *
+ * Only wyhash and xxh3 resist hash flooding. Their seed is mixed into every
+ * block, so without it an attacker cannot pick keys that collide. djb2 only
+ * uses the seed as its start value: two keys of the same length that collide
+ * for one seed collide for all of them, so it must not be used for keys an
+ * attacker controls.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "NeuHashFunctions.h"
+
+static const uint64_t __wy_secret[4] = {
+    0xa0761d6478bd642full, 0xe7037ed1a0b428dbull, 0x8ebc6af09c88c6e3ull, 0x589965cc75374cc3ull
+};
+
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ull
+#define XXH_PRIME_MX1 0x165667919E3779F9ull
+#define XXH_PRIME_MX2 0x9FB21C651E98DF25ull
+
+static const uint64_t __xxh_secret[8] = {
+    0xbe4ba423396cfeb8ull, 0x1cad21f72c81017cull, 0xdb979083e96dd4deull, 0x1f67b3b7a4a44072ull,
+    0x78e5c0cc4ee679cbull, 0x2172ffcc7dd05a82ull, 0x8e2443f7744608b8ull, 0x4c263a81e69035e0ull
+};
+
+static inline uint64_t __read64(const uint8_t* p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v)); // unaligned load, compiles to a single mov
+    return v;
+}
+
+static inline uint64_t __read32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/**
+ * Multiplies two 64 bit values and folds the 128 bit product back to 64 bits.
+ */
+static inline uint64_t __mul_fold64(uint64_t a, uint64_t b) {
+    __uint128_t product = (__uint128_t)a * b;
+    return (uint64_t)product ^ (uint64_t)(product >> 64);
+}
+
+static inline uint64_t __rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+/**
+ * The classic djb2 hash (hash * 33 + c), starting from 5381 mixed with the seed.
+ * The seed only moves the start value, so it gives no flooding protection.
+ */
+size_t hash_djb2(const char* key, size_t length, uint64_t seed) {
+    size_t hash = 5381 ^ (size_t)seed;
+    for (size_t i = 0; i < length; i++) {
+        hash = ((hash << 5) + hash) + (unsigned char)key[i]; // hash * 33 + c
+    }
+    return hash;
+}
+
+/**
+ * wyhash (final version 4, without the 32 bit and big endian paths).
+ */
+size_t hash_wyhash(const char* key, size_t length, uint64_t seed) {
+    const uint8_t* p = (const uint8_t*)key;
+    uint64_t a;
+    uint64_t b;
+    seed ^= __mul_fold64(seed ^ __wy_secret[0], __wy_secret[1]);
+
+    if (length <= 16) {
+        if (length >= 4) {
+            size_t shift = (length >> 3) << 2; // 0 for 4..7 bytes, 4 for 8..16
+            a = (__read32(p) << 32) | __read32(p + shift);
+            b = (__read32(p + length - 4) << 32) | __read32(p + length - 4 - shift);
+        } else if (length > 0) {
+            a = ((uint64_t)p[0] << 16) | ((uint64_t)p[length >> 1] << 8) | p[length - 1];
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        size_t i = length;
+        if (i > 48) {
+            uint64_t see1 = seed;
+            uint64_t see2 = seed;
+            do {
+                seed = __mul_fold64(__read64(p) ^ __wy_secret[1], __read64(p + 8) ^ seed);
+                see1 = __mul_fold64(__read64(p + 16) ^ __wy_secret[2], __read64(p + 24) ^ see1);
+                see2 = __mul_fold64(__read64(p + 32) ^ __wy_secret[3], __read64(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = __mul_fold64(__read64(p) ^ __wy_secret[1], __read64(p + 8) ^ seed);
+            p += 16;
+            i -= 16;
+        }
+        a = __read64(p + i - 16);
+        b = __read64(p + i - 8);
+    }
+
+    __uint128_t product = (__uint128_t)(a ^ __wy_secret[1]) * (b ^ seed);
+    a = (uint64_t)product;
+    b = (uint64_t)(product >> 64);
+    return __mul_fold64(a ^ __wy_secret[0] ^ length, b ^ __wy_secret[1]);
+}
+
+static inline uint64_t __xxh3_avalanche(uint64_t h) {
+    h ^= h >> 37;
+    h *= XXH_PRIME_MX1;
+    return h ^ (h >> 32);
+}
+
+static inline uint64_t __xxh3_rrmxmx(uint64_t h, size_t length) {
+    h ^= __rotl64(h, 49) ^ __rotl64(h, 24);
+    h *= XXH_PRIME_MX2;
+    h ^= (h >> 35) + length;
+    h *= XXH_PRIME_MX2;
+    return h ^ (h >> 28);
+}
+
+/**
+ * An XXH3 style hash. Keys of up to 16 bytes, which covers item IDs, go
+ * through the same 1-3, 4-8 and 9-16 byte paths as XXH3. Longer keys fold
+ * 16 byte stripes into one accumulator with XXH3's mul-fold step. The
+ * secret is a fixed table of its own, so values differ from the reference
+ * XXH3_64bits.
+ */
+size_t hash_xxh3(const char* key, size_t length, uint64_t seed) {
+    const uint8_t* p = (const uint8_t*)key;
+
+    if (length == 0) {
+        return __xxh3_avalanche(seed ^ __xxh_secret[6] ^ __xxh_secret[7]);
+    }
+    if (length <= 3) {
+        uint32_t combined = ((uint32_t)p[0] << 16) | ((uint32_t)p[length >> 1] << 24) |
+                            (uint32_t)p[length - 1] | ((uint32_t)length << 8);
+        uint64_t bitflip = (uint32_t)(__xxh_secret[0] ^ (__xxh_secret[0] >> 32)) + seed;
+        return __xxh3_avalanche(combined ^ bitflip);
+    }
+    if (length <= 8) {
+        seed ^= (uint64_t)__builtin_bswap32((uint32_t)seed) << 32;
+        uint64_t input = __read32(p + length - 4) + (__read32(p) << 32);
+        uint64_t bitflip = (__xxh_secret[1] ^ __xxh_secret[2]) - seed;
+        return __xxh3_rrmxmx(input ^ bitflip, length);
+    }
+    if (length <= 16) {
+        uint64_t low = __read64(p) ^ ((__xxh_secret[3] ^ __xxh_secret[4]) + seed);
+        uint64_t high = __read64(p + length - 8) ^ ((__xxh_secret[5] ^ __xxh_secret[6]) - seed);
+        uint64_t acc = length + __builtin_bswap64(low) + high + __mul_fold64(low, high);
+        return __xxh3_avalanche(acc);
+    }
+
+    uint64_t acc = length * XXH_PRIME64_1;
+    size_t i = 0;
+    for (; i + 16 < length; i += 16) {
+        const uint64_t* s = &__xxh_secret[2 * ((i >> 4) & 3)];
+        acc += __mul_fold64(__read64(p + i) ^ (s[0] + seed), __read64(p + i + 8) ^ (s[1] - seed));
+    }
+    // the last 16 bytes, which may overlap the final stripe
+    acc += __mul_fold64(__read64(p + length - 16) ^ (__xxh_secret[7] + seed),
+                        __read64(p + length - 8) ^ (__xxh_secret[6] - seed));
+    return __xxh3_avalanche(acc);
+}
+
+static uint64_t __seed_base;
+static atomic_uint_fast64_t __seed_counter;
+static pthread_once_t __seed_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Reads the process's secret seed base from /dev/urandom. Falls back to the
+ * clock and a stack address.
+ */
+static void __init_seed_base(void) {
+    FILE* urandom = fopen("/dev/urandom", "rb");
+    if (urandom != NULL) {
+        size_t read = fread(&__seed_base, sizeof(__seed_base), 1, urandom);
+        fclose(urandom);
+        if (read == 1) {
+            return;
+        }
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    uint64_t seed = (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+    seed ^= (uint64_t)(uintptr_t)&now;
+    __seed_base = __mul_fold64(seed ^ __wy_secret[0], __wy_secret[1]);
+}
+
+/**
+ * Gets a seed that an attacker cannot predict. /dev/urandom is read once per
+ * process; every call then gets a different seed by running a counter
+ * through the splitmix64 finalizer keyed with that secret base, so creating
+ * many tables costs no system calls.
+ */
+uint64_t hash_random_seed(void) {
+    pthread_once(&__seed_once, __init_seed_base);
+    uint64_t z = __seed_base + atomic_fetch_add(&__seed_counter, 1) * 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
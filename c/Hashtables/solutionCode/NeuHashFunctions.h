@@ -0,0 +1,19 @@
+#ifndef NEU_HASH_FUNCTIONS_H
+#define NEU_HASH_FUNCTIONS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * A string hash function. Every hashtable calls its hash function with the
+ * key, the key's length and the table's seed, so two tables with different
+ * seeds place the same keys differently.
+ */
+typedef size_t (*NeuHashFunction)(const char* key, size_t length, uint64_t seed);
+
+size_t hash_djb2(const char* key, size_t length, uint64_t seed);
+size_t hash_wyhash(const char* key, size_t length, uint64_t seed);
+size_t hash_xxh3(const char* key, size_t length, uint64_t seed);
+uint64_t hash_random_seed(void);
+
+#endif /* NEU_HASH_FUNCTIONS_H */
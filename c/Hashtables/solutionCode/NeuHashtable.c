@@ -12,17 +12,17 @@
 #include <string.h>
 
 #include "NeuHashtable.h"
+#include "NeuHashtableInternal.h"
 
 
-NeuNode**  __node_create_table(int capacity) {
-    NeuNode** table = (NeuNode**)malloc(capacity * sizeof(NeuNode*));
+NeuNode**  __node_create_table(size_t capacity) {
+    // calloc hands back zeroed pages lazily, so a large incremental resize
+    // does not pay for clearing the whole new table up front
+    NeuNode** table = (NeuNode**)calloc(capacity, sizeof(NeuNode*));
     if (table == NULL) {
         fprintf(stderr, "Memory allocation failed\n");
         exit(EXIT_FAILURE);
     }
-    for (int i = 0; i < capacity; i++) {
-        table[i] = NULL;
-    }
     return table;
 }
 
@@ -34,6 +34,28 @@ NeuNode**  __node_create_table(int capacity) {
  * @return A pointer to the newly created hashtable.
  */
 NeuHashtable* create_hashtable(int capacity) {
+    return create_hashtable_mode(capacity, HASHTABLE_MODE_CHAINING);
+}
+
+/**
+ * Creates a new hashtable backed by the given engine.
+ * HASHTABLE_MODE_SIMD rounds the capacity up to at least one group of slots.
+ * HASHTABLE_MODE_ROBIN_HOOD runs up to ROBIN_MAX_LOAD_FACTOR full before growing.
+ * HASHTABLE_MODE_CUCKOO rounds the capacity up to at least two buckets and
+ * runs up to CUCKOO_MAX_LOAD_FACTOR full.
+ * HASHTABLE_MODE_INCREMENTAL spreads each resize over the following operations
+ * instead of rehashing every node at once.
+ * HASHTABLE_MODE_MAPPED tables only come from open_hashtable_mmap; asking
+ * for one here gives a chaining table.
+ * HASHTABLE_MODE_CACHE holds at most capacity items (not rounded) and never
+ * grows; adding to a full cache evicts the least recently used item, as
+ * approximated by CLOCK.
+ *
+ * @param capacity The initial capacity of the hashtable, or the item limit of a cache.
+ * @param mode The engine used to store the items.
+ * @return A pointer to the newly created hashtable.
+ */
+NeuHashtable* create_hashtable_mode(int capacity, HashtableMode mode) {
     // first find the nearest power of two greater than or equal to capacity
     int new_capacity = 1;
     while (new_capacity < capacity) {
@@ -41,73 +63,180 @@ NeuHashtable* create_hashtable(int capacity) {
     }
 
     // allocate memory for the hashtable
-    NeuHashtable* hashtable = (NeuHashtable*)malloc(sizeof(NeuHashtable));
+    NeuHashtable* hashtable = (NeuHashtable*)calloc(1, sizeof(NeuHashtable));
     if (hashtable == NULL) {
         fprintf(stderr, "Memory allocation failed\n");
         exit(EXIT_FAILURE);
     }
-    hashtable->capacity = new_capacity;
+    hashtable->mode = mode == HASHTABLE_MODE_MAPPED ? HASHTABLE_MODE_CHAINING : mode;
     hashtable->size = 0;
-    hashtable->table = __node_create_table(new_capacity);
+    hashtable->hash_function = hash_wyhash;
+    hashtable->seed = hash_random_seed();
+    arena_init(&hashtable->strings);
+    if (mode == HASHTABLE_MODE_SIMD) {
+        __simd_create_table(hashtable, new_capacity);
+    } else if (mode == HASHTABLE_MODE_ROBIN_HOOD) {
+        __robin_create_table(hashtable, new_capacity);
+    } else if (mode == HASHTABLE_MODE_CUCKOO) {
+        __cuckoo_create_table(hashtable, new_capacity);
+    } else if (mode == HASHTABLE_MODE_CACHE) {
+        __cache_create_table(hashtable, capacity > 0 ? (size_t)capacity : 1);
+    } else {
+        hashtable->capacity = new_capacity;
+        hashtable->table = __node_create_table(new_capacity);
+    }
     return hashtable;
 }
 
+/**
+ * Frees every node slab. Nodes are never freed one at a time, so tearing
+ * down a table costs one free per slab instead of one per item.
+ */
+void __free_slabs(NeuHashtable* hashtable) {
+    NeuNodeSlab* slab = hashtable->slabs;
+    while (slab != NULL) {
+        NeuNodeSlab* next = slab->next;
+        free(slab);
+        slab = next;
+    }
+    hashtable->slabs = NULL;
+    hashtable->free_nodes = NULL;
+}
+
 /**
  * Frees the memory allocated for the hashtable.
  * @param hashtable A pointer to the hashtable to free.
  */
 void free_hashtable(NeuHashtable* hashtable) {
-    if (hashtable != NULL) {
-        for (int i = 0; i < hashtable->capacity; i++) {
-            NeuNode* current = hashtable->table[i];
-            while (current != NULL) {
-                NeuNode* temp = current;
-                current = current->next;
-                free(temp);
-            }
-        }
+    if (hashtable != NULL && hashtable->wal != NULL) {
+        __wal_close(hashtable); // commits the changes still buffered
+    }
+    if (hashtable != NULL && hashtable->bloom != NULL) {
+        bloom_free(hashtable->bloom);
+        free(hashtable->bloom);
+    }
+    if (hashtable != NULL && hashtable->mode == HASHTABLE_MODE_SIMD) {
+        __simd_free_table(hashtable);
+        arena_free(&hashtable->strings);
+        free(hashtable);
+    }
+    else if (hashtable != NULL && hashtable->mode == HASHTABLE_MODE_ROBIN_HOOD) {
+        __robin_free_table(hashtable);
+        arena_free(&hashtable->strings);
+        free(hashtable);
+    }
+    else if (hashtable != NULL && hashtable->mode == HASHTABLE_MODE_CUCKOO) {
+        __cuckoo_free_table(hashtable);
+        arena_free(&hashtable->strings);
+        free(hashtable);
+    }
+    else if (hashtable != NULL && hashtable->mode == HASHTABLE_MODE_CACHE) {
+        __cache_free_table(hashtable);
+        arena_free(&hashtable->strings);
+        free(hashtable);
+    }
+    else if (hashtable != NULL && hashtable->mode == HASHTABLE_MODE_MAPPED) {
+        __mapped_unmap(hashtable);
+        arena_free(&hashtable->strings);
+        free(hashtable);
+    }
+    else if (hashtable != NULL) {
+        __free_slabs(hashtable);
         free(hashtable->table);
+        free(hashtable->rehash_table);
+        arena_free(&hashtable->strings);
         free(hashtable);
     }
 }
 
-size_t __djb2_hash_function(const char* key) {
-    size_t hash = 5381;
-    int c;
+size_t __get_index(size_t hash, size_t capacity) {
+    return hash & (capacity-1); // faster than %
+}
 
-    while ((c = *key++)) {
-        hash = ((hash << 5) + hash) + c; // hash * 33 + c
+/**
+ * Copies an item name into the string arena, or finds its interned copy.
+ */
+const char* __store_name(NeuHashtable* hashtable, const char* itemName) {
+    size_t name_length = strlen(itemName);
+    if (hashtable->intern_names) {
+        return arena_intern(&hashtable->strings, itemName, name_length);
     }
-
-    return hash;
+    return arena_store(&hashtable->strings, itemName, name_length);
 }
 
-size_t __get_index(const char* itemID, size_t capacity) {
-    return __djb2_hash_function(itemID) & (capacity-1); // faster than %
+/**
+ * Fills in an item, copying its ID and name into the string arena.
+ * Names are interned when the table has name interning turned on.
+ * A cache table keeps the strings of each item in their own record instead,
+ * so they can be freed when the item is evicted.
+ */
+void __store_item(NeuHashtable* hashtable, Item* item, const char* itemID, size_t id_length, const char* itemName, double itemPrice, int itemQuantity) {
+    if (hashtable->mode == HASHTABLE_MODE_CACHE) {
+        __cache_store_strings(item, itemID, id_length, itemName);
+    } else {
+        item->itemID = arena_store(&hashtable->strings, itemID, id_length);
+        item->itemName = __store_name(hashtable, itemName);
+    }
+    item->itemPrice = itemPrice;
+    item->itemQuantity = itemQuantity;
 }
 
-NeuNode * __create_node(const char* itemID, const char* itemName, double itemPrice, int itemQuantity) {
-    NeuNode* newNode = (NeuNode*)malloc(sizeof(NeuNode));
-    if (newNode == NULL) {
-        fprintf(stderr, "Memory allocation failed\n");
-        exit(EXIT_FAILURE);
+/**
+ * Takes a node from the free list, or from the current slab, allocating a
+ * new slab (twice the size of the last one, up to NODE_SLAB_MAX) when full.
+ */
+NeuNode* __alloc_node(NeuHashtable* hashtable) {
+    if (hashtable->free_nodes != NULL) {
+        NeuNode* node = hashtable->free_nodes;
+        hashtable->free_nodes = node->next;
+        return node;
+    }
+    NeuNodeSlab* slab = hashtable->slabs;
+    if (slab == NULL || slab->used == slab->capacity) {
+        size_t capacity = slab == NULL ? NODE_SLAB_INITIAL : slab->capacity * 2;
+        if (capacity > NODE_SLAB_MAX) {
+            capacity = NODE_SLAB_MAX;
+        }
+        slab = (NeuNodeSlab*)malloc(sizeof(NeuNodeSlab) + capacity * sizeof(NeuNode));
+        if (slab == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        slab->used = 0;
+        slab->capacity = capacity;
+        slab->next = hashtable->slabs;
+        hashtable->slabs = slab;
     }
-    strcpy(newNode->data.itemID, itemID);
-    strcpy(newNode->data.itemName, itemName); // does this work?
-    newNode->data.itemPrice = itemPrice;
-    newNode->data.itemQuantity = itemQuantity;
+    return &slab->nodes[slab->used++];
+}
+
+/**
+ * Returns a node to the free list so the next insert can reuse it.
+ */
+void __release_node(NeuHashtable* hashtable, NeuNode* node) {
+    node->next = hashtable->free_nodes;
+    hashtable->free_nodes = node;
+}
+
+NeuNode * __create_node(NeuHashtable* hashtable, size_t hash, const char* itemID, size_t id_length, const char* itemName, double itemPrice, int itemQuantity) {
+    NeuNode* newNode = __alloc_node(hashtable);
+    __store_item(hashtable, &newNode->data, itemID, id_length, itemName, itemPrice, itemQuantity);
+    newNode->hash = hash;
     newNode->next = NULL;
     return newNode;
 }
 
-void __double_capacity(NeuHashtable * hashtable) {
-    int new_capacity = hashtable->capacity * SCALE_FACTOR;
+/**
+ * Moves every node into a new bucket array of new_capacity buckets at once.
+ */
+void __resize_chain_table(NeuHashtable * hashtable, size_t new_capacity) {
+    uint64_t start_ns = __clock_ns();
     NeuNode** new_table = __node_create_table(new_capacity);
 
     for (int i = 0; i < hashtable->capacity; i++) {
         NeuNode* current = hashtable->table[i];
         while (current != NULL) {
-            size_t hash_index = __get_index(current->data.itemID, new_capacity);
+            size_t hash_index = __get_index(current->hash, new_capacity);
             NeuNode* next_node = current->next;
 
             current->next = new_table[hash_index];
@@ -120,6 +249,204 @@ void __double_capacity(NeuHashtable * hashtable) {
     free(hashtable->table);
     hashtable->table = new_table;
     hashtable->capacity = new_capacity;    
+    __record_resize(hashtable, start_ns);
+}
+
+void __double_capacity(NeuHashtable * hashtable) {
+    __resize_chain_table(hashtable, hashtable->capacity * SCALE_FACTOR);
+}
+
+/**
+ * Starts an incremental resize, to a larger or a smaller table. The new
+ * table is allocated, but nodes are only moved by later calls to __rehash_step.
+ */
+void __start_rehash(NeuHashtable* hashtable, size_t new_capacity) {
+    uint64_t start_ns = __clock_ns();
+    hashtable->rehash_capacity = new_capacity;
+    hashtable->rehash_table = __node_create_table(hashtable->rehash_capacity);
+    hashtable->rehash_index = 0;
+    __record_resize(hashtable, start_ns);
+}
+
+/**
+ * Moves up to REHASH_STEP_BUCKETS buckets of the old table into rehash_table.
+ * Empty buckets are skipped, but at most ten per moved bucket are visited
+ * so a sparse table cannot turn one call into a long scan.
+ * Once every bucket has been moved the old table is freed.
+ */
+void __rehash_step(NeuHashtable* hashtable) {
+    uint64_t start_ns = __clock_ns();
+    int moves = REHASH_STEP_BUCKETS;
+    int empty_visits = REHASH_STEP_BUCKETS * 10;
+
+    while (moves > 0 && empty_visits > 0 && hashtable->rehash_index < hashtable->capacity) {
+        NeuNode* current = hashtable->table[hashtable->rehash_index];
+        if (current == NULL) {
+            empty_visits--;
+        } else {
+            hashtable->table[hashtable->rehash_index] = NULL;
+            moves--;
+        }
+        while (current != NULL) {
+            size_t hash_index = __get_index(current->hash, hashtable->rehash_capacity);
+            NeuNode* next_node = current->next;
+
+            current->next = hashtable->rehash_table[hash_index];
+            hashtable->rehash_table[hash_index] = current;
+
+            current = next_node;
+        }
+        hashtable->rehash_index++;
+    }
+
+    if (hashtable->rehash_index == hashtable->capacity) {
+        free(hashtable->table);
+        hashtable->table = hashtable->rehash_table;
+        hashtable->capacity = hashtable->rehash_capacity;
+        hashtable->rehash_table = NULL;
+        hashtable->rehash_capacity = 0;
+        hashtable->rehash_index = 0;
+    }
+    hashtable->resize_ns += __clock_ns() - start_ns; // counted once, in __start_rehash
+}
+
+/**
+ * Runs an incremental resize to completion, if one is in progress.
+ */
+void __finish_rehash(NeuHashtable* hashtable) {
+    while (hashtable->rehash_table != NULL) {
+        __rehash_step(hashtable);
+    }
+}
+
+/**
+ * Grows the table once so that it can hold items entries without passing
+ * its maximum load. Never shrinks the table, and never changes a cache.
+ */
+void __reserve_capacity(NeuHashtable* hashtable, size_t items) {
+    if (hashtable->mode == HASHTABLE_MODE_CACHE) {
+        return;
+    }
+    if (hashtable->mode == HASHTABLE_MODE_MAPPED) {
+        __mapped_promote(hashtable);
+    }
+    if (hashtable->mode == HASHTABLE_MODE_SIMD) {
+        __simd_reserve(hashtable, items);
+        return;
+    }
+    if (hashtable->mode == HASHTABLE_MODE_ROBIN_HOOD) {
+        __robin_reserve(hashtable, items);
+        return;
+    }
+    if (hashtable->mode == HASHTABLE_MODE_CUCKOO) {
+        __cuckoo_reserve(hashtable, items);
+        return;
+    }
+    __finish_rehash(hashtable);
+    size_t new_capacity = hashtable->capacity;
+    while ((double)items / new_capacity > LOAD_FACTOR) {
+        new_capacity *= SCALE_FACTOR;
+    }
+    if (new_capacity != hashtable->capacity) {
+        __resize_chain_table(hashtable, new_capacity);
+    }
+}
+
+/**
+ * Walks a chain looking for a key.
+ * @return The matching node, or NULL if the chain does not hold the key.
+ */
+NeuNode* __chain_find(NeuNode* current, const char* itemID, size_t length, size_t hash) {
+    while (current != NULL) {
+        // comparing the cached hash first skips the key compare on almost every other key
+        if (current->hash == hash && __key_equals(current->data.itemID, itemID, length)) {
+            return current;
+        }
+        current = current->next;
+    }
+    return NULL;
+}
+
+/**
+ * Returns the bucket that holds (or would hold) a key with the given hash.
+ * During an incremental resize, buckets of the old table below rehash_index
+ * have already been moved, so those keys live in rehash_table.
+ */
+NeuNode** __chain_bucket(NeuHashtable* hashtable, size_t hash) {
+    size_t hash_index = hash & (hashtable->capacity - 1);
+    if (hashtable->rehash_table != NULL && hash_index < hashtable->rehash_index) {
+        return &hashtable->rehash_table[hash & (hashtable->rehash_capacity - 1)];
+    }
+    return &hashtable->table[hash_index];
+}
+
+/**
+ * Finds an item in the chaining engines, adding it if it is not there.
+ */
+Item* __chain_find_or_add(NeuHashtable* hashtable, size_t hash, const char* itemID, size_t length, const char* itemName, double itemPrice, int itemQuantity, bool* inserted) {
+    // Check if the hashtable needs to be resized
+    if (hashtable->mode == HASHTABLE_MODE_INCREMENTAL) {
+        if (hashtable->rehash_table != NULL) {
+            __rehash_step(hashtable);
+        }
+        if (hashtable->rehash_table == NULL && get_load_factor(hashtable) > LOAD_FACTOR) {
+            __start_rehash(hashtable, hashtable->capacity * SCALE_FACTOR);
+        }
+    }
+    else if (get_load_factor(hashtable) > LOAD_FACTOR) {
+        __double_capacity(hashtable);
+    }
+    NeuNode** bucket = __chain_bucket(hashtable, hash);
+    NeuNode* existing = __chain_find(*bucket, itemID, length, hash);
+    if (existing != NULL) {
+        *inserted = false;
+        return &existing->data;
+    }
+    NeuNode* newNode = __create_node(hashtable, hash, itemID, length, itemName, itemPrice, itemQuantity);
+
+    newNode->next = *bucket;
+    *bucket = newNode;
+    hashtable->size++;
+    *inserted = true;
+    return &newNode->data;
+}
+
+/**
+ * Finds an item, adding it with the given fields if it is not in the table.
+ * The key is hashed once and its chain is walked once.
+ * @param inserted Set to true if the item was added, false if it already existed.
+ * @return The item that is now in the table under itemID.
+ */
+Item* __find_or_add_item(NeuHashtable* hashtable, const char* itemID, const char* itemName, double itemPrice, int itemQuantity, bool* inserted) {
+    size_t length = strlen(itemID);
+    size_t hash = __hash_key(hashtable, itemID, length);
+    return __find_or_add_hashed(hashtable, hash, itemID, length, itemName, itemPrice, itemQuantity, inserted);
+}
+
+/**
+ * Same as __find_or_add_item, for a key that has already been hashed with
+ * the table's hash function.
+ */
+Item* __find_or_add_hashed(NeuHashtable* hashtable, size_t hash, const char* itemID, size_t length, const char* itemName, double itemPrice, int itemQuantity, bool* inserted) {
+    if (hashtable->mode == HASHTABLE_MODE_MAPPED) {
+        __mapped_promote(hashtable); // the first write copies the image into a normal table
+    }
+    Item* item;
+    if (hashtable->mode == HASHTABLE_MODE_SIMD) {
+        item = __simd_find_or_add(hashtable, hash, itemID, length, itemName, itemPrice, itemQuantity, inserted);
+    } else if (hashtable->mode == HASHTABLE_MODE_ROBIN_HOOD) {
+        item = __robin_find_or_add(hashtable, hash, itemID, length, itemName, itemPrice, itemQuantity, inserted);
+    } else if (hashtable->mode == HASHTABLE_MODE_CUCKOO) {
+        item = __cuckoo_find_or_add(hashtable, hash, itemID, length, itemName, itemPrice, itemQuantity, inserted);
+    } else if (hashtable->mode == HASHTABLE_MODE_CACHE) {
+        item = __cache_find_or_add(hashtable, hash, itemID, length, itemName, itemPrice, itemQuantity, inserted);
+    } else {
+        item = __chain_find_or_add(hashtable, hash, itemID, length, itemName, itemPrice, itemQuantity, inserted);
+    }
+    if (*inserted && hashtable->bloom != NULL) {
+        __bloom_track_insert(hashtable, hash);
+    }
+    return item;
 }
 
 /**
@@ -131,27 +458,90 @@ void __double_capacity(NeuHashtable * hashtable) {
  * @param itemQuantity The quantity of the item.
  */
 void add_item(NeuHashtable* hashtable, const char* itemID, const char* itemName, double itemPrice, int itemQuantity) {
-    if (get_item(hashtable, itemID) != NULL) {
+    bool inserted;
+    __find_or_add_item(hashtable, itemID, itemName, itemPrice, itemQuantity, &inserted);
+    if (!inserted) {
         fprintf(stderr, "Item with ID %s already exists\n", itemID);
-        return;
+    } else if (hashtable->wal != NULL) {
+        __wal_log_put(hashtable, itemID, strlen(itemID), itemName, itemPrice, itemQuantity);
     }
-    
-    // Check if the hashtable needs to be resized
-    if (get_load_factor(hashtable) > LOAD_FACTOR) {
-        __double_capacity(hashtable);
+}
+
+/**
+ * Adds an item, or overwrites the name, price and quantity of the item
+ * that already has this ID.
+ * @param hashtable A pointer to the hashtable.
+ * @param itemID The ID of the item.
+ * @param itemName The name of the item.
+ * @param itemPrice The price of the item.
+ * @param itemQuantity The quantity of the item.
+ * @return ITEM_INSERTED or ITEM_UPDATED.
+ */
+UpsertResult upsert_item(NeuHashtable* hashtable, const char* itemID, const char* itemName, double itemPrice, int itemQuantity) {
+    bool inserted;
+    Item* item = __find_or_add_item(hashtable, itemID, itemName, itemPrice, itemQuantity, &inserted);
+    if (hashtable->wal != NULL) {
+        __wal_log_put(hashtable, itemID, strlen(itemID), itemName, itemPrice, itemQuantity);
     }
-    size_t hash_index = __get_index(itemID, hashtable->capacity);
-    NeuNode* newNode = __create_node(itemID, itemName, itemPrice, itemQuantity);
-    if (newNode == NULL) {
-        fprintf(stderr, "Memory allocation failed\n");
-        exit(EXIT_FAILURE);
+    if (inserted) {
+        return ITEM_INSERTED;
     }
-    
+    if (strcmp(item->itemName, itemName) != 0 && hashtable->mode == HASHTABLE_MODE_CACHE) {
+        __cache_rename(item, itemName);
+    } else if (strcmp(item->itemName, itemName) != 0) {
+        item->itemName = __store_name(hashtable, itemName); // the old name stays in the arena
+    }
+    item->itemPrice = itemPrice;
+    item->itemQuantity = itemQuantity;
+    return ITEM_UPDATED;
+}
 
-    newNode->next = hashtable->table[hash_index];
-    hashtable->table[hash_index] = newNode;
-    hashtable->size++;
-   
+/**
+ * Adds delta to the quantity of an item in a single lookup.
+ * @param hashtable A pointer to the hashtable.
+ * @param itemID The ID of the item.
+ * @param delta The change in quantity, negative to take stock out.
+ * @return ITEM_UPDATED, or ITEM_NOT_FOUND if no item has this ID.
+ */
+UpsertResult adjust_quantity(NeuHashtable* hashtable, const char* itemID, int delta) {
+    if (hashtable->mode == HASHTABLE_MODE_MAPPED && get_item(hashtable, itemID) != NULL) {
+        __mapped_promote(hashtable);
+    }
+    Item* item = get_item(hashtable, itemID);
+    if (item == NULL) {
+        return ITEM_NOT_FOUND;
+    }
+    item->itemQuantity += delta;
+    if (hashtable->wal != NULL) {
+        __wal_log_quantity(hashtable, itemID, strlen(itemID), item->itemQuantity);
+    }
+    return ITEM_UPDATED;
+}
+
+/**
+ * Looks up a key that has already been hashed, in whichever engine the table uses.
+ */
+Item* __get_item_hashed(NeuHashtable* hashtable, const char* itemID, size_t length, size_t hash) {
+    if (hashtable->mode == HASHTABLE_MODE_SIMD) {
+        return __simd_get_item(hashtable, itemID, length, hash);
+    }
+    if (hashtable->mode == HASHTABLE_MODE_ROBIN_HOOD) {
+        return __robin_get_item(hashtable, itemID, length, hash);
+    }
+    if (hashtable->mode == HASHTABLE_MODE_CUCKOO) {
+        return __cuckoo_get_item(hashtable, itemID, length, hash);
+    }
+    if (hashtable->mode == HASHTABLE_MODE_MAPPED) {
+        return __mapped_get_item(hashtable, itemID, length, hash, __mapped_scratch(hashtable, 1));
+    }
+    if (hashtable->mode == HASHTABLE_MODE_CACHE) {
+        return __cache_get_item(hashtable, itemID, length, hash);
+    }
+    if (hashtable->rehash_table != NULL) {
+        __rehash_step(hashtable);
+    }
+    NeuNode* node = __chain_find(*__chain_bucket(hashtable, hash), itemID, length, hash);
+    return node != NULL ? &node->data : NULL;
 }
 
 /**
@@ -159,17 +549,23 @@ void add_item(NeuHashtable* hashtable, const char* itemID, const char* itemName,
  * @param hashtable A pointer to the hashtable.
  * @param itemID The ID of the item to retrieve.
  * @return A pointer to the item if found, or NULL if not found.
+ *         In HASHTABLE_MODE_SIMD and HASHTABLE_MODE_ROBIN_HOOD the pointer is only
+ *         valid until the next add or remove. In HASHTABLE_MODE_MAPPED it is a
+ *         read-only view, valid until the next lookup. In HASHTABLE_MODE_CACHE
+ *         it is valid until the item is evicted or removed.
  */
 Item* get_item(NeuHashtable* hashtable, const char* itemID) {
-    size_t hash_index = __get_index(itemID, hashtable->capacity);
-    NeuNode* current = hashtable->table[hash_index];
-    while (current != NULL) {
-        if (strcmp(current->data.itemID, itemID) == 0) {
-            return &current->data;
-        }
-        current = current->next;
+    size_t length = strlen(itemID);
+    size_t hash = __hash_key(hashtable, itemID, length);
+    if (hashtable->bloom != NULL && !bloom_may_contain(hashtable->bloom, hash)) {
+        hashtable->cache_misses += hashtable->mode == HASHTABLE_MODE_CACHE;
+        return NULL; // definitely absent, the table is not touched
     }
-    return NULL;
+    Item* item = __get_item_hashed(hashtable, itemID, length, hash);
+    if (item == NULL && hashtable->bloom != NULL) {
+        hashtable->bloom->false_positives++;
+    }
+    return item;
 }
 
 /**
@@ -178,27 +574,237 @@ Item* get_item(NeuHashtable* hashtable, const char* itemID) {
  * @return The load factor of the hashtable.
  */
 inline double get_load_factor(NeuHashtable* hashtable) {
+    if (hashtable->rehash_table != NULL) {
+        return (double)hashtable->size / hashtable->rehash_capacity;
+    }
     return (double)hashtable->size / hashtable->capacity;
 }
 
 /**
- * Removes an item from the hashtable by its ID.
+ * Finds the longest and the total probe length over all items. For the
+ * chaining engines an item's probe length is its position in its chain.
+ */
+void __probe_lengths(NeuHashtable* hashtable, size_t* max, size_t* total) {
+    if (hashtable->mode == HASHTABLE_MODE_SIMD) {
+        __simd_probe_lengths(hashtable, max, total);
+        return;
+    }
+    if (hashtable->mode == HASHTABLE_MODE_ROBIN_HOOD) {
+        __robin_probe_lengths(hashtable, max, total);
+        return;
+    }
+    if (hashtable->mode == HASHTABLE_MODE_CUCKOO) {
+        __cuckoo_probe_lengths(hashtable, max, total);
+        return;
+    }
+    if (hashtable->mode == HASHTABLE_MODE_MAPPED) {
+        __mapped_probe_lengths(hashtable, max, total);
+        return;
+    }
+    *max = 0;
+    *total = 0;
+    NeuNode** tables[2] = {hashtable->table, hashtable->rehash_table};
+    size_t capacities[2] = {hashtable->capacity, hashtable->rehash_capacity};
+    for (int t = 0; t < 2 && tables[t] != NULL; t++) {
+        for (size_t i = 0; i < capacities[t]; i++) {
+            size_t position = 0;
+            for (NeuNode* current = tables[t][i]; current != NULL; current = current->next) {
+                position++;
+                *total += position;
+            }
+            if (position > *max) {
+                *max = position;
+            }
+        }
+    }
+}
+
+/**
+ * Gets the number of slots (or chain nodes) the most expensive successful
+ * lookup looks at. Scans the whole table.
+ * For HASHTABLE_MODE_SIMD it counts groups of 16 slots instead.
  * @param hashtable A pointer to the hashtable.
- * @param itemID The ID of the item to remove.
+ * @return The longest probe length, 0 for an empty table.
  */
-void remove_item(NeuHashtable* hashtable, const char* itemID) {
-    size_t hash_index = __get_index(itemID, hashtable->capacity);
-    NeuNode* current = hashtable->table[hash_index];
+size_t get_max_probe_length(NeuHashtable* hashtable) {
+    size_t max;
+    size_t total;
+    __probe_lengths(hashtable, &max, &total);
+    return max;
+}
+
+/**
+ * Gets the average number of slots (or chain nodes, or SIMD groups) a
+ * successful lookup looks at. Scans the whole table.
+ * @param hashtable A pointer to the hashtable.
+ * @return The mean probe length, 0 for an empty table.
+ */
+double get_mean_probe_length(NeuHashtable* hashtable) {
+    size_t max;
+    size_t total;
+    __probe_lengths(hashtable, &max, &total);
+    return hashtable->size == 0 ? 0.0 : (double)total / hashtable->size;
+}
+
+/**
+ * Turns interning of item names on or off for items added from now on.
+ * With interning, items that share a name point at one copy of it.
+ * @param hashtable A pointer to the hashtable.
+ * @param enabled true to intern names.
+ */
+void set_name_interning(NeuHashtable* hashtable, bool enabled) {
+    hashtable->intern_names = enabled;
+}
+
+/**
+ * Replaces the hash function of an empty hashtable.
+ * @param hashtable A pointer to the hashtable.
+ * @param hash_function The new hash function, e.g. hash_wyhash, hash_xxh3 or hash_djb2.
+ * @param seed The seed passed to every call, e.g. from hash_random_seed().
+ * @return true if the hash function was changed, false if the table already has items.
+ */
+bool set_hash_function(NeuHashtable* hashtable, NeuHashFunction hash_function, uint64_t seed) {
+    if (hashtable->size > 0) {
+        return false; // cached hashes and positions depend on the old function
+    }
+    hashtable->hash_function = hash_function;
+    hashtable->seed = seed;
+    return true;
+}
+
+/**
+ * Gets the capacity the table will have until it next grows.
+ */
+static size_t __bloom_capacity(NeuHashtable* hashtable) {
+    return hashtable->rehash_table != NULL ? hashtable->rehash_capacity : hashtable->capacity;
+}
+
+/**
+ * Gets the number of items a table of the given capacity holds before it grows.
+ */
+static size_t __max_items(NeuHashtable* hashtable, size_t capacity) {
+    switch (hashtable->mode) {
+        case HASHTABLE_MODE_SIMD: return (size_t)(capacity * SIMD_MAX_LOAD_FACTOR);
+        case HASHTABLE_MODE_ROBIN_HOOD: return (size_t)(capacity * ROBIN_MAX_LOAD_FACTOR);
+        case HASHTABLE_MODE_CUCKOO: return (size_t)(capacity * CUCKOO_MAX_LOAD_FACTOR);
+        case HASHTABLE_MODE_MAPPED: return capacity;
+        case HASHTABLE_MODE_CACHE: return hashtable->max_items;
+        default: return (size_t)(capacity * LOAD_FACTOR) + 1;
+    }
+}
+
+static void __bloom_add_visit(const Item* item, size_t hash, void* context) {
+    bloom_add((NeuBloomFilter*)context, hash);
+}
+
+/**
+ * Rebuilds the Bloom filter from the items in the table, sized for the
+ * table's current capacity. Keys of removed items are dropped. The
+ * counters carry over.
+ */
+void __rebuild_bloom(NeuHashtable* hashtable) {
+    NeuBloomFilter old = *hashtable->bloom;
+    size_t capacity = __bloom_capacity(hashtable);
+    size_t expected = __max_items(hashtable, capacity);
+    bloom_free(hashtable->bloom);
+    bloom_init(hashtable->bloom, expected > hashtable->size ? expected : hashtable->size, old.false_positive_rate);
+    hashtable->bloom->rejected = old.rejected;
+    hashtable->bloom->passed = old.passed;
+    hashtable->bloom->false_positives = old.false_positives;
+    __for_each_item(hashtable, __bloom_add_visit, hashtable->bloom);
+    hashtable->bloom_capacity = capacity;
+}
+
+/**
+ * Adds a newly inserted key to the Bloom filter, or rebuilds the filter if
+ * the table has been resized since the filter was built.
+ */
+void __bloom_track_insert(NeuHashtable* hashtable, size_t hash) {
+    if (hashtable->bloom_capacity != __bloom_capacity(hashtable)) {
+        __rebuild_bloom(hashtable);
+    } else {
+        bloom_add(hashtable->bloom, hash);
+    }
+}
+
+/**
+ * Puts a blocked Bloom filter in front of the table. Lookups and removes of
+ * keys the filter has never seen return without touching the table.
+ * The filter is rebuilt, dropping removed keys, whenever the table grows.
+ * Counters are in hashtable->bloom: rejected, passed and false_positives.
+ * @param hashtable A pointer to the hashtable.
+ * @param false_positive_rate The share of absent keys allowed through, e.g. 0.01.
+ */
+void enable_bloom_filter(NeuHashtable* hashtable, double false_positive_rate) {
+    if (hashtable->bloom == NULL) {
+        hashtable->bloom = (NeuBloomFilter*)calloc(1, sizeof(NeuBloomFilter));
+        if (hashtable->bloom == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    hashtable->bloom->false_positive_rate = false_positive_rate;
+    __rebuild_bloom(hashtable);
+}
+
+/**
+ * Removes the Bloom filter from the table.
+ * @param hashtable A pointer to the hashtable.
+ */
+void disable_bloom_filter(NeuHashtable* hashtable) {
+    if (hashtable->bloom != NULL) {
+        bloom_free(hashtable->bloom);
+        free(hashtable->bloom);
+        hashtable->bloom = NULL;
+    }
+}
+
+/**
+ * Removes an item from whichever engine the table uses.
+ */
+static void __remove_item(NeuHashtable* hashtable, const char* itemID) {
+    size_t length = strlen(itemID);
+    size_t hash = __hash_key(hashtable, itemID, length);
+    if (hashtable->bloom != NULL && !bloom_may_contain(hashtable->bloom, hash)) {
+        return;
+    }
+    if (hashtable->mode == HASHTABLE_MODE_MAPPED) {
+        if (__mapped_get_item(hashtable, itemID, length, hash, __mapped_scratch(hashtable, 1)) == NULL) {
+            return; // nothing to remove, so the image can stay mapped
+        }
+        __mapped_promote(hashtable);
+    }
+    if (hashtable->mode == HASHTABLE_MODE_SIMD) {
+        __simd_remove_item(hashtable, itemID, length, hash);
+        return;
+    }
+    if (hashtable->mode == HASHTABLE_MODE_ROBIN_HOOD) {
+        __robin_remove_item(hashtable, itemID, length, hash);
+        return;
+    }
+    if (hashtable->mode == HASHTABLE_MODE_CUCKOO) {
+        __cuckoo_remove_item(hashtable, itemID, length, hash);
+        return;
+    }
+    if (hashtable->mode == HASHTABLE_MODE_CACHE) {
+        __cache_remove_item(hashtable, itemID, length, hash);
+        return;
+    }
+    if (hashtable->rehash_table != NULL) {
+        __rehash_step(hashtable);
+    }
+    NeuNode** bucket = __chain_bucket(hashtable, hash);
+    NeuNode* current = *bucket;
     NeuNode* prev = NULL;
 
     while (current != NULL) {
-        if (strcmp(current->data.itemID, itemID) == 0) {
+        if (current->hash == hash && __key_equals(current->data.itemID, itemID, length)) {
             if (prev == NULL) {
-                hashtable->table[hash_index] = current->next;
+                *bucket = current->next;
             } else {
                 prev->next = current->next;
             }
-            free(current);
+            __release_node(hashtable, current);
             hashtable->size--;
             return;
         }
@@ -207,6 +813,164 @@ void remove_item(NeuHashtable* hashtable, const char* itemID) {
     }
 }
 
+/**
+ * Removes an item from the hashtable by its ID.
+ * The item's strings stay in the arena until the hashtable is freed, and
+ * its key stays in the Bloom filter (if any) until the next resize.
+ * @param hashtable A pointer to the hashtable.
+ * @param itemID The ID of the item to remove.
+ */
+void remove_item(NeuHashtable* hashtable, const char* itemID) {
+    size_t size = hashtable->size;
+    __remove_item(hashtable, itemID);
+    if (hashtable->size < size && (double)hashtable->size < hashtable->capacity * SHRINK_LOAD_FACTOR) {
+        __shrink_table(hashtable);
+    }
+    if (hashtable->wal != NULL && hashtable->size < size) {
+        __wal_log_remove(hashtable, itemID, strlen(itemID));
+    }
+}
+
+/**
+ * Gets the smallest capacity the table's engine may have.
+ */
+static size_t __min_capacity(NeuHashtable* hashtable) {
+    return hashtable->mode == HASHTABLE_MODE_SIMD ? SIMD_GROUP_WIDTH : INITIAL_CAPACITY;
+}
+
+/**
+ * Rebuilds the table into new_capacity buckets or slots. An incremental
+ * table only starts the move, later operations finish it.
+ */
+static void __resize_table(NeuHashtable* hashtable, size_t new_capacity) {
+    if (hashtable->mode == HASHTABLE_MODE_SIMD) {
+        __simd_rehash(hashtable, new_capacity);
+    } else if (hashtable->mode == HASHTABLE_MODE_ROBIN_HOOD) {
+        __robin_rehash(hashtable, new_capacity);
+    } else if (hashtable->mode == HASHTABLE_MODE_CUCKOO) {
+        __cuckoo_resize(hashtable, new_capacity);
+    } else if (hashtable->mode == HASHTABLE_MODE_INCREMENTAL) {
+        __start_rehash(hashtable, new_capacity);
+    } else {
+        __resize_chain_table(hashtable, new_capacity);
+    }
+}
+
+/**
+ * Halves the table until one more halving would put it above twice
+ * SHRINK_LOAD_FACTOR, so it lands between the shrink and the grow
+ * thresholds and a few adds or removes cannot make it resize back and forth.
+ * The table keeps room for the items reserved with hashtable_reserve.
+ */
+void __shrink_table(NeuHashtable* hashtable) {
+    if (hashtable->mode == HASHTABLE_MODE_CACHE || hashtable->mode == HASHTABLE_MODE_MAPPED ||
+        hashtable->rehash_table != NULL) {
+        return;
+    }
+    size_t keep = hashtable->size > hashtable->reserved_items ? hashtable->size : hashtable->reserved_items;
+    size_t new_capacity = hashtable->capacity;
+    while (new_capacity / 2 >= __min_capacity(hashtable) && (double)keep < new_capacity / 2 * SHRINK_LOAD_FACTOR * 2 &&
+           keep <= __max_items(hashtable, new_capacity / 2)) {
+        new_capacity /= 2;
+    }
+    if (new_capacity != hashtable->capacity) {
+        __resize_table(hashtable, new_capacity);
+    }
+}
+
+/**
+ * Grows the table once so that it can hold items entries without growing
+ * again, for example before a bulk load. Removes will not shrink the table
+ * below this size; hashtable_compact or another call with 0 lifts that.
+ * @param hashtable A pointer to the hashtable.
+ * @param items The number of items the table should hold.
+ */
+void hashtable_reserve(NeuHashtable* hashtable, size_t items) {
+    hashtable->reserved_items = items;
+    __reserve_capacity(hashtable, items);
+}
+
+/**
+ * Copies a chaining table's nodes, bucket by bucket, into fresh slabs and a
+ * bucket array of new_capacity, then frees the old slabs and their holes.
+ */
+static void __compact_chains(NeuHashtable* hashtable, size_t new_capacity) {
+    uint64_t start_ns = __clock_ns();
+    NeuNodeSlab* old_slabs = hashtable->slabs;
+    NeuNode** old_table = hashtable->table;
+    size_t old_capacity = hashtable->capacity;
+    NeuNode** new_table = __node_create_table(new_capacity);
+    hashtable->slabs = NULL;
+    hashtable->free_nodes = NULL;
+    for (size_t i = 0; i < old_capacity; i++) {
+        for (NeuNode* current = old_table[i]; current != NULL; current = current->next) {
+            NeuNode* node = __alloc_node(hashtable);
+            *node = *current;
+            size_t hash_index = __get_index(node->hash, new_capacity);
+            node->next = new_table[hash_index];
+            new_table[hash_index] = node;
+        }
+    }
+    NeuNodeSlab* slab = old_slabs;
+    while (slab != NULL) {
+        NeuNodeSlab* next = slab->next;
+        free(slab);
+        slab = next;
+    }
+    free(old_table);
+    hashtable->table = new_table;
+    hashtable->capacity = new_capacity;
+    __record_resize(hashtable, start_ns);
+}
+
+/**
+ * Copies the strings of one item into the new arena passed as context.
+ * __for_each_item hands out the table's own items for every engine but
+ * the mapped one, so they can be updated in place.
+ */
+static void __compact_strings_visit(const Item* item, size_t hash, void* context) {
+    NeuHashtable* hashtable = (NeuHashtable*)context;
+    Item* stored = (Item*)item;
+    stored->itemID = arena_store(&hashtable->strings, item->itemID, arena_length(item->itemID));
+    stored->itemName = hashtable->intern_names ? arena_intern(&hashtable->strings, item->itemName, arena_length(item->itemName))
+                                               : arena_store(&hashtable->strings, item->itemName, arena_length(item->itemName));
+}
+
+/**
+ * Rebuilds the table densely: the smallest capacity that holds its items,
+ * no free nodes or tombstones, and a string arena holding only the strings
+ * of items still in the table. Removed items' strings and nodes, which
+ * removes alone never give back, are freed. Also drops a reservation made
+ * with hashtable_reserve. Pointers to items are invalidated. Cache and
+ * mapped tables are already dense and are left alone.
+ * @param hashtable A pointer to the hashtable.
+ */
+void hashtable_compact(NeuHashtable* hashtable) {
+    if (hashtable->mode == HASHTABLE_MODE_CACHE || hashtable->mode == HASHTABLE_MODE_MAPPED) {
+        return;
+    }
+    __finish_rehash(hashtable);
+    hashtable->reserved_items = 0;
+    size_t new_capacity = __min_capacity(hashtable);
+    while (hashtable->size > __max_items(hashtable, new_capacity)) {
+        new_capacity *= SCALE_FACTOR;
+    }
+    if (hashtable->mode == HASHTABLE_MODE_CHAINING || hashtable->mode == HASHTABLE_MODE_INCREMENTAL) {
+        __compact_chains(hashtable, new_capacity);
+    } else {
+        __resize_table(hashtable, new_capacity);
+    }
+
+    NeuStringArena old_strings = hashtable->strings;
+    arena_init(&hashtable->strings);
+    __for_each_item(hashtable, __compact_strings_visit, hashtable);
+    arena_free(&old_strings);
+
+    if (hashtable->bloom != NULL) {
+        __rebuild_bloom(hashtable); // also forgets the removed keys
+    }
+}
+
 /**
  * Prints an item from the hastable.
  * @param item A pointer to the item to print.
@@ -221,6 +985,66 @@ void __print_item(Item* item) {
     }
 }
 
+void __print_nodes(NeuNode** table, size_t capacity, bool* first) {
+    for (size_t i = 0; i < capacity; i++) {
+        for (NeuNode* current = table[i]; current != NULL; current = current->next) {
+            if (!*first) {
+                printf(", ");
+            }
+            printf("%s:", current->data.itemID);
+            __print_item(&current->data);
+            *first = false;
+        }
+    }
+}
+
+/**
+ * Calls visit for every item in the table, in no particular order.
+ * The table must not be changed until it returns.
+ */
+void __for_each_item(NeuHashtable* hashtable, NeuItemVisitor visit, void* context) {
+    if (hashtable->mode == HASHTABLE_MODE_MAPPED) {
+        __mapped_for_each(hashtable, visit, context);
+        return;
+    }
+    if (hashtable->mode == HASHTABLE_MODE_SIMD || hashtable->mode == HASHTABLE_MODE_ROBIN_HOOD) {
+        for (size_t i = 0; i < hashtable->capacity; i++) {
+            bool used = hashtable->mode == HASHTABLE_MODE_SIMD ? !(hashtable->ctrl[i] & 0x80) : hashtable->distances[i] != 0;
+            if (used) {
+                visit(&hashtable->slots[i].data, hashtable->slots[i].hash, context);
+            }
+        }
+        return;
+    }
+    if (hashtable->mode == HASHTABLE_MODE_CUCKOO) {
+        for (size_t i = 0; i < hashtable->capacity + hashtable->stash_size; i++) {
+            if (i >= hashtable->capacity || hashtable->tags[i] != 0) {
+                visit(&hashtable->slots[i].data, hashtable->slots[i].hash, context);
+            }
+        }
+        return;
+    }
+    NeuNode** tables[2] = {hashtable->table, hashtable->rehash_table};
+    size_t capacities[2] = {hashtable->capacity, hashtable->rehash_capacity};
+    for (int t = 0; t < 2 && tables[t] != NULL; t++) {
+        for (size_t i = 0; i < capacities[t]; i++) {
+            for (NeuNode* current = tables[t][i]; current != NULL; current = current->next) {
+                visit(&current->data, current->hash, context);
+            }
+        }
+    }
+}
+
+static void __print_visit(const Item* item, size_t hash, void* context) {
+    bool* first = (bool*)context;
+    if (!*first) {
+        printf(", ");
+    }
+    printf("%s:", item->itemID);
+    __print_item((Item*)item);
+    *first = false;
+}
+
 /**
  * Prints the contents of the hashtable.
  * Format is key:value seperated by commas.
@@ -228,43 +1052,81 @@ void __print_item(Item* item) {
  * @param hashtable A pointer to the hashtable.
  */
 void print_hashtable(NeuHashtable* hashtable) {
+    if (hashtable->mode == HASHTABLE_MODE_SIMD) {
+        __simd_print_hashtable(hashtable);
+        return;
+    }
+    if (hashtable->mode == HASHTABLE_MODE_ROBIN_HOOD) {
+        __robin_print_hashtable(hashtable);
+        return;
+    }
+    if (hashtable->mode == HASHTABLE_MODE_CUCKOO) {
+        __cuckoo_print_hashtable(hashtable);
+        return;
+    }
+    if (hashtable->mode == HASHTABLE_MODE_MAPPED) {
+        bool first = true;
+        printf("{");
+        __for_each_item(hashtable, __print_visit, &first);
+        printf("}\n");
+        return;
+    }
     printf("{");
-    for (int i = 0; i < hashtable->capacity; i++) {
-        NeuNode* current = hashtable->table[i];
-        while (current != NULL) {
-            printf("%s:", current->data.itemID);
-            __print_item(&current->data);
-            current = current->next;
-            if (current != NULL) {
-                printf(", ");
-            }
-        }
-         if (i < hashtable->capacity - 1 && hashtable->table[i] != NULL) {
-             printf(", ");
-         }
+    bool first = true;
+    __print_nodes(hashtable->table, hashtable->capacity, &first);
+    if (hashtable->rehash_table != NULL) {
+        __print_nodes(hashtable->rehash_table, hashtable->rehash_capacity, &first);
     }
     printf("}\n");
 }
 
-/**
- * Prints the array with a count of number of items in 
- * each index of the hashtable. An example layout would be
- * [1, 0, 0, 0, 0, 0, 0, 1]
- * where the first index has 1 item and the last index has 1 item.
- */
-void print_table_visual(NeuHashtable *hashtable) {
+void __print_bucket_counts(NeuNode** table, size_t capacity) {
     printf("[");
-    for (int i = 0; i < hashtable->capacity; i++) {
-        NeuNode* current = hashtable->table[i];
+    for (size_t i = 0; i < capacity; i++) {
+        NeuNode* current = table[i];
         int count = 0;
         while (current != NULL) {
             count++;
             current = current->next;
         }
         printf("%d", count);
-        if (i < hashtable->capacity - 1) {
+        if (i < capacity - 1) {
             printf(", ");
         }
     }
     printf("]\n");
-}
\ No newline at end of file
+}
+
+/**
+ * Prints the array with a count of number of items in 
+ * each index of the hashtable. An example layout would be
+ * [1, 0, 0, 0, 0, 0, 0, 1]
+ * where the first index has 1 item and the last index has 1 item.
+ * For HASHTABLE_MODE_SIMD each count is one group of 16 slots.
+ * For HASHTABLE_MODE_ROBIN_HOOD each entry is the probe length of one slot's item.
+ * For HASHTABLE_MODE_CUCKOO each count is one bucket of 4 slots.
+ * For HASHTABLE_MODE_MAPPED each entry is one slot of the image.
+ * While an incremental resize is running, the new table is printed on a second line.
+ */
+void print_table_visual(NeuHashtable *hashtable) {
+    if (hashtable->mode == HASHTABLE_MODE_SIMD) {
+        __simd_print_table_visual(hashtable);
+        return;
+    }
+    if (hashtable->mode == HASHTABLE_MODE_ROBIN_HOOD) {
+        __robin_print_table_visual(hashtable);
+        return;
+    }
+    if (hashtable->mode == HASHTABLE_MODE_CUCKOO) {
+        __cuckoo_print_table_visual(hashtable);
+        return;
+    }
+    if (hashtable->mode == HASHTABLE_MODE_MAPPED) {
+        __mapped_print_table_visual(hashtable);
+        return;
+    }
+    __print_bucket_counts(hashtable->table, hashtable->capacity);
+    if (hashtable->rehash_table != NULL) {
+        __print_bucket_counts(hashtable->rehash_table, hashtable->rehash_capacity);
+    }
+}
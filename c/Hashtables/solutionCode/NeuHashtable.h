@@ -2,41 +2,202 @@
 #define NEU_HASHTABLE_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "NeuBloomFilter.h"
+#include "NeuHashFunctions.h"
+#include "NeuStringArena.h"
+
 #define SCALE_FACTOR 2
 #define LOAD_FACTOR 0.7
+#define SHRINK_LOAD_FACTOR 0.2 // a remove that leaves the table emptier than this shrinks it
 #define INITIAL_CAPACITY 8
 
+#define NODE_SLAB_INITIAL 64     // nodes in the first slab, later slabs double
+#define NODE_SLAB_MAX (64 * 1024) // largest slab, in nodes
+#define REHASH_STEP_BUCKETS 4 // buckets moved per operation during an incremental resize
+
+#define SIMD_GROUP_WIDTH 16 // control bytes scanned per SSE2 compare
+#define SIMD_MAX_LOAD_FACTOR 0.875
+#define ROBIN_MAX_LOAD_FACTOR 0.9
+#define CUCKOO_BUCKET_SLOTS 4  // slots per bucket, their tags are one 64-bit word
+#define CUCKOO_STASH_SIZE 8    // initial slots for items that found no bucket
+#define CUCKOO_MAX_LOAD_FACTOR 0.93
+
+#define STATS_HISTOGRAM_BUCKETS 16 // lengths 0..14, the last bucket counts everything longer
+
+/**
+ * The storage engine behind a hashtable. Every engine is used through the
+ * same create/add/get/remove functions.
+ */
+typedef enum {
+    HASHTABLE_MODE_CHAINING,    // separate chaining, one node per item
+    HASHTABLE_MODE_INCREMENTAL, // separate chaining, resized a few buckets per operation
+    HASHTABLE_MODE_SIMD,        // open addressing, 1-byte tags probed 16 at a time
+    HASHTABLE_MODE_ROBIN_HOOD,  // linear probing, richer items give up their slot to poorer ones
+    HASHTABLE_MODE_MAPPED,      // read-only image from open_hashtable_mmap, copied into a normal table on the first write
+    HASHTABLE_MODE_CACHE,       // separate chaining with a fixed number of items, evicts with CLOCK instead of growing
+    HASHTABLE_MODE_CUCKOO       // 4-way buckets, every item in one of two buckets, so lookups read at most two
+} HashtableMode;
+
+/**
+ * What upsert_item and adjust_quantity did to the table.
+ */
+typedef enum {
+    ITEM_NOT_FOUND,
+    ITEM_INSERTED,
+    ITEM_UPDATED
+} UpsertResult;
+
+/**
+ * A view of one item. itemID and itemName point into the hashtable's string
+ * arena, so an item costs a few pointers instead of two fixed 255 byte buffers.
+ * The strings stay valid until the hashtable is freed.
+ */
 typedef struct {
-    char itemID[255];
-    char itemName[255];
+    const char* itemID;
+    const char* itemName;
     double itemPrice;
     int itemQuantity;
 } Item;
 
 typedef struct NeuNode {
     Item data;
+    size_t hash; // full hash of data.itemID, so resizing never rehashes the key
     struct NeuNode* next;
 } NeuNode;
 
+/**
+ * A block of nodes owned by one hashtable. Nodes are handed out in order,
+ * so nodes inserted together sit next to each other in memory.
+ */
+typedef struct NeuNodeSlab {
+    struct NeuNodeSlab* next;
+    size_t used;
+    size_t capacity;
+    NeuNode nodes[];
+} NeuNodeSlab;
+
+typedef struct {
+    size_t hash; // full hash of data.itemID
+    Item data;
+} NeuSlot;
+
+/**
+ * The order hashtable_export_sorted copies items in.
+ */
+typedef enum {
+    HASHTABLE_SORT_BY_ID,   // byte order of the IDs, like strcmp
+    HASHTABLE_SORT_BY_PRICE // ascending price
+} HashtableSortKey;
+
+/**
+ * Called once for every item visited by hashtable_scan.
+ */
+typedef void (*NeuScanVisitor)(const Item* item, void* context);
+
+typedef struct NeuWal NeuWal;
+
 typedef struct {
-    NeuNode** table;
+    HashtableMode mode;
+    NeuNode** table;    // chaining: bucket array
+    NeuNode** rehash_table;  // incremental: destination while a resize is running, else NULL
+    size_t rehash_capacity;
+    size_t rehash_index;     // incremental: next bucket of table to move into rehash_table
+    NeuNodeSlab* slabs;      // chaining: node storage, newest slab first
+    NeuNode* free_nodes;     // chaining: removed nodes, reused before the slab grows
+    uint8_t* ctrl;      // simd: one control byte (tag, empty or deleted) per slot
+    NeuSlot* slots;     // simd, robin hood, cuckoo: flat slot array (cuckoo: then the stash)
+    uint16_t* tags;     // cuckoo: 16-bit hash tag per slot, 0 when empty
+    size_t stash_size;  // cuckoo: items in the stash after the last bucket
+    size_t stash_capacity;
+    uint32_t* distances; // robin hood: probe distance + 1 per slot, 0 when empty
+    size_t tombstones;  // simd: number of deleted control bytes
+    void* map;                 // mapped: the image, mapped read-only
+    size_t map_size;
+    Item* map_scratch;         // mapped: views handed out by get_item and get_items_batch
+    size_t map_scratch_capacity;
+    size_t max_items;          // cache: items held before one is evicted
+    uint8_t* referenced;       // cache: one bit per node, set when the item is used
+    size_t clock_hand;         // cache: next node the eviction sweep looks at
+    size_t cache_hits;         // cache: lookups that found their item
+    size_t cache_misses;       // cache: lookups that did not
+    size_t cache_evictions;    // cache: items dropped to make room
+    size_t reserved_items;     // hashtable_reserve: removes never shrink the table below this
+    size_t resizes;            // times the table was rebuilt into a new array
+    uint64_t resize_ns;        // time spent in those rebuilds
+    NeuBloomFilter* bloom;     // optional filter in front of lookups, NULL when off
+    size_t bloom_capacity;     // table capacity the filter was sized for
+    NeuWal* wal;               // write-ahead log of a durable table, else NULL
+    NeuHashFunction hash_function;
+    uint64_t seed;           // random per table, so bucket placement cannot be predicted
+    NeuStringArena strings;  // backing store for every itemID and itemName
+    bool intern_names;       // store equal item names only once
     size_t size;
     size_t capacity;
 } NeuHashtable;
 
+/**
+ * A picture of a table's shape and cost, filled in by hashtable_stats.
+ * Probe counts are in chain nodes for the chaining engines, groups of 16
+ * slots for HASHTABLE_MODE_SIMD, buckets for HASHTABLE_MODE_CUCKOO (3 for
+ * the stash) and slots for the other engines. A miss
+ * probe count is what a lookup of an absent key starting at a random
+ * position would pay.
+ */
+typedef struct {
+    HashtableMode mode;
+    size_t size;
+    size_t capacity;
+    double load_factor;
+    size_t histogram[STATS_HISTOGRAM_BUCKETS]; // chaining: buckets per chain length, cuckoo: buckets per item count, open addressing: items per probe count
+    double mean_hit_probes;
+    size_t max_hit_probes;    // the longest seen in the sample
+    double mean_miss_probes;
+    size_t max_miss_probes;
+    size_t resizes;
+    double resize_seconds;
+    size_t bytes;             // memory owned by the table, strings included
+    double bytes_per_entry;
+    size_t positions;         // buckets, slots or groups in the table
+    size_t sampled;           // how many of them were looked at
+} NeuHashtableStats;
+
 
 NeuHashtable* create_hashtable(int capacity);
+NeuHashtable* create_hashtable_mode(int capacity, HashtableMode mode);
 void free_hashtable(NeuHashtable* hashtable);
 void add_item(NeuHashtable* hashtable, const char* itemID, const char* itemName, double itemPrice, int itemQuantity);
 Item* get_item(NeuHashtable* hashtable, const char* itemID);
+UpsertResult upsert_item(NeuHashtable* hashtable, const char* itemID, const char* itemName, double itemPrice, int itemQuantity);
+UpsertResult adjust_quantity(NeuHashtable* hashtable, const char* itemID, int delta);
 void remove_item(NeuHashtable* hashtable, const char* itemID);
+size_t add_items_batch(NeuHashtable* hashtable, const Item* items, size_t count);
+size_t get_items_batch(NeuHashtable* hashtable, const char* const* itemIDs, size_t count, Item** results);
 void print_hashtable(NeuHashtable* hashtable);
+size_t hashtable_scan(NeuHashtable* hashtable, size_t cursor, NeuScanVisitor visit, void* context);
+size_t hashtable_export(NeuHashtable* hashtable, Item* items, size_t max);
+size_t hashtable_export_sorted(NeuHashtable* hashtable, Item* items, size_t max, HashtableSortKey key);
 void print_table_visual(NeuHashtable* hashtable);
 double get_load_factor(NeuHashtable* hashtable);
+size_t get_max_probe_length(NeuHashtable* hashtable);
+double get_mean_probe_length(NeuHashtable* hashtable);
+void hashtable_reserve(NeuHashtable* hashtable, size_t items);
+void hashtable_compact(NeuHashtable* hashtable);
+void set_name_interning(NeuHashtable* hashtable, bool enabled);
+bool set_hash_function(NeuHashtable* hashtable, NeuHashFunction hash_function, uint64_t seed);
+void enable_bloom_filter(NeuHashtable* hashtable, double false_positive_rate);
+void disable_bloom_filter(NeuHashtable* hashtable);
+bool save_hashtable(NeuHashtable* hashtable, const char* path);
+NeuHashtable* open_hashtable_mmap(const char* path);
+NeuHashtable* open_hashtable_durable(const char* path, HashtableMode mode, unsigned commit_interval_ms);
+bool sync_hashtable(NeuHashtable* hashtable);
+bool checkpoint_hashtable(NeuHashtable* hashtable);
+void hashtable_stats(NeuHashtable* hashtable, NeuHashtableStats* stats, size_t sample);
+void hashtable_stats_json(const NeuHashtableStats* stats, FILE* out);
 
 
 
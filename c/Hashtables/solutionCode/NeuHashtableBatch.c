@@ -0,0 +1,145 @@
+/**
+ * Batched insert and lookup for NeuHashtable.
+ *
+ * A batch is processed BATCH_CHUNK keys at a time. All keys of a chunk are
+ * hashed first and a prefetch is issued for each target bucket, then the
+ * chain heads are prefetched, and only then are the keys resolved. The cache
+ * misses of a whole chunk overlap instead of being paid one after another.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "NeuHashtableInternal.h"
+
+#define BATCH_CHUNK 32
+
+/**
+ * Hashes one chunk of keys and prefetches the memory each lookup will touch first.
+ */
+static void __batch_prepare(NeuHashtable* hashtable, const char* const* keys, size_t count,
+                            size_t* hashes, size_t* lengths, NeuNode*** buckets) {
+    for (size_t i = 0; i < count; i++) {
+        lengths[i] = strlen(keys[i]);
+        hashes[i] = __hash_key(hashtable, keys[i], lengths[i]);
+        if (hashtable->mode == HASHTABLE_MODE_SIMD) {
+            __simd_prefetch(hashtable, hashes[i]);
+        } else if (hashtable->mode == HASHTABLE_MODE_ROBIN_HOOD) {
+            __robin_prefetch(hashtable, hashes[i]);
+        } else if (hashtable->mode == HASHTABLE_MODE_CUCKOO) {
+            __cuckoo_prefetch(hashtable, hashes[i]);
+        } else if (hashtable->mode != HASHTABLE_MODE_MAPPED) {
+            buckets[i] = __chain_bucket(hashtable, hashes[i]);
+            __builtin_prefetch(buckets[i]);
+        }
+    }
+    if (hashtable->mode == HASHTABLE_MODE_CHAINING || hashtable->mode == HASHTABLE_MODE_INCREMENTAL ||
+        hashtable->mode == HASHTABLE_MODE_CACHE) {
+        for (size_t i = 0; i < count; i++) {
+            NeuNode* head = *buckets[i];
+            if (head != NULL) {
+                __builtin_prefetch(head);
+            }
+        }
+    }
+}
+
+/**
+ * Adds a batch of items. The table is grown once up front to fit every
+ * item, so no resize happens part way through the batch. Each item goes
+ * through the same single probe find-or-add as add_item, with its hash
+ * taken from the chunk's precomputed hashes.
+ * Items whose ID already exists (in the table or earlier in the batch) are skipped.
+ *
+ * @param hashtable A pointer to the hashtable.
+ * @param items The items to add. Their strings are copied into the table.
+ * @param count The number of items.
+ * @return The number of items that were added.
+ */
+size_t add_items_batch(NeuHashtable* hashtable, const Item* items, size_t count) {
+    size_t hashes[BATCH_CHUNK];
+    size_t lengths[BATCH_CHUNK];
+    NeuNode** buckets[BATCH_CHUNK]; // only prefetched, __find_or_add_hashed finds the bucket again
+    const char* keys[BATCH_CHUNK];
+    size_t added = 0;
+
+    __reserve_capacity(hashtable, hashtable->size + count);
+
+    for (size_t start = 0; start < count; start += BATCH_CHUNK) {
+        size_t chunk = count - start < BATCH_CHUNK ? count - start : BATCH_CHUNK;
+        for (size_t i = 0; i < chunk; i++) {
+            keys[i] = items[start + i].itemID;
+        }
+        __batch_prepare(hashtable, keys, chunk, hashes, lengths, buckets);
+
+        for (size_t i = 0; i < chunk; i++) {
+            const Item* item = &items[start + i];
+            bool inserted;
+            __find_or_add_hashed(hashtable, hashes[i], keys[i], lengths[i], item->itemName, item->itemPrice, item->itemQuantity, &inserted);
+            if (!inserted) {
+                fprintf(stderr, "Item with ID %s already exists\n", keys[i]);
+                continue;
+            }
+            if (hashtable->wal != NULL) {
+                __wal_log_put(hashtable, keys[i], lengths[i], item->itemName, item->itemPrice, item->itemQuantity);
+            }
+            added++;
+        }
+    }
+    return added;
+}
+
+/**
+ * Looks up a batch of IDs.
+ *
+ * @param hashtable A pointer to the hashtable.
+ * @param itemIDs The IDs to look up.
+ * @param count The number of IDs.
+ * @param results Filled with a pointer to each item, or NULL for IDs not in the table.
+ *                For a mapped table these are views, valid until the next lookup.
+ * @return The number of IDs that were found.
+ */
+size_t get_items_batch(NeuHashtable* hashtable, const char* const* itemIDs, size_t count, Item** results) {
+    size_t hashes[BATCH_CHUNK];
+    size_t lengths[BATCH_CHUNK];
+    NeuNode** buckets[BATCH_CHUNK];
+    size_t found = 0;
+    Item* views = hashtable->mode == HASHTABLE_MODE_MAPPED ? __mapped_scratch(hashtable, count) : NULL;
+
+    // lookups here do not advance an incremental resize, so the bucket
+    // pointers taken in __batch_prepare stay valid for the whole chunk
+    for (size_t start = 0; start < count; start += BATCH_CHUNK) {
+        size_t chunk = count - start < BATCH_CHUNK ? count - start : BATCH_CHUNK;
+        const char* const* keys = itemIDs + start;
+        __batch_prepare(hashtable, keys, chunk, hashes, lengths, buckets);
+
+        for (size_t i = 0; i < chunk; i++) {
+            Item* item;
+            bool rejected = hashtable->bloom != NULL && !bloom_may_contain(hashtable->bloom, hashes[i]);
+            if (rejected) {
+                item = NULL;
+                hashtable->cache_misses += hashtable->mode == HASHTABLE_MODE_CACHE;
+            } else if (hashtable->mode == HASHTABLE_MODE_SIMD) {
+                item = __simd_get_item(hashtable, keys[i], lengths[i], hashes[i]);
+            } else if (hashtable->mode == HASHTABLE_MODE_ROBIN_HOOD) {
+                item = __robin_get_item(hashtable, keys[i], lengths[i], hashes[i]);
+            } else if (hashtable->mode == HASHTABLE_MODE_CUCKOO) {
+                item = __cuckoo_get_item(hashtable, keys[i], lengths[i], hashes[i]);
+            } else if (hashtable->mode == HASHTABLE_MODE_MAPPED) {
+                item = __mapped_get_item(hashtable, keys[i], lengths[i], hashes[i], &views[start + i]);
+            } else if (hashtable->mode == HASHTABLE_MODE_CACHE) {
+                item = __cache_get_item(hashtable, keys[i], lengths[i], hashes[i]);
+            } else {
+                NeuNode* node = __chain_find(*buckets[i], keys[i], lengths[i], hashes[i]);
+                item = node != NULL ? &node->data : NULL;
+            }
+            if (!rejected && item == NULL && hashtable->bloom != NULL) {
+                hashtable->bloom->false_positives++;
+            }
+            results[start + i] = item;
+            found += item != NULL;
+        }
+    }
+    return found;
+}
@@ -0,0 +1,227 @@
+/**
+ * Bounded cache engine for NeuHashtable.
+ *
+ * A cache table holds at most max_items items and never resizes: the
+ * bucket array and every node are allocated when the table is created.
+ * When a new item arrives at a full table, one item is evicted with the
+ * CLOCK algorithm. Each node has a referenced bit, set by every hit. The
+ * clock hand sweeps over the node array, clearing set bits, and evicts the
+ * first node whose bit is already clear. A hit only sets a byte, so no list
+ * is reordered on the read path, and an eviction is amortized O(1).
+ *
+ * Evicted items must give their memory back, so a cache table does not use
+ * the string arena: each item's ID and name share one heap record, laid out
+ * like two arena strings, which is freed with the item. Name interning is
+ * ignored.
+ *
+ * The counters cache_hits, cache_misses and cache_evictions are kept on
+ * the table.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "NeuHashtableInternal.h"
+
+#define CACHE_STRING_ALIGN sizeof(uint32_t)
+
+static size_t __cache_string_size(size_t length) {
+    size_t size = sizeof(uint32_t) + length + 1;
+    return (size + CACHE_STRING_ALIGN - 1) & ~(CACHE_STRING_ALIGN - 1);
+}
+
+static char* __cache_write_string(char* record, const char* str, size_t length) {
+    uint32_t prefix = (uint32_t)length;
+    memcpy(record, &prefix, sizeof(uint32_t));
+    memcpy(record + sizeof(uint32_t), str, length);
+    record[sizeof(uint32_t) + length] = '\0';
+    return record + sizeof(uint32_t);
+}
+
+/**
+ * Copies an item's ID and name into one heap record.
+ */
+void __cache_store_strings(Item* item, const char* itemID, size_t id_length, const char* itemName) {
+    size_t name_length = strlen(itemName);
+    size_t id_size = __cache_string_size(id_length);
+    char* record = (char*)malloc(id_size + __cache_string_size(name_length));
+    if (record == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    item->itemID = __cache_write_string(record, itemID, id_length);
+    item->itemName = __cache_write_string(record + id_size, itemName, name_length);
+}
+
+/**
+ * Gets the bytes of the record holding an item's ID and name.
+ */
+size_t __cache_record_size(const Item* item) {
+    return __cache_string_size(arena_length(item->itemID)) + __cache_string_size(arena_length(item->itemName));
+}
+
+/**
+ * Frees the record holding an item's ID and name.
+ */
+static void __cache_free_strings(Item* item) {
+    free((char*)item->itemID - sizeof(uint32_t));
+}
+
+/**
+ * Replaces the name of a cached item, rewriting its string record.
+ */
+void __cache_rename(Item* item, const char* itemName) {
+    char* old_record = (char*)item->itemID - sizeof(uint32_t);
+    __cache_store_strings(item, item->itemID, arena_length(item->itemID), itemName);
+    free(old_record);
+}
+
+static size_t __cache_index(NeuHashtable* hashtable, NeuNode* node) {
+    return (size_t)(node - hashtable->slabs->nodes);
+}
+
+/**
+ * Sets up an empty cache of max_items items. The bucket array is sized so
+ * that a full cache stays under LOAD_FACTOR, and all nodes come from a
+ * single slab, so nothing is allocated per item except its strings.
+ */
+void __cache_create_table(NeuHashtable* hashtable, size_t max_items) {
+    if (max_items == 0) {
+        max_items = 1;
+    }
+    size_t capacity = INITIAL_CAPACITY;
+    while ((double)max_items / capacity > LOAD_FACTOR) {
+        capacity *= SCALE_FACTOR;
+    }
+    hashtable->table = (NeuNode**)calloc(capacity, sizeof(NeuNode*));
+    hashtable->slabs = (NeuNodeSlab*)malloc(sizeof(NeuNodeSlab) + max_items * sizeof(NeuNode));
+    hashtable->referenced = (uint8_t*)calloc(max_items, sizeof(uint8_t));
+    if (hashtable->table == NULL || hashtable->slabs == NULL || hashtable->referenced == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    hashtable->slabs->next = NULL;
+    hashtable->slabs->used = 0;
+    hashtable->slabs->capacity = max_items;
+    hashtable->capacity = capacity;
+    hashtable->max_items = max_items;
+    hashtable->clock_hand = 0;
+}
+
+void __cache_free_table(NeuHashtable* hashtable) {
+    for (size_t i = 0; i < hashtable->capacity; i++) {
+        for (NeuNode* current = hashtable->table[i]; current != NULL; current = current->next) {
+            __cache_free_strings(&current->data);
+        }
+    }
+    free(hashtable->slabs);
+    free(hashtable->table);
+    free(hashtable->referenced);
+    hashtable->slabs = NULL;
+    hashtable->table = NULL;
+    hashtable->referenced = NULL;
+    hashtable->free_nodes = NULL;
+}
+
+/**
+ * Takes a node out of its chain, frees its strings and puts it on the free list.
+ */
+static void __cache_unlink(NeuHashtable* hashtable, NeuNode** link, NeuNode* node) {
+    *link = node->next;
+    __cache_free_strings(&node->data);
+    hashtable->referenced[__cache_index(hashtable, node)] = 0;
+    node->next = hashtable->free_nodes;
+    hashtable->free_nodes = node;
+    hashtable->size--;
+}
+
+/**
+ * Advances the clock hand to the first node that has not been used since
+ * the hand last passed it, and evicts that node. Only called on a full
+ * cache, so every node in the slab holds an item.
+ */
+static void __cache_evict(NeuHashtable* hashtable) {
+    NeuNode* nodes = hashtable->slabs->nodes;
+    while (hashtable->referenced[hashtable->clock_hand]) {
+        hashtable->referenced[hashtable->clock_hand] = 0; // second chance
+        hashtable->clock_hand = (hashtable->clock_hand + 1) % hashtable->max_items;
+    }
+    NeuNode* victim = &nodes[hashtable->clock_hand];
+    hashtable->clock_hand = (hashtable->clock_hand + 1) % hashtable->max_items;
+
+    NeuNode** link = &hashtable->table[victim->hash & (hashtable->capacity - 1)];
+    while (*link != victim) {
+        link = &(*link)->next;
+    }
+    __cache_unlink(hashtable, link, victim);
+    hashtable->cache_evictions++;
+    if (hashtable->bloom != NULL && hashtable->cache_evictions % hashtable->max_items == 0) {
+        __rebuild_bloom(hashtable); // drop the keys of evicted items
+    }
+}
+
+/**
+ * Gets an item by ID, marking it as recently used and counting the hit or miss.
+ */
+Item* __cache_get_item(NeuHashtable* hashtable, const char* itemID, size_t length, size_t hash) {
+    NeuNode* node = __chain_find(hashtable->table[hash & (hashtable->capacity - 1)], itemID, length, hash);
+    if (node == NULL) {
+        hashtable->cache_misses++;
+        return NULL;
+    }
+    hashtable->referenced[__cache_index(hashtable, node)] = 1;
+    hashtable->cache_hits++;
+    return &node->data;
+}
+
+/**
+ * Finds an item, adding it if it is missing. Adding to a full cache evicts
+ * one item first. A found item is marked as used; a new item is not, so an
+ * item that is never read again is the first to go.
+ * @param inserted Set to true if the item was added, false if it already existed.
+ * @return The item in its node.
+ */
+Item* __cache_find_or_add(NeuHashtable* hashtable, size_t hash, const char* itemID, size_t length, const char* itemName, double itemPrice, int itemQuantity, bool* inserted) {
+    NeuNode** bucket = &hashtable->table[hash & (hashtable->capacity - 1)];
+    NeuNode* existing = __chain_find(*bucket, itemID, length, hash);
+    if (existing != NULL) {
+        hashtable->referenced[__cache_index(hashtable, existing)] = 1;
+        *inserted = false;
+        return &existing->data;
+    }
+    if (hashtable->size == hashtable->max_items) {
+        __cache_evict(hashtable);
+    }
+    NeuNode* node;
+    if (hashtable->free_nodes != NULL) {
+        node = hashtable->free_nodes;
+        hashtable->free_nodes = node->next;
+    } else {
+        node = &hashtable->slabs->nodes[hashtable->slabs->used++];
+    }
+    __store_item(hashtable, &node->data, itemID, length, itemName, itemPrice, itemQuantity);
+    node->hash = hash;
+    node->next = *bucket;
+    *bucket = node;
+    hashtable->size++;
+    *inserted = true;
+    return &node->data;
+}
+
+/**
+ * Removes an item by ID, freeing its strings.
+ * @return true if the item was found and removed.
+ */
+bool __cache_remove_item(NeuHashtable* hashtable, const char* itemID, size_t length, size_t hash) {
+    NeuNode** link = &hashtable->table[hash & (hashtable->capacity - 1)];
+    while (*link != NULL) {
+        NeuNode* current = *link;
+        if (current->hash == hash && __key_equals(current->data.itemID, itemID, length)) {
+            __cache_unlink(hashtable, link, current);
+            return true;
+        }
+        link = &current->next;
+    }
+    return false;
+}
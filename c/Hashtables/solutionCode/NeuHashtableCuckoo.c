@@ -0,0 +1,435 @@
+/**
+ * Bucketized cuckoo hashing engine for NeuHashtable.
+ *
+ * Slots are grouped into buckets of CUCKOO_BUCKET_SLOTS, and every key may
+ * only live in one of two buckets: its home bucket, or the home bucket
+ * xor-ed with a value derived from its tag (partial-key cuckoo hashing, so
+ * the other bucket can be found from either one). A lookup therefore never
+ * reads more than two buckets, whatever the load.
+ *
+ * Every slot has a 16-bit tag taken from the hash, 0 when the slot is empty.
+ * The four tags of a bucket are one aligned 64-bit word, compared against
+ * the lookup's tag in a few ALU operations, so a lookup loads two tag words
+ * and then only the slots whose tag matches.
+ *
+ * The tags are kept in their own array, apart from the 40-byte slots, so a
+ * lookup is not bounded by two cache lines. A hit touches the two tag words
+ * (two lines, one if both buckets share it), the line of each slot whose
+ * tag matches (usually just the item's own, which may straddle two lines),
+ * and the item's key in the string arena, plus the stash slots while the
+ * stash is not empty. A miss usually stops after the two tag words.
+ *
+ * An insert into two full buckets moves a resident to its other bucket,
+ * which may move another one, and so on for at most CUCKOO_MAX_KICKS moves.
+ * When that runs out, the item in hand goes to a small stash that lookups
+ * check only while it is not empty. A full stash grows the table, or, if it
+ * fills while the table is mostly empty (so the hashes themselves collide,
+ * and more buckets would not help), the stash doubles instead.
+ *
+ * Pointers returned by __cuckoo_get_item point into the slot array, so they
+ * are only valid until the next add or remove on the table.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "NeuHashtableInternal.h"
+
+#define CUCKOO_MIN_CAPACITY (2 * CUCKOO_BUCKET_SLOTS)
+#define CUCKOO_MAX_KICKS 128
+
+#define CUCKOO_LANES_LOW 0x0001000100010001ULL
+#define CUCKOO_LANES_HIGH 0x8000800080008000ULL
+
+static inline uint16_t __cuckoo_tag(size_t hash) {
+    uint16_t tag = (uint16_t)(hash >> 48);
+    return tag == 0 ? 1 : tag;
+}
+
+/**
+ * Picks the home bucket from the high bits of hash * 2^64/phi, like the
+ * Robin Hood engine, so a weak hash still spreads over every bucket.
+ */
+static inline size_t __cuckoo_home(size_t hash, size_t buckets) {
+    uint64_t mixed = (uint64_t)hash * 0x9E3779B97F4A7C15ULL;
+    return (size_t)(mixed >> (64 - __builtin_ctzll(buckets))) & (buckets - 1);
+}
+
+/**
+ * Gets the other bucket of a key from either of its buckets. The | 1 keeps
+ * the two buckets apart.
+ */
+static inline size_t __cuckoo_alternate(size_t bucket, uint16_t tag, size_t buckets) {
+    return (bucket ^ (((size_t)tag * 0x5BD1E995u) | 1)) & (buckets - 1);
+}
+
+/**
+ * Compares the four tags of a bucket with tag at once.
+ * @return A word with the high bit of every matching 16-bit lane set.
+ */
+static inline uint64_t __cuckoo_match(const uint16_t* tags, size_t bucket, uint16_t tag) {
+    uint64_t word;
+    memcpy(&word, &tags[bucket * CUCKOO_BUCKET_SLOTS], sizeof(word));
+    uint64_t diff = word ^ (CUCKOO_LANES_LOW * tag);
+    // a lane is zero exactly when neither its high bit nor the carry out of its low 15 bits is set
+    uint64_t low = (diff & ~CUCKOO_LANES_HIGH) + ~CUCKOO_LANES_HIGH;
+    return ~(low | diff | ~CUCKOO_LANES_HIGH);
+}
+
+static inline size_t __cuckoo_lane(uint64_t matches) {
+    return (size_t)__builtin_ctzll(matches) / 16;
+}
+
+static void __cuckoo_alloc_arrays(size_t capacity, size_t stash_capacity, uint16_t** tags, NeuSlot** slots) {
+    *tags = (uint16_t*)calloc(capacity, sizeof(uint16_t));
+    // the stash sits right after the bucket slots
+    *slots = (NeuSlot*)malloc((capacity + stash_capacity) * sizeof(NeuSlot));
+    if (*tags == NULL || *slots == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * Places an entry known not to be in the arrays yet, moving residents to
+ * their other bucket as needed.
+ * @param stash_size The number of stash slots in use, updated if the entry
+ *                   in hand ends up in the stash.
+ * @param stash_capacity The number of stash slots after the bucket slots.
+ * @param entry The entry to place. If placing fails it holds the entry that
+ *              could not be placed, which may be a former resident.
+ * @return The slot the last entry in hand went to, which is entry itself
+ *         unless residents were moved, or SIZE_MAX if CUCKOO_MAX_KICKS moves
+ *         were not enough and the stash is full.
+ */
+static size_t __cuckoo_insert(uint16_t* tags, NeuSlot* slots, size_t capacity, size_t* stash_size, size_t stash_capacity, NeuSlot* entry) {
+    size_t buckets = capacity / CUCKOO_BUCKET_SLOTS;
+    uint16_t tag = __cuckoo_tag(entry->hash);
+    size_t bucket = __cuckoo_home(entry->hash, buckets);
+    size_t other = __cuckoo_alternate(bucket, tag, buckets);
+    uint64_t empty = __cuckoo_match(tags, bucket, 0);
+    if (empty == 0) {
+        bucket = other;
+        empty = __cuckoo_match(tags, bucket, 0);
+    }
+
+    for (int kicks = 0; empty == 0 && kicks < CUCKOO_MAX_KICKS; kicks++) {
+        // evict a resident picked by the hash and the kick count, so walks do not cycle
+        size_t slot = bucket * CUCKOO_BUCKET_SLOTS + ((entry->hash >> 8) + (size_t)kicks) % CUCKOO_BUCKET_SLOTS;
+        NeuSlot displaced = slots[slot];
+        slots[slot] = *entry;
+        tags[slot] = tag;
+        *entry = displaced;
+        tag = __cuckoo_tag(entry->hash);
+        bucket = __cuckoo_alternate(bucket, tag, buckets);
+        empty = __cuckoo_match(tags, bucket, 0);
+    }
+
+    if (empty != 0) {
+        size_t slot = bucket * CUCKOO_BUCKET_SLOTS + __cuckoo_lane(empty);
+        slots[slot] = *entry;
+        tags[slot] = tag;
+        return slot;
+    }
+    if (*stash_size < stash_capacity) {
+        slots[capacity + *stash_size] = *entry;
+        return capacity + (*stash_size)++;
+    }
+    return SIZE_MAX;
+}
+
+void __cuckoo_create_table(NeuHashtable* hashtable, size_t capacity) {
+    if (capacity < CUCKOO_MIN_CAPACITY) {
+        capacity = CUCKOO_MIN_CAPACITY;
+    }
+    __cuckoo_alloc_arrays(capacity, CUCKOO_STASH_SIZE, &hashtable->tags, &hashtable->slots);
+    hashtable->stash_size = 0;
+    hashtable->stash_capacity = CUCKOO_STASH_SIZE;
+    hashtable->table = NULL;
+    hashtable->capacity = capacity;
+}
+
+void __cuckoo_free_table(NeuHashtable* hashtable) {
+    free(hashtable->tags);
+    free(hashtable->slots);
+    hashtable->tags = NULL;
+    hashtable->slots = NULL;
+}
+
+/**
+ * Rebuilds the table into at least new_capacity slots, leaving at least one
+ * stash slot free. If the items do not fit, the capacity doubles again, or
+ * the stash does when the table is already mostly empty.
+ */
+static void __cuckoo_rehash(NeuHashtable* hashtable, size_t new_capacity, size_t stash_capacity) {
+    uint64_t start_ns = __clock_ns();
+    for (;;) {
+        uint16_t* new_tags;
+        NeuSlot* new_slots;
+        size_t new_stash_size = 0;
+        __cuckoo_alloc_arrays(new_capacity, stash_capacity, &new_tags, &new_slots);
+
+        bool placed = true;
+        for (size_t i = 0; placed && i < hashtable->capacity + hashtable->stash_size; i++) {
+            if (i < hashtable->capacity && hashtable->tags[i] == 0) {
+                continue;
+            }
+            NeuSlot entry = hashtable->slots[i];
+            placed = __cuckoo_insert(new_tags, new_slots, new_capacity, &new_stash_size, stash_capacity, &entry) != SIZE_MAX;
+        }
+        if (!placed || new_stash_size == stash_capacity) {
+            free(new_tags);
+            free(new_slots);
+            if (hashtable->size > new_capacity / 4) {
+                new_capacity *= SCALE_FACTOR;
+            } else {
+                stash_capacity *= 2;
+            }
+            continue;
+        }
+
+        __cuckoo_free_table(hashtable);
+        hashtable->tags = new_tags;
+        hashtable->slots = new_slots;
+        hashtable->stash_size = new_stash_size;
+        hashtable->stash_capacity = stash_capacity;
+        hashtable->capacity = new_capacity;
+        __record_resize(hashtable, start_ns);
+        return;
+    }
+}
+
+/**
+ * Rebuilds the table into new_capacity slots with a stash of the initial size.
+ */
+void __cuckoo_resize(NeuHashtable* hashtable, size_t new_capacity) {
+    __cuckoo_rehash(hashtable, new_capacity, CUCKOO_STASH_SIZE);
+}
+
+/**
+ * Grows the table once so that items entries fit under CUCKOO_MAX_LOAD_FACTOR.
+ */
+void __cuckoo_reserve(NeuHashtable* hashtable, size_t items) {
+    size_t new_capacity = hashtable->capacity;
+    while ((double)items > new_capacity * CUCKOO_MAX_LOAD_FACTOR) {
+        new_capacity *= SCALE_FACTOR;
+    }
+    if (new_capacity != hashtable->capacity) {
+        __cuckoo_rehash(hashtable, new_capacity, hashtable->stash_capacity);
+    }
+}
+
+/**
+ * Starts loading the tags of both buckets of hash.
+ */
+void __cuckoo_prefetch(NeuHashtable* hashtable, size_t hash) {
+    size_t buckets = hashtable->capacity / CUCKOO_BUCKET_SLOTS;
+    size_t bucket = __cuckoo_home(hash, buckets);
+    __builtin_prefetch(&hashtable->tags[bucket * CUCKOO_BUCKET_SLOTS]);
+    __builtin_prefetch(&hashtable->tags[__cuckoo_alternate(bucket, __cuckoo_tag(hash), buckets) * CUCKOO_BUCKET_SLOTS]);
+}
+
+/**
+ * Gets an item by ID.
+ * @param hashtable A pointer to the hashtable.
+ * @param itemID The ID of the item to retrieve.
+ * @param length The length of itemID.
+ * @param hash The hash of itemID.
+ * @return A pointer to the item in the slot array, or NULL if not found.
+ */
+Item* __cuckoo_get_item(NeuHashtable* hashtable, const char* itemID, size_t length, size_t hash) {
+    size_t buckets = hashtable->capacity / CUCKOO_BUCKET_SLOTS;
+    uint16_t tag = __cuckoo_tag(hash);
+    size_t bucket = __cuckoo_home(hash, buckets);
+    // the other bucket is only read if the home bucket does not hold the key
+    for (int b = 0; b < 2; b++) {
+        for (uint64_t matches = __cuckoo_match(hashtable->tags, bucket, tag); matches != 0; matches &= matches - 1) {
+            NeuSlot* slot = &hashtable->slots[bucket * CUCKOO_BUCKET_SLOTS + __cuckoo_lane(matches)];
+            if (slot->hash == hash && __key_equals(slot->data.itemID, itemID, length)) {
+                return &slot->data;
+            }
+        }
+        bucket = __cuckoo_alternate(bucket, tag, buckets);
+    }
+    for (size_t i = 0; i < hashtable->stash_size; i++) {
+        NeuSlot* slot = &hashtable->slots[hashtable->capacity + i];
+        if (slot->hash == hash && __key_equals(slot->data.itemID, itemID, length)) {
+            return &slot->data;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Looks up an item and adds it if it is missing.
+ * @param inserted Set to true if the item was added, false if it already existed.
+ * @return The item in the slot array.
+ */
+Item* __cuckoo_find_or_add(NeuHashtable* hashtable, size_t hash, const char* itemID, size_t length, const char* itemName, double itemPrice, int itemQuantity, bool* inserted) {
+    Item* item = __cuckoo_get_item(hashtable, itemID, length, hash);
+    if (item != NULL) {
+        *inserted = false;
+        return item;
+    }
+
+    *inserted = true;
+    if ((double)(hashtable->size + 1) > hashtable->capacity * CUCKOO_MAX_LOAD_FACTOR) {
+        __cuckoo_rehash(hashtable, hashtable->capacity * SCALE_FACTOR, hashtable->stash_capacity);
+    } else if (hashtable->stash_size == hashtable->stash_capacity) {
+        // a stash that fills while the table is mostly empty means the hashes collide
+        bool crowded = hashtable->size > hashtable->capacity / 4;
+        __cuckoo_rehash(hashtable, crowded ? hashtable->capacity * SCALE_FACTOR : hashtable->capacity,
+                        crowded ? hashtable->stash_capacity : hashtable->stash_capacity * 2);
+    }
+
+    NeuSlot entry;
+    entry.hash = hash;
+    __store_item(hashtable, &entry.data, itemID, length, itemName, itemPrice, itemQuantity);
+    const char* stored_id = entry.data.itemID;
+    // the stash had room, so this always succeeds
+    size_t slot = __cuckoo_insert(hashtable->tags, hashtable->slots, hashtable->capacity, &hashtable->stash_size,
+                                  hashtable->stash_capacity, &entry);
+    hashtable->size++;
+    if (hashtable->slots[slot].data.itemID == stored_id) {
+        return &hashtable->slots[slot].data;
+    }
+    // the walk moved the new item on again, so find where it landed
+    return __cuckoo_get_item(hashtable, itemID, length, hash);
+}
+
+/**
+ * Moves stashed items whose bucket has a free slot back into the buckets,
+ * so lookups can skip the stash again.
+ */
+static void __cuckoo_drain_stash(NeuHashtable* hashtable) {
+    size_t buckets = hashtable->capacity / CUCKOO_BUCKET_SLOTS;
+    for (size_t i = 0; i < hashtable->stash_size;) {
+        NeuSlot* entry = &hashtable->slots[hashtable->capacity + i];
+        uint16_t tag = __cuckoo_tag(entry->hash);
+        size_t bucket = __cuckoo_home(entry->hash, buckets);
+        uint64_t empty = __cuckoo_match(hashtable->tags, bucket, 0);
+        if (empty == 0) {
+            bucket = __cuckoo_alternate(bucket, tag, buckets);
+            empty = __cuckoo_match(hashtable->tags, bucket, 0);
+        }
+        if (empty == 0) {
+            i++;
+            continue;
+        }
+        size_t slot = bucket * CUCKOO_BUCKET_SLOTS + __cuckoo_lane(empty);
+        hashtable->slots[slot] = *entry;
+        hashtable->tags[slot] = tag;
+        *entry = hashtable->slots[hashtable->capacity + --hashtable->stash_size];
+    }
+}
+
+/**
+ * Removes an item by ID. Emptying a slot only clears its tag.
+ * @return true if the item was found and removed.
+ */
+bool __cuckoo_remove_item(NeuHashtable* hashtable, const char* itemID, size_t length, size_t hash) {
+    Item* item = __cuckoo_get_item(hashtable, itemID, length, hash);
+    if (item == NULL) {
+        return false;
+    }
+    size_t slot = (size_t)((NeuSlot*)((char*)item - offsetof(NeuSlot, data)) - hashtable->slots);
+    if (slot >= hashtable->capacity) {
+        hashtable->slots[slot] = hashtable->slots[hashtable->capacity + --hashtable->stash_size];
+    } else {
+        hashtable->tags[slot] = 0;
+        if (hashtable->stash_size > 0) {
+            __cuckoo_drain_stash(hashtable);
+        }
+    }
+    hashtable->size--;
+    return true;
+}
+
+/**
+ * Gets the number of buckets (plus the stash) a lookup reads to find the
+ * item in slot.
+ */
+static size_t __cuckoo_probes(NeuHashtable* hashtable, size_t slot) {
+    if (slot >= hashtable->capacity) {
+        return 3;
+    }
+    size_t buckets = hashtable->capacity / CUCKOO_BUCKET_SLOTS;
+    return __cuckoo_home(hashtable->slots[slot].hash, buckets) == slot / CUCKOO_BUCKET_SLOTS ? 1 : 2;
+}
+
+/**
+ * Finds the longest and the total probe length over all items, counted in
+ * buckets: 1 for the home bucket, 2 for the other one and 3 for the stash.
+ */
+void __cuckoo_probe_lengths(NeuHashtable* hashtable, size_t* max, size_t* total) {
+    *max = 0;
+    *total = 0;
+    for (size_t i = 0; i < hashtable->capacity + hashtable->stash_size; i++) {
+        if (i < hashtable->capacity && hashtable->tags[i] == 0) {
+            continue;
+        }
+        size_t probes = __cuckoo_probes(hashtable, i);
+        *total += probes;
+        if (probes > *max) {
+            *max = probes;
+        }
+    }
+}
+
+/**
+ * Adds one bucket to a stats sample. The histogram counts items per bucket,
+ * and a miss always reads both buckets, plus the stash if it is in use.
+ */
+void __cuckoo_sample_bucket(NeuHashtable* hashtable, size_t bucket, NeuStatsSample* sample) {
+    size_t used = 0;
+    for (size_t slot = bucket * CUCKOO_BUCKET_SLOTS; slot < (bucket + 1) * CUCKOO_BUCKET_SLOTS; slot++) {
+        if (hashtable->tags[slot] != 0) {
+            used++;
+            __stats_hit(sample, __cuckoo_probes(hashtable, slot));
+        }
+    }
+    __stats_histogram(sample, used);
+    __stats_miss(sample, hashtable->stash_size > 0 ? 3 : 2);
+}
+
+/**
+ * Prints the contents of the table in the same format as print_hashtable.
+ */
+void __cuckoo_print_hashtable(NeuHashtable* hashtable) {
+    printf("{");
+    bool first = true;
+    for (size_t i = 0; i < hashtable->capacity + hashtable->stash_size; i++) {
+        if (i < hashtable->capacity && hashtable->tags[i] == 0) {
+            continue;
+        }
+        if (!first) {
+            printf(", ");
+        }
+        printf("%s:", hashtable->slots[i].data.itemID);
+        __print_item(&hashtable->slots[i].data);
+        first = false;
+    }
+    printf("}\n");
+}
+
+/**
+ * Prints the number of items in each bucket, then the stash size if it is
+ * in use.
+ */
+void __cuckoo_print_table_visual(NeuHashtable* hashtable) {
+    size_t buckets = hashtable->capacity / CUCKOO_BUCKET_SLOTS;
+    printf("[");
+    for (size_t bucket = 0; bucket < buckets; bucket++) {
+        printf("%d", CUCKOO_BUCKET_SLOTS - __builtin_popcountll(__cuckoo_match(hashtable->tags, bucket, 0)));
+        if (bucket < buckets - 1) {
+            printf(", ");
+        }
+    }
+    printf("]\n");
+    if (hashtable->stash_size > 0) {
+        printf("stash: %zu\n", hashtable->stash_size);
+    }
+}
@@ -0,0 +1,171 @@
+#ifndef NEU_HASHTABLE_INTERNAL_H
+#define NEU_HASHTABLE_INTERNAL_H
+
+/**
+ * Helpers shared between the hashtable engines. These are not part of the
+ * public API, only the NeuHashtable source files include this header.
+ */
+
+#include <time.h>
+
+#include "NeuHashtable.h"
+
+/**
+ * Hashes a key with the table's hash function and seed.
+ */
+static inline size_t __hash_key(NeuHashtable* hashtable, const char* key, size_t length) {
+    return hashtable->hash_function(key, length, hashtable->seed);
+}
+
+void __store_item(NeuHashtable* hashtable, Item* item, const char* itemID, size_t id_length, const char* itemName, double itemPrice, int itemQuantity);
+
+/**
+ * Compares a key stored in the arena with a lookup key of known length.
+ * The length prefix rejects most mismatches before any bytes are compared.
+ */
+static inline bool __key_equals(const char* stored, const char* key, size_t length) {
+    return arena_length(stored) == length && memcmp(stored, key, length) == 0;
+}
+
+/**
+ * Called once for every item by __for_each_item, with the item's full hash.
+ */
+typedef void (*NeuItemVisitor)(const Item* item, size_t hash, void* context);
+
+/**
+ * Reads a monotonic clock, for timing resizes.
+ */
+static inline uint64_t __clock_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+/**
+ * Records one resize that started at start_ns.
+ */
+static inline void __record_resize(NeuHashtable* hashtable, uint64_t start_ns) {
+    hashtable->resizes++;
+    hashtable->resize_ns += __clock_ns() - start_ns;
+}
+
+/**
+ * Probe costs that hashtable_stats collects from the sampled positions.
+ */
+typedef struct {
+    size_t histogram[STATS_HISTOGRAM_BUCKETS];
+    size_t hits;
+    size_t hit_probes;
+    size_t max_hit_probes;
+    size_t misses;
+    size_t miss_probes;
+    size_t max_miss_probes;
+    size_t string_bytes; // cache: string records of the sampled items
+} NeuStatsSample;
+
+static inline void __stats_histogram(NeuStatsSample* sample, size_t length) {
+    sample->histogram[length < STATS_HISTOGRAM_BUCKETS ? length : STATS_HISTOGRAM_BUCKETS - 1]++;
+}
+
+static inline void __stats_hit(NeuStatsSample* sample, size_t probes) {
+    sample->hits++;
+    sample->hit_probes += probes;
+    if (probes > sample->max_hit_probes) {
+        sample->max_hit_probes = probes;
+    }
+}
+
+static inline void __stats_miss(NeuStatsSample* sample, size_t probes) {
+    sample->misses++;
+    sample->miss_probes += probes;
+    if (probes > sample->max_miss_probes) {
+        sample->max_miss_probes = probes;
+    }
+}
+
+// separate chaining engine and dispatch (NeuHashtable.c)
+Item* __find_or_add_item(NeuHashtable* hashtable, const char* itemID, const char* itemName, double itemPrice, int itemQuantity, bool* inserted);
+Item* __find_or_add_hashed(NeuHashtable* hashtable, size_t hash, const char* itemID, size_t length, const char* itemName, double itemPrice, int itemQuantity, bool* inserted);
+void __for_each_item(NeuHashtable* hashtable, NeuItemVisitor visit, void* context);
+Item* __get_item_hashed(NeuHashtable* hashtable, const char* itemID, size_t length, size_t hash);
+void __bloom_track_insert(NeuHashtable* hashtable, size_t hash);
+void __rebuild_bloom(NeuHashtable* hashtable);
+NeuNode** __chain_bucket(NeuHashtable* hashtable, size_t hash);
+NeuNode* __chain_find(NeuNode* current, const char* itemID, size_t length, size_t hash);
+NeuNode* __create_node(NeuHashtable* hashtable, size_t hash, const char* itemID, size_t id_length, const char* itemName, double itemPrice, int itemQuantity);
+void __reserve_capacity(NeuHashtable* hashtable, size_t items);
+void __shrink_table(NeuHashtable* hashtable);
+
+// open addressing engine (NeuHashtableSimd.c)
+void __simd_create_table(NeuHashtable* hashtable, size_t capacity);
+void __simd_free_table(NeuHashtable* hashtable);
+Item* __simd_get_item(NeuHashtable* hashtable, const char* itemID, size_t length, size_t hash);
+void __simd_add_item(NeuHashtable* hashtable, size_t hash, const char* itemID, size_t length, const char* itemName, double itemPrice, int itemQuantity);
+Item* __simd_find_or_add(NeuHashtable* hashtable, size_t hash, const char* itemID, size_t length, const char* itemName, double itemPrice, int itemQuantity, bool* inserted);
+bool __simd_remove_item(NeuHashtable* hashtable, const char* itemID, size_t length, size_t hash);
+void __simd_rehash(NeuHashtable* hashtable, size_t new_capacity);
+void __simd_reserve(NeuHashtable* hashtable, size_t items);
+void __simd_prefetch(NeuHashtable* hashtable, size_t hash);
+void __simd_print_hashtable(NeuHashtable* hashtable);
+void __simd_print_table_visual(NeuHashtable* hashtable);
+void __simd_probe_lengths(NeuHashtable* hashtable, size_t* max, size_t* total);
+void __simd_sample_group(NeuHashtable* hashtable, size_t group, NeuStatsSample* sample);
+
+// robin hood engine (NeuHashtableRobin.c)
+void __robin_create_table(NeuHashtable* hashtable, size_t capacity);
+void __robin_free_table(NeuHashtable* hashtable);
+Item* __robin_get_item(NeuHashtable* hashtable, const char* itemID, size_t length, size_t hash);
+Item* __robin_find_or_add(NeuHashtable* hashtable, size_t hash, const char* itemID, size_t length, const char* itemName, double itemPrice, int itemQuantity, bool* inserted);
+bool __robin_remove_item(NeuHashtable* hashtable, const char* itemID, size_t length, size_t hash);
+void __robin_rehash(NeuHashtable* hashtable, size_t new_capacity);
+void __robin_reserve(NeuHashtable* hashtable, size_t items);
+void __robin_prefetch(NeuHashtable* hashtable, size_t hash);
+void __robin_print_hashtable(NeuHashtable* hashtable);
+void __robin_print_table_visual(NeuHashtable* hashtable);
+void __robin_probe_lengths(NeuHashtable* hashtable, size_t* max, size_t* total);
+void __robin_sample_slot(NeuHashtable* hashtable, size_t slot, NeuStatsSample* sample);
+
+// mapped images (NeuHashtableSnapshot.c)
+Item* __mapped_get_item(NeuHashtable* hashtable, const char* itemID, size_t length, size_t hash, Item* item);
+Item* __mapped_scratch(NeuHashtable* hashtable, size_t count);
+void __mapped_for_each(NeuHashtable* hashtable, NeuItemVisitor visit, void* context);
+bool __mapped_slot_item(NeuHashtable* hashtable, size_t slot, Item* item);
+void __mapped_unmap(NeuHashtable* hashtable);
+void __mapped_promote(NeuHashtable* hashtable);
+void __mapped_probe_lengths(NeuHashtable* hashtable, size_t* max, size_t* total);
+void __mapped_sample_slot(NeuHashtable* hashtable, size_t slot, NeuStatsSample* sample);
+void __mapped_print_table_visual(NeuHashtable* hashtable);
+
+// bounded cache engine (NeuHashtableCache.c)
+void __cache_create_table(NeuHashtable* hashtable, size_t max_items);
+void __cache_free_table(NeuHashtable* hashtable);
+void __cache_store_strings(Item* item, const char* itemID, size_t id_length, const char* itemName);
+void __cache_rename(Item* item, const char* itemName);
+size_t __cache_record_size(const Item* item);
+Item* __cache_get_item(NeuHashtable* hashtable, const char* itemID, size_t length, size_t hash);
+Item* __cache_find_or_add(NeuHashtable* hashtable, size_t hash, const char* itemID, size_t length, const char* itemName, double itemPrice, int itemQuantity, bool* inserted);
+bool __cache_remove_item(NeuHashtable* hashtable, const char* itemID, size_t length, size_t hash);
+
+// bucketized cuckoo engine (NeuHashtableCuckoo.c)
+void __cuckoo_create_table(NeuHashtable* hashtable, size_t capacity);
+void __cuckoo_free_table(NeuHashtable* hashtable);
+Item* __cuckoo_get_item(NeuHashtable* hashtable, const char* itemID, size_t length, size_t hash);
+Item* __cuckoo_find_or_add(NeuHashtable* hashtable, size_t hash, const char* itemID, size_t length, const char* itemName, double itemPrice, int itemQuantity, bool* inserted);
+bool __cuckoo_remove_item(NeuHashtable* hashtable, const char* itemID, size_t length, size_t hash);
+void __cuckoo_resize(NeuHashtable* hashtable, size_t new_capacity);
+void __cuckoo_reserve(NeuHashtable* hashtable, size_t items);
+void __cuckoo_prefetch(NeuHashtable* hashtable, size_t hash);
+void __cuckoo_print_hashtable(NeuHashtable* hashtable);
+void __cuckoo_print_table_visual(NeuHashtable* hashtable);
+void __cuckoo_probe_lengths(NeuHashtable* hashtable, size_t* max, size_t* total);
+void __cuckoo_sample_bucket(NeuHashtable* hashtable, size_t bucket, NeuStatsSample* sample);
+
+// write-ahead log (NeuHashtableWal.c)
+void __wal_log_put(NeuHashtable* hashtable, const char* itemID, size_t id_length, const char* itemName, double itemPrice, int itemQuantity);
+void __wal_log_quantity(NeuHashtable* hashtable, const char* itemID, size_t id_length, int itemQuantity);
+void __wal_log_remove(NeuHashtable* hashtable, const char* itemID, size_t length);
+void __wal_close(NeuHashtable* hashtable);
+
+void __print_item(Item* item);
+
+#endif /* NEU_HASHTABLE_INTERNAL_H */
@@ -0,0 +1,289 @@
+/**
+ * Robin Hood linear probing engine for NeuHashtable.
+ *
+ * Items live in a flat slot array, like the SIMD engine, and every slot
+ * records its probe distance: how many slots past its home slot the item
+ * sits (stored plus one, so 0 marks an empty slot). On insert an item that
+ * has probed further than the resident of a slot takes the slot, and the
+ * resident moves on. This keeps every probe sequence short, which lets the
+ * table run at up to ROBIN_MAX_LOAD_FACTOR.
+ *
+ * A lookup stops as soon as it reaches a slot whose item is closer to home
+ * than the lookup has probed, because the key would have displaced it.
+ * Removing shifts the following items back one slot instead of leaving a
+ * tombstone, so deletes never make later probes longer.
+ *
+ * Pointers returned by __robin_get_item point into the slot array, so they
+ * are only valid until the next add or remove on the table.
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "NeuHashtableInternal.h"
+
+#define ROBIN_MIN_CAPACITY 8
+
+/**
+ * Picks the home slot from the high bits of hash * 2^64/phi, so a weak hash
+ * with poor low bits still spreads over the whole table.
+ */
+static inline size_t __robin_home(size_t hash, size_t capacity) {
+    uint64_t mixed = (uint64_t)hash * 0x9E3779B97F4A7C15ULL;
+    return (size_t)(mixed >> (64 - __builtin_ctzll(capacity))) & (capacity - 1);
+}
+
+static void __robin_alloc_arrays(size_t capacity, uint32_t** distances, NeuSlot** slots) {
+    *distances = (uint32_t*)calloc(capacity, sizeof(uint32_t));
+    *slots = (NeuSlot*)malloc(capacity * sizeof(NeuSlot));
+    if (*distances == NULL || *slots == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * Puts entry into slot, which is the first slot along its probe sequence
+ * whose resident is closer to home, then carries every displaced item
+ * forward the same way until one lands in an empty slot.
+ * @param distance The probe distance (plus one) of entry at slot.
+ */
+static void __robin_place(uint32_t* distances, NeuSlot* slots, size_t capacity, size_t slot, uint32_t distance, NeuSlot entry) {
+    while (distances[slot] != 0) {
+        if (distances[slot] < distance) {
+            NeuSlot displaced = slots[slot];
+            uint32_t displaced_distance = distances[slot];
+            slots[slot] = entry;
+            distances[slot] = distance;
+            entry = displaced;
+            distance = displaced_distance;
+        }
+        slot = (slot + 1) & (capacity - 1);
+        distance++;
+    }
+    slots[slot] = entry;
+    distances[slot] = distance;
+}
+
+/**
+ * Inserts an entry known not to be in the arrays yet. Used when rebuilding.
+ */
+static void __robin_insert(uint32_t* distances, NeuSlot* slots, size_t capacity, NeuSlot entry) {
+    size_t slot = __robin_home(entry.hash, capacity);
+    uint32_t distance = 1;
+    while (distances[slot] >= distance) {
+        slot = (slot + 1) & (capacity - 1);
+        distance++;
+    }
+    __robin_place(distances, slots, capacity, slot, distance, entry);
+}
+
+void __robin_create_table(NeuHashtable* hashtable, size_t capacity) {
+    if (capacity < ROBIN_MIN_CAPACITY) {
+        capacity = ROBIN_MIN_CAPACITY;
+    }
+    __robin_alloc_arrays(capacity, &hashtable->distances, &hashtable->slots);
+    hashtable->table = NULL;
+    hashtable->capacity = capacity;
+}
+
+void __robin_free_table(NeuHashtable* hashtable) {
+    free(hashtable->distances);
+    free(hashtable->slots);
+    hashtable->distances = NULL;
+    hashtable->slots = NULL;
+}
+
+/**
+ * Rebuilds the table into new_capacity slots.
+ */
+void __robin_rehash(NeuHashtable* hashtable, size_t new_capacity) {
+    uint64_t start_ns = __clock_ns();
+    uint32_t* new_distances;
+    NeuSlot* new_slots;
+    __robin_alloc_arrays(new_capacity, &new_distances, &new_slots);
+
+    for (size_t i = 0; i < hashtable->capacity; i++) {
+        if (hashtable->distances[i] != 0) {
+            __robin_insert(new_distances, new_slots, new_capacity, hashtable->slots[i]);
+        }
+    }
+
+    __robin_free_table(hashtable);
+    hashtable->distances = new_distances;
+    hashtable->slots = new_slots;
+    hashtable->capacity = new_capacity;
+    __record_resize(hashtable, start_ns);
+}
+
+/**
+ * Grows the table once so that items entries fit under ROBIN_MAX_LOAD_FACTOR.
+ */
+void __robin_reserve(NeuHashtable* hashtable, size_t items) {
+    size_t new_capacity = hashtable->capacity;
+    while ((double)items > new_capacity * ROBIN_MAX_LOAD_FACTOR) {
+        new_capacity *= SCALE_FACTOR;
+    }
+    if (new_capacity != hashtable->capacity) {
+        __robin_rehash(hashtable, new_capacity);
+    }
+}
+
+/**
+ * Starts loading the home slot of hash.
+ */
+void __robin_prefetch(NeuHashtable* hashtable, size_t hash) {
+    size_t slot = __robin_home(hash, hashtable->capacity);
+    __builtin_prefetch(&hashtable->distances[slot]);
+    __builtin_prefetch(&hashtable->slots[slot]);
+}
+
+/**
+ * Gets an item by ID.
+ * @param hashtable A pointer to the hashtable.
+ * @param itemID The ID of the item to retrieve.
+ * @param length The length of itemID.
+ * @param hash The hash of itemID.
+ * @return A pointer to the item in the slot array, or NULL if not found.
+ */
+Item* __robin_get_item(NeuHashtable* hashtable, const char* itemID, size_t length, size_t hash) {
+    size_t mask = hashtable->capacity - 1;
+    size_t slot = __robin_home(hash, hashtable->capacity);
+    for (uint32_t distance = 1; hashtable->distances[slot] >= distance; distance++) {
+        if (hashtable->slots[slot].hash == hash && __key_equals(hashtable->slots[slot].data.itemID, itemID, length)) {
+            return &hashtable->slots[slot].data;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return NULL;
+}
+
+/**
+ * Looks up an item and adds it if it is missing, in a single probe: the
+ * lookup stops at exactly the slot the new item belongs in.
+ * @param inserted Set to true if the item was added, false if it already existed.
+ * @return The item in the slot array.
+ */
+Item* __robin_find_or_add(NeuHashtable* hashtable, size_t hash, const char* itemID, size_t length, const char* itemName, double itemPrice, int itemQuantity, bool* inserted) {
+    size_t mask = hashtable->capacity - 1;
+    size_t slot = __robin_home(hash, hashtable->capacity);
+    uint32_t distance = 1;
+    for (; hashtable->distances[slot] >= distance; distance++) {
+        if (hashtable->slots[slot].hash == hash && __key_equals(hashtable->slots[slot].data.itemID, itemID, length)) {
+            *inserted = false;
+            return &hashtable->slots[slot].data;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    *inserted = true;
+    if ((double)(hashtable->size + 1) > hashtable->capacity * ROBIN_MAX_LOAD_FACTOR) {
+        __robin_rehash(hashtable, hashtable->capacity * SCALE_FACTOR);
+        mask = hashtable->capacity - 1;
+        slot = __robin_home(hash, hashtable->capacity);
+        for (distance = 1; hashtable->distances[slot] >= distance; distance++) {
+            slot = (slot + 1) & mask;
+        }
+    }
+
+    NeuSlot entry;
+    entry.hash = hash;
+    __store_item(hashtable, &entry.data, itemID, length, itemName, itemPrice, itemQuantity);
+    // the new item always stays in the first slot, only residents move on
+    __robin_place(hashtable->distances, hashtable->slots, hashtable->capacity, slot, distance, entry);
+    hashtable->size++;
+    return &hashtable->slots[slot].data;
+}
+
+/**
+ * Removes an item by ID. The items after it that are not in their home slot
+ * are shifted back by one, so no tombstone is left behind.
+ * @return true if the item was found and removed.
+ */
+bool __robin_remove_item(NeuHashtable* hashtable, const char* itemID, size_t length, size_t hash) {
+    Item* item = __robin_get_item(hashtable, itemID, length, hash);
+    if (item == NULL) {
+        return false;
+    }
+    size_t mask = hashtable->capacity - 1;
+    size_t slot = (size_t)((NeuSlot*)((char*)item - offsetof(NeuSlot, data)) - hashtable->slots);
+    size_t next = (slot + 1) & mask;
+    while (hashtable->distances[next] > 1) {
+        hashtable->slots[slot] = hashtable->slots[next];
+        hashtable->distances[slot] = hashtable->distances[next] - 1;
+        slot = next;
+        next = (next + 1) & mask;
+    }
+    hashtable->distances[slot] = 0;
+    hashtable->size--;
+    return true;
+}
+
+/**
+ * Finds the longest and the total probe distance over all items.
+ */
+void __robin_probe_lengths(NeuHashtable* hashtable, size_t* max, size_t* total) {
+    *max = 0;
+    *total = 0;
+    for (size_t i = 0; i < hashtable->capacity; i++) {
+        size_t distance = hashtable->distances[i];
+        *total += distance;
+        if (distance > *max) {
+            *max = distance;
+        }
+    }
+}
+
+/**
+ * Adds the probe costs of one slot to a stats sample: the distance of its
+ * item, if any, and the slots a miss whose home is this slot looks at.
+ */
+void __robin_sample_slot(NeuHashtable* hashtable, size_t slot, NeuStatsSample* sample) {
+    if (hashtable->distances[slot] != 0) {
+        __stats_hit(sample, hashtable->distances[slot]);
+        __stats_histogram(sample, hashtable->distances[slot]);
+    }
+    size_t mask = hashtable->capacity - 1;
+    uint32_t distance = 1;
+    while (hashtable->distances[slot] >= distance) {
+        slot = (slot + 1) & mask;
+        distance++;
+    }
+    __stats_miss(sample, distance);
+}
+
+/**
+ * Prints the contents of the table in the same format as print_hashtable.
+ */
+void __robin_print_hashtable(NeuHashtable* hashtable) {
+    printf("{");
+    bool first = true;
+    for (size_t i = 0; i < hashtable->capacity; i++) {
+        if (hashtable->distances[i] == 0) {
+            continue;
+        }
+        if (!first) {
+            printf(", ");
+        }
+        printf("%s:", hashtable->slots[i].data.itemID);
+        __print_item(&hashtable->slots[i].data);
+        first = false;
+    }
+    printf("}\n");
+}
+
+/**
+ * Prints the probe length of the item in each slot, 0 for an empty slot.
+ */
+void __robin_print_table_visual(NeuHashtable* hashtable) {
+    printf("[");
+    for (size_t i = 0; i < hashtable->capacity; i++) {
+        printf("%u", hashtable->distances[i]);
+        if (i < hashtable->capacity - 1) {
+            printf(", ");
+        }
+    }
+    printf("]\n");
+}
@@ -0,0 +1,326 @@
+/**
+ * Iterating over and exporting the items of a NeuHashtable.
+ *
+ * hashtable_scan walks the table a few positions per call and hands back a
+ * cursor to continue from, so a caller can enumerate a large table in small
+ * steps between other work without allocating anything.
+ *
+ * The chaining engines (chaining, incremental and cache) walk their buckets
+ * in reverse-binary order of the bucket index. A bucket of a table with 2^k
+ * buckets splits into the buckets with the same low k bits when the table
+ * grows, and those buckets merge back into it when the table shrinks. In
+ * reverse-binary order all of those buckets sit at the same cursor prefix,
+ * so a cursor taken from one capacity still means "everything before here
+ * has been visited" after the table is resized, including while an
+ * incremental resize is running. Every item that is in the table for the
+ * whole scan is returned at least once; items may be returned twice after a
+ * shrink, and items added or removed during the scan may or may not be.
+ *
+ * The open addressing engines move items between slots on every resize,
+ * so for them the cursor is a plain slot index and the scan is only
+ * complete if the table is not changed between calls.
+ *
+ * hashtable_export copies the items into a caller's array, and
+ * hashtable_export_sorted orders them by ID or price with an LSD radix sort
+ * over 64-bit keys extracted from the items.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "NeuHashtableInternal.h"
+
+#define RADIX_BITS 8
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+
+/**
+ * Reverses the bits of a cursor.
+ */
+static inline uint64_t __reverse_bits(uint64_t v) {
+    v = __builtin_bswap64(v);
+    v = ((v >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((v & 0x0F0F0F0F0F0F0F0FULL) << 4);
+    v = ((v >> 2) & 0x3333333333333333ULL) | ((v & 0x3333333333333333ULL) << 2);
+    v = ((v >> 1) & 0x5555555555555555ULL) | ((v & 0x5555555555555555ULL) << 1);
+    return v;
+}
+
+/**
+ * Advances a cursor to the next bucket of a table with mask + 1 buckets,
+ * counting up in the bits above the mask seen in reverse.
+ */
+static inline uint64_t __next_cursor(uint64_t cursor, uint64_t mask) {
+    cursor |= ~mask;
+    cursor = __reverse_bits(cursor);
+    cursor++;
+    return __reverse_bits(cursor);
+}
+
+static size_t __scan_chain(NeuNode* current, NeuScanVisitor visit, void* context) {
+    size_t visited = 0;
+    for (; current != NULL; current = current->next) {
+        visit(&current->data, context);
+        visited++;
+    }
+    return visited;
+}
+
+/**
+ * Visits the buckets of a chaining table at cursor. While an incremental
+ * resize is running both tables are read: the bucket of the smaller one and
+ * every bucket of the larger one it splits into. Buckets of the old table
+ * that were already moved are empty, so nothing is visited twice.
+ * @param visited Incremented by the number of items visited.
+ * @return The next cursor, 0 when the scan is done.
+ */
+static uint64_t __scan_chain_step(NeuHashtable* hashtable, uint64_t cursor, NeuScanVisitor visit, void* context, size_t* visited) {
+    if (hashtable->rehash_table == NULL) {
+        uint64_t mask = hashtable->capacity - 1;
+        *visited += __scan_chain(hashtable->table[cursor & mask], visit, context);
+        return __next_cursor(cursor, mask);
+    }
+
+    NeuNode** small = hashtable->table;
+    NeuNode** large = hashtable->rehash_table;
+    uint64_t small_mask = hashtable->capacity - 1;
+    uint64_t large_mask = hashtable->rehash_capacity - 1;
+    if (small_mask > large_mask) {
+        // a shrink is running
+        NeuNode** table = small;
+        small = large;
+        large = table;
+        uint64_t mask = small_mask;
+        small_mask = large_mask;
+        large_mask = mask;
+    }
+    *visited += __scan_chain(small[cursor & small_mask], visit, context);
+    do {
+        *visited += __scan_chain(large[cursor & large_mask], visit, context);
+        cursor = __next_cursor(cursor, large_mask);
+    } while (cursor & (small_mask ^ large_mask));
+    return cursor;
+}
+
+/**
+ * Visits one slot of an open addressing table or image.
+ * @return true if the slot held an item.
+ */
+static bool __scan_slot(NeuHashtable* hashtable, size_t slot, NeuScanVisitor visit, void* context) {
+    bool used;
+    switch (hashtable->mode) {
+        case HASHTABLE_MODE_SIMD:
+            used = !(hashtable->ctrl[slot] & 0x80);
+            break;
+        case HASHTABLE_MODE_ROBIN_HOOD:
+            used = hashtable->distances[slot] != 0;
+            break;
+        case HASHTABLE_MODE_CUCKOO:
+            used = slot >= hashtable->capacity || hashtable->tags[slot] != 0; // past the buckets is the stash
+            break;
+        default: {
+            Item item;
+            if (!__mapped_slot_item(hashtable, slot, &item)) {
+                return false;
+            }
+            visit(&item, context);
+            return true;
+        }
+    }
+    if (used) {
+        visit(&hashtable->slots[slot].data, context);
+    }
+    return used;
+}
+
+/**
+ * Visits the next few items of the table. Start with cursor 0 and pass the
+ * returned cursor to the next call until it returns 0. Each call visits at
+ * least one item unless the scan is done.
+ *
+ * For the chaining, incremental and cache engines every item that stays in
+ * the table for the whole scan is visited, even if the table is resized
+ * between calls; some items may be visited twice. For the other engines the
+ * table must not be changed between calls.
+ * @param hashtable A pointer to the hashtable.
+ * @param cursor 0 to start, else the value returned by the previous call.
+ * @param visit Called with each item. It must not change the table.
+ * @param context Passed to visit.
+ * @return The cursor to continue from, or 0 when every item was visited.
+ */
+size_t hashtable_scan(NeuHashtable* hashtable, size_t cursor, NeuScanVisitor visit, void* context) {
+    size_t visited = 0;
+    if (hashtable->mode == HASHTABLE_MODE_SIMD || hashtable->mode == HASHTABLE_MODE_ROBIN_HOOD ||
+        hashtable->mode == HASHTABLE_MODE_CUCKOO || hashtable->mode == HASHTABLE_MODE_MAPPED) {
+        size_t slots = hashtable->capacity;
+        if (hashtable->mode == HASHTABLE_MODE_CUCKOO) {
+            slots += hashtable->stash_size;
+        }
+        while (cursor < slots) {
+            visited += __scan_slot(hashtable, cursor, visit, context);
+            cursor++;
+            if (visited > 0) {
+                return cursor < slots ? cursor : 0;
+            }
+        }
+        return 0;
+    }
+
+    uint64_t next = cursor;
+    do {
+        next = __scan_chain_step(hashtable, next, visit, context, &visited);
+    } while (visited == 0 && next != 0);
+    return (size_t)next;
+}
+
+typedef struct {
+    Item* items;
+    size_t count;
+    size_t max;
+} NeuExport;
+
+static void __export_visit(const Item* item, size_t hash, void* context) {
+    NeuExport* export = (NeuExport*)context;
+    if (export->count < export->max) {
+        export->items[export->count++] = *item;
+    }
+}
+
+/**
+ * Copies the items of the table into an array, in no particular order.
+ * The copied itemID and itemName still point into the table, so they are
+ * valid until the table is freed (or, for a mapped table, promoted).
+ * @param hashtable A pointer to the hashtable.
+ * @param items The array to fill.
+ * @param max The number of items that fit in the array.
+ * @return The number of items copied, the smaller of max and the table's size.
+ */
+size_t hashtable_export(NeuHashtable* hashtable, Item* items, size_t max) {
+    NeuExport export = {items, 0, max};
+    if (max > 0) {
+        __for_each_item(hashtable, __export_visit, &export);
+    }
+    return export.count;
+}
+
+typedef struct {
+    uint64_t key;
+    const Item* item;
+} NeuSortEntry;
+
+/**
+ * Maps a price to an unsigned key with the same order: positive doubles
+ * already compare like their bits, negative ones compare in reverse.
+ */
+static inline uint64_t __price_key(double price) {
+    uint64_t bits;
+    memcpy(&bits, &price, sizeof(bits));
+    return (bits & 0x8000000000000000ULL) ? ~bits : bits | 0x8000000000000000ULL;
+}
+
+/**
+ * Packs the first 8 bytes of an ID into a key, first byte highest, so keys
+ * compare like strcmp on those bytes.
+ */
+static inline uint64_t __id_key(const char* itemID) {
+    size_t length = arena_length(itemID);
+    uint64_t key = 0;
+    for (size_t i = 0; i < 8; i++) {
+        key = (key << 8) | (i < length ? (uint8_t)itemID[i] : 0);
+    }
+    return key;
+}
+
+/**
+ * Sorts entries by key with one counting pass per byte, lowest byte first.
+ * Passes where every key has the same byte are skipped.
+ * @param scratch An array of count entries the passes alternate with.
+ * @return entries or scratch, whichever holds the sorted result.
+ */
+static NeuSortEntry* __radix_sort(NeuSortEntry* entries, NeuSortEntry* scratch, size_t count) {
+    size_t counts[sizeof(uint64_t)][RADIX_BUCKETS];
+    memset(counts, 0, sizeof(counts));
+    for (size_t i = 0; i < count; i++) {
+        for (size_t pass = 0; pass < sizeof(uint64_t); pass++) {
+            counts[pass][(entries[i].key >> (pass * RADIX_BITS)) & (RADIX_BUCKETS - 1)]++;
+        }
+    }
+
+    for (size_t pass = 0; pass < sizeof(uint64_t); pass++) {
+        size_t shift = pass * RADIX_BITS;
+        if (counts[pass][(entries[0].key >> shift) & (RADIX_BUCKETS - 1)] == count) {
+            continue;
+        }
+        size_t offset = 0;
+        for (size_t b = 0; b < RADIX_BUCKETS; b++) {
+            size_t bucket_count = counts[pass][b];
+            counts[pass][b] = offset;
+            offset += bucket_count;
+        }
+        for (size_t i = 0; i < count; i++) {
+            scratch[counts[pass][(entries[i].key >> shift) & (RADIX_BUCKETS - 1)]++] = entries[i];
+        }
+        NeuSortEntry* swap = entries;
+        entries = scratch;
+        scratch = swap;
+    }
+    return entries;
+}
+
+static int __compare_entry_ids(const void* a, const void* b) {
+    return strcmp(((const NeuSortEntry*)a)->item->itemID, ((const NeuSortEntry*)b)->item->itemID);
+}
+
+/**
+ * Copies the items of the table into an array, ordered by ID (byte order,
+ * like strcmp) or by ascending price. Items with the same price keep no
+ * particular order.
+ * @param hashtable A pointer to the hashtable.
+ * @param items The array to fill.
+ * @param max The number of items that fit in the array. If the table holds
+ *            more, only the first max in sorted order are copied.
+ * @param key What to order the items by.
+ * @return The number of items copied.
+ */
+size_t hashtable_export_sorted(NeuHashtable* hashtable, Item* items, size_t max, HashtableSortKey key) {
+    size_t size = hashtable->size;
+    if (max == 0 || size == 0) {
+        return 0;
+    }
+    Item* all = (Item*)malloc(size * sizeof(Item));
+    NeuSortEntry* entries = (NeuSortEntry*)malloc(2 * size * sizeof(NeuSortEntry));
+    if (all == NULL || entries == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    size_t count = hashtable_export(hashtable, all, size);
+    for (size_t i = 0; i < count; i++) {
+        entries[i].key = key == HASHTABLE_SORT_BY_PRICE ? __price_key(all[i].itemPrice) : __id_key(all[i].itemID);
+        entries[i].item = &all[i];
+    }
+
+    NeuSortEntry* sorted = __radix_sort(entries, entries + size, count);
+    if (key == HASHTABLE_SORT_BY_ID) {
+        // IDs that share their first 8 bytes are ordered by the rest
+        for (size_t start = 0; start < count;) {
+            size_t end = start + 1;
+            while (end < count && sorted[end].key == sorted[start].key) {
+                end++;
+            }
+            if (end - start > 1) {
+                qsort(sorted + start, end - start, sizeof(NeuSortEntry), __compare_entry_ids);
+            }
+            start = end;
+        }
+    }
+
+    if (count > max) {
+        count = max;
+    }
+    for (size_t i = 0; i < count; i++) {
+        items[i] = *sorted[i].item;
+    }
+    free(entries);
+    free(all);
+    return count;
+}
@@ -0,0 +1,414 @@
+/**
+ * Open addressing engine for NeuHashtable.
+ *
+ * Instead of a linked list per bucket, items are stored directly in a flat
+ * slot array. Next to it is an array of control bytes, one per slot, that
+ * holds either EMPTY, DELETED or a 7 bit tag taken from the item's hash.
+ * Slots are grouped 16 at a time, so a single SSE2 compare checks the tags
+ * of a whole group and only slots whose tag matches get a key compare.
+ *
+ * Each slot also caches the full hash of its key, so growing the table never
+ * hashes a key a second time.
+ *
+ * Pointers returned by __simd_get_item point into the slot array, so they
+ * are only valid until the next add or remove on the table.
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "NeuHashtableInternal.h"
+
+#define CTRL_EMPTY ((uint8_t)0x80)   // never used, ends a probe sequence
+#define CTRL_DELETED ((uint8_t)0xFE) // tombstone, probing continues past it
+
+/**
+ * A weak hash function such as hash_djb2 leaves the high bits of short keys
+ * at zero, so the hash is mixed (murmur3 finalizer) before being split into
+ * group index and tag.
+ */
+static inline size_t __simd_mix(size_t hash) {
+    uint64_t h = hash;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return (size_t)h;
+}
+
+static inline uint8_t __simd_tag(size_t mixed) {
+    return (uint8_t)(mixed & 0x7F); // top bit clear, so never EMPTY or DELETED
+}
+
+static inline size_t __simd_group(size_t mixed, size_t num_groups) {
+    return (mixed >> 7) & (num_groups - 1);
+}
+
+/**
+ * Returns a bitmask with bit i set when ctrl[i] == value, for the 16
+ * control bytes starting at group.
+ */
+static inline unsigned __simd_match(const uint8_t* group, uint8_t value) {
+#ifdef __SSE2__
+    __m128i ctrl = _mm_load_si128((const __m128i*)group);
+    return (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)value)));
+#else
+    unsigned mask = 0;
+    for (int i = 0; i < SIMD_GROUP_WIDTH; i++) {
+        mask |= (unsigned)(group[i] == value) << i;
+    }
+    return mask;
+#endif
+}
+
+/**
+ * Returns a bitmask of the slots in the group that are EMPTY or DELETED.
+ * Both have their top bit set, which is exactly what movemask collects.
+ */
+static inline unsigned __simd_match_free(const uint8_t* group) {
+#ifdef __SSE2__
+    __m128i ctrl = _mm_load_si128((const __m128i*)group);
+    return (unsigned)_mm_movemask_epi8(ctrl);
+#else
+    unsigned mask = 0;
+    for (int i = 0; i < SIMD_GROUP_WIDTH; i++) {
+        mask |= (unsigned)(group[i] >> 7) << i;
+    }
+    return mask;
+#endif
+}
+
+static void __simd_alloc_arrays(size_t capacity, uint8_t** ctrl, NeuSlot** slots) {
+    // capacity is a multiple of the group width, so aligned_alloc is happy
+    *ctrl = (uint8_t*)aligned_alloc(SIMD_GROUP_WIDTH, capacity);
+    *slots = (NeuSlot*)malloc(capacity * sizeof(NeuSlot));
+    if (*ctrl == NULL || *slots == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    memset(*ctrl, CTRL_EMPTY, capacity);
+}
+
+/**
+ * Finds the first EMPTY or DELETED slot along the probe sequence of mixed.
+ * The table always has free slots, as the load is capped below 1.
+ */
+static size_t __simd_find_free_slot(const uint8_t* ctrl, size_t capacity, size_t mixed) {
+    size_t num_groups = capacity / SIMD_GROUP_WIDTH;
+    size_t group = __simd_group(mixed, num_groups);
+    for (size_t step = 1; ; step++) {
+        unsigned mask = __simd_match_free(ctrl + group * SIMD_GROUP_WIDTH);
+        if (mask != 0) {
+            return group * SIMD_GROUP_WIDTH + __builtin_ctz(mask);
+        }
+        group = (group + step) & (num_groups - 1); // triangular probing visits every group
+    }
+}
+
+/**
+ * Allocates the slot and control arrays. Capacity is rounded up to a whole
+ * number of groups.
+ */
+void __simd_create_table(NeuHashtable* hashtable, size_t capacity) {
+    if (capacity < SIMD_GROUP_WIDTH) {
+        capacity = SIMD_GROUP_WIDTH;
+    }
+    __simd_alloc_arrays(capacity, &hashtable->ctrl, &hashtable->slots);
+    hashtable->table = NULL;
+    hashtable->capacity = capacity;
+    hashtable->tombstones = 0;
+}
+
+void __simd_free_table(NeuHashtable* hashtable) {
+    free(hashtable->ctrl);
+    free(hashtable->slots);
+    hashtable->ctrl = NULL;
+    hashtable->slots = NULL;
+}
+
+/**
+ * Rebuilds the table into new_capacity slots, dropping all tombstones.
+ */
+void __simd_rehash(NeuHashtable* hashtable, size_t new_capacity) {
+    uint64_t start_ns = __clock_ns();
+    uint8_t* new_ctrl;
+    NeuSlot* new_slots;
+    __simd_alloc_arrays(new_capacity, &new_ctrl, &new_slots);
+
+    for (size_t i = 0; i < hashtable->capacity; i++) {
+        if (hashtable->ctrl[i] & 0x80) {
+            continue; // EMPTY or DELETED
+        }
+        size_t mixed = __simd_mix(hashtable->slots[i].hash);
+        size_t slot = __simd_find_free_slot(new_ctrl, new_capacity, mixed);
+        new_ctrl[slot] = __simd_tag(mixed);
+        new_slots[slot] = hashtable->slots[i];
+    }
+
+    __simd_free_table(hashtable);
+    hashtable->ctrl = new_ctrl;
+    hashtable->slots = new_slots;
+    hashtable->capacity = new_capacity;
+    hashtable->tombstones = 0;
+    __record_resize(hashtable, start_ns);
+}
+
+/**
+ * Rebuilds the table once so that items entries fit under
+ * SIMD_MAX_LOAD_FACTOR. Tombstones count against the load until a rebuild
+ * clears them, so the table is rebuilt (at the same size if that is big
+ * enough) whenever they would otherwise force one before items is reached.
+ */
+void __simd_reserve(NeuHashtable* hashtable, size_t items) {
+    if ((double)(items + hashtable->tombstones) <= hashtable->capacity * SIMD_MAX_LOAD_FACTOR) {
+        return;
+    }
+    size_t new_capacity = hashtable->capacity;
+    while ((double)items > new_capacity * SIMD_MAX_LOAD_FACTOR) {
+        new_capacity *= SCALE_FACTOR;
+    }
+    __simd_rehash(hashtable, new_capacity);
+}
+
+/**
+ * Starts loading the first control group a lookup of hash will scan.
+ */
+void __simd_prefetch(NeuHashtable* hashtable, size_t hash) {
+    size_t group = __simd_group(__simd_mix(hash), hashtable->capacity / SIMD_GROUP_WIDTH);
+    __builtin_prefetch(hashtable->ctrl + group * SIMD_GROUP_WIDTH);
+}
+
+/**
+ * Gets an item by ID.
+ * @param hashtable A pointer to the hashtable.
+ * @param itemID The ID of the item to retrieve.
+ * @param length The length of itemID.
+ * @param hash The unmixed hash of itemID.
+ * @return A pointer to the item in the slot array, or NULL if not found.
+ */
+Item* __simd_get_item(NeuHashtable* hashtable, const char* itemID, size_t length, size_t hash) {
+    size_t mixed = __simd_mix(hash);
+    uint8_t tag = __simd_tag(mixed);
+    size_t num_groups = hashtable->capacity / SIMD_GROUP_WIDTH;
+    size_t group = __simd_group(mixed, num_groups);
+
+    for (size_t step = 1; step <= num_groups; step++) {
+        const uint8_t* ctrl = hashtable->ctrl + group * SIMD_GROUP_WIDTH;
+        unsigned mask = __simd_match(ctrl, tag);
+        while (mask != 0) {
+            size_t slot = group * SIMD_GROUP_WIDTH + __builtin_ctz(mask);
+            if (hashtable->slots[slot].hash == hash && __key_equals(hashtable->slots[slot].data.itemID, itemID, length)) {
+                return &hashtable->slots[slot].data;
+            }
+            mask &= mask - 1; // clear lowest set bit
+        }
+        if (__simd_match(ctrl, CTRL_EMPTY) != 0) {
+            return NULL; // an empty slot means the key was never placed further on
+        }
+        group = (group + step) & (num_groups - 1);
+    }
+    return NULL;
+}
+
+/**
+ * Grows (or cleans out tombstones) when one more entry would pass SIMD_MAX_LOAD_FACTOR.
+ * @return true if the table was rebuilt, which moves every slot.
+ */
+static bool __simd_make_room(NeuHashtable* hashtable) {
+    if ((double)(hashtable->size + hashtable->tombstones + 1) <= hashtable->capacity * SIMD_MAX_LOAD_FACTOR) {
+        return false;
+    }
+    // mostly tombstones: rebuilding at the same size is enough
+    if ((double)(hashtable->size + 1) <= hashtable->capacity * SIMD_MAX_LOAD_FACTOR / 2) {
+        __simd_rehash(hashtable, hashtable->capacity);
+    } else {
+        __simd_rehash(hashtable, hashtable->capacity * SCALE_FACTOR);
+    }
+    return true;
+}
+
+/**
+ * Fills a free slot with a new item.
+ */
+static Item* __simd_place(NeuHashtable* hashtable, size_t slot, size_t mixed, size_t hash, const char* itemID, size_t length, const char* itemName, double itemPrice, int itemQuantity) {
+    if (hashtable->ctrl[slot] == CTRL_DELETED) {
+        hashtable->tombstones--;
+    }
+    hashtable->ctrl[slot] = __simd_tag(mixed);
+
+    hashtable->slots[slot].hash = hash;
+    __store_item(hashtable, &hashtable->slots[slot].data, itemID, length, itemName, itemPrice, itemQuantity);
+    hashtable->size++;
+    return &hashtable->slots[slot].data;
+}
+
+/**
+ * Adds an item that is known not to be in the table yet.
+ */
+void __simd_add_item(NeuHashtable* hashtable, size_t hash, const char* itemID, size_t length, const char* itemName, double itemPrice, int itemQuantity) {
+    __simd_make_room(hashtable);
+    size_t mixed = __simd_mix(hash);
+    size_t slot = __simd_find_free_slot(hashtable->ctrl, hashtable->capacity, mixed);
+    __simd_place(hashtable, slot, mixed, hash, itemID, length, itemName, itemPrice, itemQuantity);
+}
+
+/**
+ * Looks up an item and adds it if it is missing, in a single probe. The first
+ * free slot passed on the way is remembered, and it is exactly the slot
+ * __simd_find_free_slot would pick, so a miss does not probe again unless
+ * the table has to grow first.
+ * @param inserted Set to true if the item was added, false if it already existed.
+ * @return The item in the slot array.
+ */
+Item* __simd_find_or_add(NeuHashtable* hashtable, size_t hash, const char* itemID, size_t length, const char* itemName, double itemPrice, int itemQuantity, bool* inserted) {
+    size_t mixed = __simd_mix(hash);
+    uint8_t tag = __simd_tag(mixed);
+    size_t num_groups = hashtable->capacity / SIMD_GROUP_WIDTH;
+    size_t group = __simd_group(mixed, num_groups);
+    size_t free_slot = SIZE_MAX;
+
+    for (size_t step = 1; step <= num_groups; step++) {
+        const uint8_t* ctrl = hashtable->ctrl + group * SIMD_GROUP_WIDTH;
+        unsigned mask = __simd_match(ctrl, tag);
+        while (mask != 0) {
+            size_t slot = group * SIMD_GROUP_WIDTH + __builtin_ctz(mask);
+            if (hashtable->slots[slot].hash == hash && __key_equals(hashtable->slots[slot].data.itemID, itemID, length)) {
+                *inserted = false;
+                return &hashtable->slots[slot].data;
+            }
+            mask &= mask - 1;
+        }
+        unsigned free_mask = __simd_match_free(ctrl);
+        if (free_slot == SIZE_MAX && free_mask != 0) {
+            free_slot = group * SIMD_GROUP_WIDTH + __builtin_ctz(free_mask);
+        }
+        if (__simd_match(ctrl, CTRL_EMPTY) != 0) {
+            break;
+        }
+        group = (group + step) & (num_groups - 1);
+    }
+
+    *inserted = true;
+    if (__simd_make_room(hashtable) || free_slot == SIZE_MAX) {
+        free_slot = __simd_find_free_slot(hashtable->ctrl, hashtable->capacity, mixed);
+    }
+    return __simd_place(hashtable, free_slot, mixed, hash, itemID, length, itemName, itemPrice, itemQuantity);
+}
+
+/**
+ * Removes an item by ID.
+ * A slot can go straight back to EMPTY when its group still has an EMPTY
+ * slot, as no probe sequence ever continued past that group. Otherwise it
+ * becomes a tombstone.
+ * @return true if the item was found and removed.
+ */
+bool __simd_remove_item(NeuHashtable* hashtable, const char* itemID, size_t length, size_t hash) {
+    Item* item = __simd_get_item(hashtable, itemID, length, hash);
+    if (item == NULL) {
+        return false;
+    }
+    size_t slot = (size_t)((NeuSlot*)((char*)item - offsetof(NeuSlot, data)) - hashtable->slots);
+    const uint8_t* group = hashtable->ctrl + (slot & ~(size_t)(SIMD_GROUP_WIDTH - 1));
+    if (__simd_match(group, CTRL_EMPTY) != 0) {
+        hashtable->ctrl[slot] = CTRL_EMPTY;
+    } else {
+        hashtable->ctrl[slot] = CTRL_DELETED;
+        hashtable->tombstones++;
+    }
+    hashtable->size--;
+    return true;
+}
+
+/**
+ * Finds the longest and the total number of groups probed to reach each item.
+ */
+void __simd_probe_lengths(NeuHashtable* hashtable, size_t* max, size_t* total) {
+    size_t num_groups = hashtable->capacity / SIMD_GROUP_WIDTH;
+    *max = 0;
+    *total = 0;
+    for (size_t i = 0; i < hashtable->capacity; i++) {
+        if (hashtable->ctrl[i] & 0x80) {
+            continue;
+        }
+        size_t group = __simd_group(__simd_mix(hashtable->slots[i].hash), num_groups);
+        size_t probes = 1;
+        for (size_t step = 1; group != i / SIMD_GROUP_WIDTH; step++) {
+            group = (group + step) & (num_groups - 1);
+            probes++;
+        }
+        *total += probes;
+        if (probes > *max) {
+            *max = probes;
+        }
+    }
+}
+
+/**
+ * Adds the probe costs of one group to a stats sample: the groups each of
+ * its items is found after, and the groups a miss that starts here scans.
+ */
+void __simd_sample_group(NeuHashtable* hashtable, size_t group, NeuStatsSample* sample) {
+    size_t num_groups = hashtable->capacity / SIMD_GROUP_WIDTH;
+    for (size_t i = group * SIMD_GROUP_WIDTH; i < (group + 1) * SIMD_GROUP_WIDTH; i++) {
+        if (hashtable->ctrl[i] & 0x80) {
+            continue;
+        }
+        size_t current = __simd_group(__simd_mix(hashtable->slots[i].hash), num_groups);
+        size_t probes = 1;
+        for (size_t step = 1; current != group; step++) {
+            current = (current + step) & (num_groups - 1);
+            probes++;
+        }
+        __stats_hit(sample, probes);
+        __stats_histogram(sample, probes);
+    }
+    size_t probes = 1;
+    for (size_t step = 1; step < num_groups && __simd_match(hashtable->ctrl + group * SIMD_GROUP_WIDTH, CTRL_EMPTY) == 0; step++) {
+        group = (group + step) & (num_groups - 1);
+        probes++;
+    }
+    __stats_miss(sample, probes);
+}
+
+/**
+ * Prints the contents of the table in the same format as print_hashtable.
+ */
+void __simd_print_hashtable(NeuHashtable* hashtable) {
+    printf("{");
+    bool first = true;
+    for (size_t i = 0; i < hashtable->capacity; i++) {
+        if (hashtable->ctrl[i] & 0x80) {
+            continue;
+        }
+        if (!first) {
+            printf(", ");
+        }
+        printf("%s:", hashtable->slots[i].data.itemID);
+        __print_item(&hashtable->slots[i].data);
+        first = false;
+    }
+    printf("}\n");
+}
+
+/**
+ * Prints the number of items in each group of 16 slots.
+ */
+void __simd_print_table_visual(NeuHashtable* hashtable) {
+    size_t num_groups = hashtable->capacity / SIMD_GROUP_WIDTH;
+    printf("[");
+    for (size_t g = 0; g < num_groups; g++) {
+        unsigned free_mask = __simd_match_free(hashtable->ctrl + g * SIMD_GROUP_WIDTH);
+        printf("%d", SIMD_GROUP_WIDTH - __builtin_popcount(free_mask));
+        if (g < num_groups - 1) {
+            printf(", ");
+        }
+    }
+    printf("]\n");
+}
@@ -0,0 +1,460 @@
+/**
+ * Saving a NeuHashtable to disk and mapping it back in.
+ *
+ * The image is a header, a linear probing slot array and the item strings.
+ * Every reference inside the image is a byte offset from its start, so the
+ * file can be mapped at any address and used as is: open_hashtable_mmap only
+ * checks the header, and get_item probes the mapped slot array directly.
+ * Strings are stored with the same 4 byte length prefix as the string arena,
+ * so keys are compared with __key_equals straight from the mapping.
+ *
+ * A mapped table is read-only. The first write copies every item into a
+ * normal table of the engine the image was saved from and unmaps the file.
+ *
+ * Images use the byte order of the machine that wrote them.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "NeuHashtableInternal.h"
+
+#define IMAGE_MAGIC "NEUHTIMG"
+#define IMAGE_VERSION 1
+#define IMAGE_MIN_CAPACITY 8
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t hash_id;         // index into __image_hashes
+    uint64_t seed;
+    uint64_t size;
+    uint64_t capacity;        // slots, a power of two at most half full
+    uint64_t slots_offset;
+    uint64_t strings_offset;
+    uint64_t file_size;
+    uint32_t mode;            // engine to promote into on the first write
+    uint32_t reserved;
+} NeuImageHeader;
+
+typedef struct {
+    uint64_t hash;
+    uint64_t id_offset;       // 0 marks an empty slot
+    uint64_t name_offset;
+    double price;
+    int64_t quantity;
+} NeuImageSlot;
+
+static const NeuHashFunction __image_hashes[] = {hash_djb2, hash_wyhash, hash_xxh3};
+#define IMAGE_HASH_COUNT (sizeof(__image_hashes) / sizeof(__image_hashes[0]))
+
+static inline const NeuImageHeader* __image_header(NeuHashtable* hashtable) {
+    return (const NeuImageHeader*)hashtable->map;
+}
+
+static inline const NeuImageSlot* __image_slots(NeuHashtable* hashtable) {
+    return (const NeuImageSlot*)((const char*)hashtable->map + __image_header(hashtable)->slots_offset);
+}
+
+static inline const char* __image_string(NeuHashtable* hashtable, uint64_t offset) {
+    return (const char*)hashtable->map + offset;
+}
+
+/**
+ * Fills in an Item view of one mapped slot.
+ */
+static void __image_item(NeuHashtable* hashtable, const NeuImageSlot* slot, Item* item) {
+    item->itemID = __image_string(hashtable, slot->id_offset);
+    item->itemName = __image_string(hashtable, slot->name_offset);
+    item->itemPrice = slot->price;
+    item->itemQuantity = (int)slot->quantity;
+}
+
+/**
+ * Gets an item from a mapped image.
+ * @param item Filled with a view of the item; its strings point into the mapping.
+ * @return item, or NULL if the ID is not in the image.
+ */
+Item* __mapped_get_item(NeuHashtable* hashtable, const char* itemID, size_t length, size_t hash, Item* item) {
+    const NeuImageSlot* slots = __image_slots(hashtable);
+    size_t mask = hashtable->capacity - 1;
+    for (size_t i = hash & mask; slots[i].id_offset != 0; i = (i + 1) & mask) {
+        if (slots[i].hash == hash && __key_equals(__image_string(hashtable, slots[i].id_offset), itemID, length)) {
+            __image_item(hashtable, &slots[i], item);
+            return item;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Makes sure the scratch buffer that mapped lookups return views in holds
+ * at least count items.
+ */
+Item* __mapped_scratch(NeuHashtable* hashtable, size_t count) {
+    if (hashtable->map_scratch_capacity < count) {
+        free(hashtable->map_scratch);
+        hashtable->map_scratch = (Item*)malloc(count * sizeof(Item));
+        if (hashtable->map_scratch == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        hashtable->map_scratch_capacity = count;
+    }
+    return hashtable->map_scratch;
+}
+
+void __mapped_for_each(NeuHashtable* hashtable, NeuItemVisitor visit, void* context) {
+    const NeuImageSlot* slots = __image_slots(hashtable);
+    Item item;
+    for (size_t i = 0; i < hashtable->capacity; i++) {
+        if (slots[i].id_offset != 0) {
+            __image_item(hashtable, &slots[i], &item);
+            visit(&item, slots[i].hash, context);
+        }
+    }
+}
+
+/**
+ * Gets a view of the item in one slot of the image.
+ * @return false if the slot is empty.
+ */
+bool __mapped_slot_item(NeuHashtable* hashtable, size_t slot, Item* item) {
+    const NeuImageSlot* slots = __image_slots(hashtable);
+    if (slots[slot].id_offset == 0) {
+        return false;
+    }
+    __image_item(hashtable, &slots[slot], item);
+    return true;
+}
+
+void __mapped_unmap(NeuHashtable* hashtable) {
+    munmap(hashtable->map, hashtable->map_size);
+    free(hashtable->map_scratch);
+    hashtable->map = NULL;
+    hashtable->map_size = 0;
+    hashtable->map_scratch = NULL;
+    hashtable->map_scratch_capacity = 0;
+}
+
+static void __promote_visit(const Item* item, size_t hash, void* context) {
+    bool inserted;
+    __find_or_add_item((NeuHashtable*)context, item->itemID, item->itemName, item->itemPrice, item->itemQuantity, &inserted);
+}
+
+/**
+ * Copies every item of a mapped table into a table of the engine the image
+ * was saved from, then unmaps the file. Views returned by earlier lookups
+ * become invalid.
+ */
+void __mapped_promote(NeuHashtable* hashtable) {
+    const NeuImageHeader* header = __image_header(hashtable);
+    NeuHashtable* promoted = create_hashtable_mode(INITIAL_CAPACITY, (HashtableMode)header->mode);
+    set_hash_function(promoted, hashtable->hash_function, hashtable->seed);
+    set_name_interning(promoted, hashtable->intern_names);
+    __reserve_capacity(promoted, hashtable->size);
+    __mapped_for_each(hashtable, __promote_visit, promoted);
+
+    NeuBloomFilter* bloom = hashtable->bloom;
+    size_t bloom_capacity = hashtable->bloom_capacity;
+    NeuWal* wal = hashtable->wal;
+    __mapped_unmap(hashtable);
+    *hashtable = *promoted; // take over the new table's storage and arena
+    hashtable->bloom = bloom; // still holds every key, rebuilt on the next insert
+    hashtable->bloom_capacity = bloom_capacity;
+    hashtable->wal = wal; // a durable table keeps logging after the first write
+    free(promoted);
+}
+
+/**
+ * Finds the longest and the total linear probe distance over all items.
+ */
+void __mapped_probe_lengths(NeuHashtable* hashtable, size_t* max, size_t* total) {
+    const NeuImageSlot* slots = __image_slots(hashtable);
+    size_t mask = hashtable->capacity - 1;
+    *max = 0;
+    *total = 0;
+    for (size_t i = 0; i < hashtable->capacity; i++) {
+        if (slots[i].id_offset == 0) {
+            continue;
+        }
+        size_t probes = ((i - (slots[i].hash & mask)) & mask) + 1;
+        *total += probes;
+        if (probes > *max) {
+            *max = probes;
+        }
+    }
+}
+
+/**
+ * Adds the probe costs of one image slot to a stats sample: the linear
+ * probe distance of its item, if any, and the run a miss starting here scans.
+ */
+void __mapped_sample_slot(NeuHashtable* hashtable, size_t slot, NeuStatsSample* sample) {
+    const NeuImageSlot* slots = __image_slots(hashtable);
+    size_t mask = hashtable->capacity - 1;
+    if (slots[slot].id_offset != 0) {
+        size_t probes = ((slot - (slots[slot].hash & mask)) & mask) + 1;
+        __stats_hit(sample, probes);
+        __stats_histogram(sample, probes);
+    }
+    size_t probes = 1;
+    for (size_t i = slot; slots[i].id_offset != 0; i = (i + 1) & mask) {
+        probes++;
+    }
+    __stats_miss(sample, probes);
+}
+
+/**
+ * Prints 1 for each occupied slot of the image and 0 for each empty one.
+ */
+void __mapped_print_table_visual(NeuHashtable* hashtable) {
+    const NeuImageSlot* slots = __image_slots(hashtable);
+    printf("[");
+    for (size_t i = 0; i < hashtable->capacity; i++) {
+        printf("%d", slots[i].id_offset != 0);
+        if (i < hashtable->capacity - 1) {
+            printf(", ");
+        }
+    }
+    printf("]\n");
+}
+
+typedef struct {
+    NeuImageSlot* slots;
+    size_t mask;
+    uint64_t next_offset;     // where the next string goes
+    FILE* file;               // NULL while only laying out the slots
+    bool failed;
+} NeuImageWriter;
+
+static uint64_t __image_string_size(size_t length) {
+    return (sizeof(uint32_t) + length + 1 + 3) & ~(uint64_t)3; // keep prefixes 4 byte aligned
+}
+
+static void __image_write_string(NeuImageWriter* writer, const char* str) {
+    static const char padding[4] = {0};
+    uint32_t length = (uint32_t)arena_length(str);
+    uint64_t size = __image_string_size(length);
+    if (fwrite(&length, sizeof(length), 1, writer->file) != 1 ||
+        fwrite(str, 1, length + 1, writer->file) != length + 1 ||
+        fwrite(padding, 1, size - sizeof(length) - length - 1, writer->file) != size - sizeof(length) - length - 1) {
+        writer->failed = true;
+    }
+}
+
+/**
+ * First pass: gives each item a slot and string offsets.
+ * Second pass (file set): writes the strings in the same order.
+ */
+static void __image_visit(const Item* item, size_t hash, void* context) {
+    NeuImageWriter* writer = (NeuImageWriter*)context;
+    if (writer->file != NULL) {
+        __image_write_string(writer, item->itemID);
+        __image_write_string(writer, item->itemName);
+        return;
+    }
+    size_t i = hash & writer->mask;
+    while (writer->slots[i].id_offset != 0) {
+        i = (i + 1) & writer->mask;
+    }
+    NeuImageSlot* slot = &writer->slots[i];
+    slot->hash = hash;
+    // offsets point past the length prefix, like the pointers the arena hands out
+    slot->id_offset = writer->next_offset + sizeof(uint32_t);
+    writer->next_offset += __image_string_size(arena_length(item->itemID));
+    slot->name_offset = writer->next_offset + sizeof(uint32_t);
+    writer->next_offset += __image_string_size(arena_length(item->itemName));
+    slot->price = item->itemPrice;
+    slot->quantity = item->itemQuantity;
+}
+
+/**
+ * Flushes the directory holding path, so a rename into it survives a crash.
+ * @return true on success, else errno is set.
+ */
+static bool __fsync_parent_dir(const char* path) {
+    const char* slash = strrchr(path, '/');
+    size_t length = slash == NULL ? 1 : slash == path ? 1 : (size_t)(slash - path);
+    char* dir = (char*)malloc(length + 1);
+    if (dir == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(dir, slash == NULL ? "." : path, length);
+    dir[length] = '\0';
+    int fd = open(dir, O_RDONLY | O_DIRECTORY);
+    free(dir);
+    if (fd < 0) {
+        return false;
+    }
+    bool synced = fsync(fd) == 0;
+    int saved_errno = errno;
+    close(fd);
+    errno = saved_errno;
+    return synced;
+}
+
+/**
+ * Writes the hashtable to a file that open_hashtable_mmap can map.
+ * The image is written to path.tmp and renamed over path, so a reader never
+ * sees a half written file. The directory is flushed after the rename, so
+ * once this returns true the new image is what a crash leaves behind.
+ * @param hashtable A pointer to the hashtable.
+ * @param path The file to write.
+ * @return true on success. On failure errno is set, EINVAL if the table uses
+ *         a hash function other than the built-in ones or is a cache.
+ */
+bool save_hashtable(NeuHashtable* hashtable, const char* path) {
+    if (hashtable->mode == HASHTABLE_MODE_CACHE) {
+        errno = EINVAL; // a cache is refilled from its backing store, not saved
+        return false;
+    }
+    uint32_t hash_id = 0;
+    while (hash_id < IMAGE_HASH_COUNT && __image_hashes[hash_id] != hashtable->hash_function) {
+        hash_id++;
+    }
+    if (hash_id == IMAGE_HASH_COUNT) {
+        errno = EINVAL; // a function pointer cannot be stored in the file
+        return false;
+    }
+
+    size_t capacity = IMAGE_MIN_CAPACITY;
+    while (capacity < hashtable->size * 2) {
+        capacity *= 2;
+    }
+    NeuImageHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, IMAGE_MAGIC, sizeof(header.magic));
+    header.version = IMAGE_VERSION;
+    header.hash_id = hash_id;
+    header.seed = hashtable->seed;
+    header.size = hashtable->size;
+    header.capacity = capacity;
+    header.slots_offset = sizeof(NeuImageHeader);
+    header.strings_offset = header.slots_offset + capacity * sizeof(NeuImageSlot);
+    header.mode = hashtable->mode == HASHTABLE_MODE_MAPPED ? __image_header(hashtable)->mode : (uint32_t)hashtable->mode;
+
+    NeuImageWriter writer = {0};
+    writer.slots = (NeuImageSlot*)calloc(capacity, sizeof(NeuImageSlot));
+    if (writer.slots == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    writer.mask = capacity - 1;
+    writer.next_offset = header.strings_offset;
+    __for_each_item(hashtable, __image_visit, &writer);
+    header.file_size = writer.next_offset;
+
+    size_t path_length = strlen(path);
+    char* tmp_path = (char*)malloc(path_length + 5);
+    if (tmp_path == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(tmp_path, path, path_length);
+    memcpy(tmp_path + path_length, ".tmp", 5);
+
+    writer.file = fopen(tmp_path, "wb");
+    if (writer.file != NULL) {
+        if (fwrite(&header, sizeof(header), 1, writer.file) != 1 ||
+            fwrite(writer.slots, sizeof(NeuImageSlot), capacity, writer.file) != capacity) {
+            writer.failed = true;
+        }
+        if (!writer.failed) {
+            __for_each_item(hashtable, __image_visit, &writer);
+        }
+        // the image must be on disk before it replaces the old one, or a
+        // crash could leave an empty file behind a truncated write-ahead log
+        if (!writer.failed && (fflush(writer.file) != 0 || fsync(fileno(writer.file)) != 0)) {
+            writer.failed = true;
+        }
+        if (fclose(writer.file) != 0) {
+            writer.failed = true;
+        }
+    }
+    bool saved = writer.file != NULL && !writer.failed && rename(tmp_path, path) == 0;
+    if (saved) {
+        // the rename itself is only durable once the directory entry is
+        saved = __fsync_parent_dir(path);
+    } else {
+        int saved_errno = errno;
+        remove(tmp_path);
+        errno = saved_errno;
+    }
+    free(tmp_path);
+    free(writer.slots);
+    return saved;
+}
+
+/**
+ * Maps an image written by save_hashtable. Nothing is copied or parsed:
+ * lookups read the file through the page cache. The table is read-only
+ * until the first add, upsert, adjust or successful remove, which copies it
+ * into a normal table first.
+ * Items returned by get_item are views into a buffer owned by the table and
+ * stay valid until the next lookup.
+ * @param path The file to map.
+ * @return The mapped table, or NULL with errno set (EINVAL for a file that
+ *         is not a valid image).
+ */
+NeuHashtable* open_hashtable_mmap(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        int saved_errno = errno;
+        close(fd);
+        errno = saved_errno;
+        return NULL;
+    }
+    if ((size_t)st.st_size < sizeof(NeuImageHeader)) {
+        close(fd);
+        errno = EINVAL;
+        return NULL;
+    }
+    void* map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd); // the mapping keeps the file open
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+
+    const NeuImageHeader* header = (const NeuImageHeader*)map;
+    if (memcmp(header->magic, IMAGE_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != IMAGE_VERSION ||
+        header->hash_id >= IMAGE_HASH_COUNT ||
+        header->file_size != (uint64_t)st.st_size ||
+        header->capacity == 0 || (header->capacity & (header->capacity - 1)) != 0 ||
+        header->size >= header->capacity ||
+        header->slots_offset + header->capacity * sizeof(NeuImageSlot) > header->strings_offset ||
+        header->strings_offset > header->file_size ||
+        header->mode == HASHTABLE_MODE_MAPPED || header->mode == HASHTABLE_MODE_CACHE ||
+        header->mode > HASHTABLE_MODE_CUCKOO) {
+        munmap(map, (size_t)st.st_size);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    NeuHashtable* hashtable = (NeuHashtable*)calloc(1, sizeof(NeuHashtable));
+    if (hashtable == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    hashtable->mode = HASHTABLE_MODE_MAPPED;
+    hashtable->map = map;
+    hashtable->map_size = (size_t)st.st_size;
+    hashtable->hash_function = __image_hashes[header->hash_id];
+    hashtable->seed = header->seed;
+    hashtable->size = header->size;
+    hashtable->capacity = header->capacity;
+    arena_init(&hashtable->strings);
+    return hashtable;
+}
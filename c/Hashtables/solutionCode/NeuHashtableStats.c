@@ -0,0 +1,181 @@
+/**
+ * Shape and cost statistics for NeuHashtable.
+ *
+ * hashtable_stats looks at an evenly spaced sample of the table's buckets
+ * (or slots, or SIMD groups), so a production table can be checked often
+ * without scanning millions of positions. Each engine reports, per sampled
+ * position, the probes its items are found after and the probes a miss
+ * starting there would take. Histograms are scaled up to the whole table.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "NeuHashtableInternal.h"
+
+static const char* __stats_mode_names[] = {"chain", "incremental", "simd", "robin", "mapped", "cache", "cuckoo"};
+
+/**
+ * Adds one chain to a stats sample. The k-th node is found after k
+ * compares, and a miss compares every node of the chain.
+ */
+static void __chain_sample_bucket(NeuHashtable* hashtable, NeuNode* current, NeuStatsSample* sample) {
+    size_t length = 0;
+    for (; current != NULL; current = current->next) {
+        length++;
+        __stats_hit(sample, length);
+        if (hashtable->mode == HASHTABLE_MODE_CACHE) {
+            sample->string_bytes += __cache_record_size(&current->data);
+        }
+    }
+    __stats_histogram(sample, length);
+    __stats_miss(sample, length);
+}
+
+/**
+ * Gets the number of positions hashtable_stats can sample. During an
+ * incremental resize these are the old buckets not moved yet followed by
+ * every bucket of the new table.
+ */
+static size_t __stats_positions(NeuHashtable* hashtable) {
+    if (hashtable->mode == HASHTABLE_MODE_SIMD) {
+        return hashtable->capacity / SIMD_GROUP_WIDTH;
+    }
+    if (hashtable->mode == HASHTABLE_MODE_CUCKOO) {
+        return hashtable->capacity / CUCKOO_BUCKET_SLOTS;
+    }
+    if (hashtable->rehash_table != NULL) {
+        return hashtable->capacity - hashtable->rehash_index + hashtable->rehash_capacity;
+    }
+    return hashtable->capacity;
+}
+
+static void __stats_sample_position(NeuHashtable* hashtable, size_t position, NeuStatsSample* sample) {
+    switch (hashtable->mode) {
+        case HASHTABLE_MODE_SIMD:
+            __simd_sample_group(hashtable, position, sample);
+            break;
+        case HASHTABLE_MODE_ROBIN_HOOD:
+            __robin_sample_slot(hashtable, position, sample);
+            break;
+        case HASHTABLE_MODE_CUCKOO:
+            __cuckoo_sample_bucket(hashtable, position, sample);
+            break;
+        case HASHTABLE_MODE_MAPPED:
+            __mapped_sample_slot(hashtable, position, sample);
+            break;
+        default:
+            if (hashtable->rehash_table == NULL) {
+                __chain_sample_bucket(hashtable, hashtable->table[position], sample);
+            } else if (position < hashtable->capacity - hashtable->rehash_index) {
+                __chain_sample_bucket(hashtable, hashtable->table[hashtable->rehash_index + position], sample);
+            } else {
+                size_t moved = position - (hashtable->capacity - hashtable->rehash_index);
+                __chain_sample_bucket(hashtable, hashtable->rehash_table[moved], sample);
+            }
+            break;
+    }
+}
+
+/**
+ * Adds up the memory the table owns. Only the string records of a cache
+ * are not tracked, so they are estimated from the sample.
+ */
+static size_t __stats_bytes(NeuHashtable* hashtable, const NeuStatsSample* sample) {
+    size_t bytes = sizeof(NeuHashtable);
+    bytes += hashtable->strings.bytes_reserved + hashtable->strings.intern_capacity * sizeof(const char*);
+    if (hashtable->bloom != NULL) {
+        bytes += sizeof(NeuBloomFilter) + hashtable->bloom->num_blocks * BLOOM_BLOCK_WORDS * sizeof(uint64_t);
+    }
+    switch (hashtable->mode) {
+        case HASHTABLE_MODE_SIMD:
+            bytes += hashtable->capacity * (sizeof(uint8_t) + sizeof(NeuSlot));
+            break;
+        case HASHTABLE_MODE_ROBIN_HOOD:
+            bytes += hashtable->capacity * (sizeof(uint32_t) + sizeof(NeuSlot));
+            break;
+        case HASHTABLE_MODE_CUCKOO:
+            bytes += hashtable->capacity * sizeof(uint16_t) + (hashtable->capacity + hashtable->stash_capacity) * sizeof(NeuSlot);
+            break;
+        case HASHTABLE_MODE_MAPPED:
+            bytes += hashtable->map_size + hashtable->map_scratch_capacity * sizeof(Item);
+            break;
+        default:
+            bytes += (hashtable->capacity + hashtable->rehash_capacity) * sizeof(NeuNode*);
+            for (NeuNodeSlab* slab = hashtable->slabs; slab != NULL; slab = slab->next) {
+                bytes += sizeof(NeuNodeSlab) + slab->capacity * sizeof(NeuNode);
+            }
+            if (hashtable->mode == HASHTABLE_MODE_CACHE) {
+                bytes += hashtable->max_items * sizeof(uint8_t);
+                if (sample->hits > 0) {
+                    bytes += (size_t)((double)sample->string_bytes / sample->hits * hashtable->size);
+                }
+            }
+            break;
+    }
+    return bytes;
+}
+
+/**
+ * Collects statistics about a table: a histogram of chain lengths (or probe
+ * counts), mean and max probes for hits and misses, how often and for how
+ * long the table was resized, and the bytes it uses per item.
+ * @param hashtable A pointer to the hashtable. It is not changed.
+ * @param stats Filled with the statistics.
+ * @param sample The most buckets (or slots, or groups) to look at, spread
+ *               evenly over the table. 0 looks at all of them.
+ */
+void hashtable_stats(NeuHashtable* hashtable, NeuHashtableStats* stats, size_t sample) {
+    memset(stats, 0, sizeof(NeuHashtableStats));
+    stats->mode = hashtable->mode;
+    stats->size = hashtable->size;
+    stats->capacity = hashtable->capacity;
+    stats->load_factor = get_load_factor(hashtable);
+    stats->resizes = hashtable->resizes;
+    stats->resize_seconds = hashtable->resize_ns / 1e9;
+    stats->positions = __stats_positions(hashtable);
+
+    size_t stride = 1;
+    size_t start = 0;
+    if (sample > 0 && sample < stats->positions) {
+        stride = stats->positions / sample;
+        start = (size_t)__clock_ns() % stride; // a different sample each call
+    }
+    NeuStatsSample collected;
+    memset(&collected, 0, sizeof(collected));
+    for (size_t position = start; position < stats->positions; position += stride) {
+        __stats_sample_position(hashtable, position, &collected);
+        stats->sampled++;
+    }
+
+    double scale = stats->sampled == 0 ? 0.0 : (double)stats->positions / stats->sampled;
+    for (int i = 0; i < STATS_HISTOGRAM_BUCKETS; i++) {
+        stats->histogram[i] = (size_t)(collected.histogram[i] * scale + 0.5);
+    }
+    stats->mean_hit_probes = collected.hits == 0 ? 0.0 : (double)collected.hit_probes / collected.hits;
+    stats->max_hit_probes = collected.max_hit_probes;
+    stats->mean_miss_probes = collected.misses == 0 ? 0.0 : (double)collected.miss_probes / collected.misses;
+    stats->max_miss_probes = collected.max_miss_probes;
+    stats->bytes = __stats_bytes(hashtable, &collected);
+    stats->bytes_per_entry = hashtable->size == 0 ? 0.0 : (double)stats->bytes / hashtable->size;
+}
+
+/**
+ * Writes the statistics as one line of JSON, for dashboards and scripts.
+ * @param stats Statistics from hashtable_stats.
+ * @param out The stream to write to, for example stdout.
+ */
+void hashtable_stats_json(const NeuHashtableStats* stats, FILE* out) {
+    fprintf(out, "{\"mode\":\"%s\",\"size\":%zu,\"capacity\":%zu,\"load_factor\":%.4f,",
+            __stats_mode_names[stats->mode], stats->size, stats->capacity, stats->load_factor);
+    fprintf(out, "\"histogram\":[");
+    for (int i = 0; i < STATS_HISTOGRAM_BUCKETS; i++) {
+        fprintf(out, i == 0 ? "%zu" : ",%zu", stats->histogram[i]);
+    }
+    fprintf(out, "],\"mean_hit_probes\":%.4f,\"max_hit_probes\":%zu,\"mean_miss_probes\":%.4f,\"max_miss_probes\":%zu,",
+            stats->mean_hit_probes, stats->max_hit_probes, stats->mean_miss_probes, stats->max_miss_probes);
+    fprintf(out, "\"resizes\":%zu,\"resize_seconds\":%.6f,\"bytes\":%zu,\"bytes_per_entry\":%.2f,",
+            stats->resizes, stats->resize_seconds, stats->bytes, stats->bytes_per_entry);
+    fprintf(out, "\"positions\":%zu,\"sampled\":%zu}\n", stats->positions, stats->sampled);
+}
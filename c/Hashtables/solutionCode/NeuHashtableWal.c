@@ -0,0 +1,459 @@
+/**
+ * Write-ahead log for NeuHashtable.
+ *
+ * A durable table lives in two files: a snapshot written by save_hashtable
+ * (path) and an append-only log of the changes made since (path.wal).
+ * Opening maps the snapshot and replays the log on top of it.
+ *
+ * Every change appends one compact binary record to an in-memory buffer.
+ * With a commit interval of 0 the buffer is written and fdatasync'ed before
+ * the change returns. Otherwise a background thread writes whatever has
+ * accumulated once per interval and syncs it with a single fdatasync, so a
+ * thousand changes cost one disk flush (group commit). A crash loses at
+ * most the last interval of changes.
+ *
+ * Records are idempotent: a put carries the whole item and a quantity
+ * change carries the new quantity, not the delta. So replaying records that
+ * are already in the snapshot, which happens if a checkpoint is cut short
+ * between writing the snapshot and truncating the log, does no harm.
+ *
+ * Record layout, little endian, no padding:
+ *   u32 checksum   wyhash of everything after it, truncated
+ *   u8  type       WAL_PUT, WAL_REMOVE or WAL_QUANTITY
+ *   u32 id_length
+ *   WAL_PUT:      u32 name_length, f64 price, i32 quantity, id, name
+ *   WAL_REMOVE:   id
+ *   WAL_QUANTITY: i32 quantity, id
+ * Replay stops at the first record that is cut short or fails its checksum,
+ * and the log is truncated there, as that is where a crash interrupted a write.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "NeuHashtableInternal.h"
+
+#define WAL_PUT 1
+#define WAL_REMOVE 2
+#define WAL_QUANTITY 3
+
+#define WAL_HEADER_SIZE (sizeof(uint32_t) + 1 + sizeof(uint32_t))
+#define WAL_BUFFER_INITIAL 4096
+
+struct NeuWal {
+    int fd;
+    char* snapshot_path;
+    unsigned commit_interval_ms; // 0 syncs every change
+    pthread_mutex_t lock;        // guards buffer
+    pthread_mutex_t io_lock;     // held while writing to or truncating the file
+    pthread_cond_t wake;
+    pthread_t flusher;
+    bool stopping;
+    bool failed;                 // a write or sync failed, see errno_value
+    int errno_value;
+    char* buffer;                // records not yet written
+    size_t length;
+    size_t capacity;
+    char* spare;                 // the flusher writes from this one
+    size_t spare_capacity;
+};
+
+static char* __wal_reserve(NeuWal* wal, size_t bytes) {
+    if (wal->length + bytes > wal->capacity) {
+        size_t capacity = wal->capacity == 0 ? WAL_BUFFER_INITIAL : wal->capacity;
+        while (capacity < wal->length + bytes) {
+            capacity *= 2;
+        }
+        wal->buffer = (char*)realloc(wal->buffer, capacity);
+        if (wal->buffer == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        wal->capacity = capacity;
+    }
+    char* record = wal->buffer + wal->length;
+    wal->length += bytes;
+    return record;
+}
+
+static uint32_t __wal_checksum(const char* data, size_t length) {
+    return (uint32_t)hash_wyhash(data, length, 0);
+}
+
+/**
+ * Writes all of data to the log file and waits for it to reach the disk.
+ * Called with io_lock held.
+ */
+static bool __wal_write(NeuWal* wal, const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(wal->fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        length -= (size_t)written;
+    }
+    return fdatasync(wal->fd) == 0;
+}
+
+/**
+ * Takes everything buffered so far and commits it with one write and one sync.
+ * @return false if the write or the sync failed.
+ */
+static bool __wal_commit(NeuWal* wal) {
+    pthread_mutex_lock(&wal->io_lock);
+    pthread_mutex_lock(&wal->lock);
+    char* pending = wal->buffer;
+    size_t pending_capacity = wal->capacity;
+    size_t length = wal->length;
+    wal->buffer = wal->spare;
+    wal->capacity = wal->spare_capacity;
+    wal->length = 0;
+    wal->spare = pending;
+    wal->spare_capacity = pending_capacity;
+    pthread_mutex_unlock(&wal->lock);
+
+    // new records go into the other buffer while this one is on its way to disk
+    bool ok = length == 0 || __wal_write(wal, pending, length);
+    if (!ok) {
+        wal->failed = true;
+        wal->errno_value = errno;
+    }
+    pthread_mutex_unlock(&wal->io_lock);
+    return ok;
+}
+
+static void* __wal_flusher(void* arg) {
+    NeuWal* wal = (NeuWal*)arg;
+    pthread_mutex_lock(&wal->lock);
+    while (!wal->stopping) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        uint64_t nanos = (uint64_t)deadline.tv_nsec + (uint64_t)wal->commit_interval_ms * 1000000ull;
+        deadline.tv_sec += (time_t)(nanos / 1000000000ull);
+        deadline.tv_nsec = (long)(nanos % 1000000000ull);
+        pthread_cond_timedwait(&wal->wake, &wal->lock, &deadline);
+        if (wal->length > 0) {
+            pthread_mutex_unlock(&wal->lock);
+            __wal_commit(wal);
+            pthread_mutex_lock(&wal->lock);
+        }
+    }
+    pthread_mutex_unlock(&wal->lock);
+    return NULL;
+}
+
+/**
+ * Appends one record: the header, then fixed fields, then the strings.
+ */
+static void __wal_append(NeuHashtable* hashtable, uint8_t type, const char* itemID, uint32_t id_length,
+                         const void* fields, size_t fields_length, const char* itemName, uint32_t name_length) {
+    NeuWal* wal = hashtable->wal;
+    size_t body_length = 1 + sizeof(uint32_t) + fields_length + id_length + name_length;
+
+    pthread_mutex_lock(&wal->lock);
+    char* record = __wal_reserve(wal, sizeof(uint32_t) + body_length);
+    char* body = record + sizeof(uint32_t);
+    char* p = body;
+    *p++ = (char)type;
+    memcpy(p, &id_length, sizeof(uint32_t));
+    p += sizeof(uint32_t);
+    if (fields_length > 0) {
+        memcpy(p, fields, fields_length);
+        p += fields_length;
+    }
+    memcpy(p, itemID, id_length);
+    if (name_length > 0) {
+        memcpy(p + id_length, itemName, name_length);
+    }
+    uint32_t checksum = __wal_checksum(body, body_length);
+    memcpy(record, &checksum, sizeof(uint32_t));
+    pthread_mutex_unlock(&wal->lock);
+
+    if (wal->commit_interval_ms == 0) {
+        __wal_commit(wal);
+    }
+}
+
+/**
+ * Logs that the item with this ID now holds these fields, whether it was
+ * added or updated.
+ */
+void __wal_log_put(NeuHashtable* hashtable, const char* itemID, size_t id_length, const char* itemName, double itemPrice, int itemQuantity) {
+    char fields[sizeof(uint32_t) + sizeof(double) + sizeof(int32_t)];
+    uint32_t name_length = (uint32_t)strlen(itemName);
+    int32_t quantity = itemQuantity;
+    memcpy(fields, &name_length, sizeof(uint32_t));
+    memcpy(fields + sizeof(uint32_t), &itemPrice, sizeof(double));
+    memcpy(fields + sizeof(uint32_t) + sizeof(double), &quantity, sizeof(int32_t));
+    __wal_append(hashtable, WAL_PUT, itemID, (uint32_t)id_length, fields, sizeof(fields), itemName, name_length);
+}
+
+/**
+ * Logs the new quantity of the item with this ID.
+ */
+void __wal_log_quantity(NeuHashtable* hashtable, const char* itemID, size_t id_length, int itemQuantity) {
+    int32_t quantity = itemQuantity;
+    __wal_append(hashtable, WAL_QUANTITY, itemID, (uint32_t)id_length, &quantity, sizeof(int32_t), NULL, 0);
+}
+
+/**
+ * Logs that the item with this ID was removed.
+ */
+void __wal_log_remove(NeuHashtable* hashtable, const char* itemID, size_t length) {
+    __wal_append(hashtable, WAL_REMOVE, itemID, (uint32_t)length, NULL, 0, NULL, 0);
+}
+
+/**
+ * Applies every intact record of the log to the table.
+ * @return The length of the intact prefix of the log.
+ */
+static size_t __wal_replay(NeuHashtable* hashtable, const char* log, size_t size) {
+    size_t offset = 0;
+    char* key = NULL;
+    size_t key_capacity = 0;
+    while (size - offset >= WAL_HEADER_SIZE) {
+        const char* record = log + offset;
+        uint32_t checksum;
+        uint32_t id_length;
+        uint8_t type = (uint8_t)record[sizeof(uint32_t)];
+        memcpy(&checksum, record, sizeof(uint32_t));
+        memcpy(&id_length, record + sizeof(uint32_t) + 1, sizeof(uint32_t));
+        size_t fields_length = type == WAL_PUT ? sizeof(uint32_t) + sizeof(double) + sizeof(int32_t)
+                             : type == WAL_QUANTITY ? sizeof(int32_t) : 0;
+        if (type < WAL_PUT || type > WAL_QUANTITY || size - offset - WAL_HEADER_SIZE < fields_length) {
+            break;
+        }
+        const char* fields = record + WAL_HEADER_SIZE;
+        uint32_t name_length = 0;
+        if (type == WAL_PUT) {
+            memcpy(&name_length, fields, sizeof(uint32_t));
+        }
+        size_t record_length = WAL_HEADER_SIZE + fields_length + (size_t)id_length + name_length;
+        if (record_length > size - offset ||
+            __wal_checksum(record + sizeof(uint32_t), record_length - sizeof(uint32_t)) != checksum) {
+            break;
+        }
+
+        // keys in the log are not '\0' terminated, the public functions need them to be
+        size_t strings_length = (size_t)id_length + name_length + 2;
+        if (strings_length > key_capacity) {
+            key_capacity = strings_length * 2;
+            key = (char*)realloc(key, key_capacity);
+            if (key == NULL) {
+                fprintf(stderr, "Memory allocation failed\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        const char* strings = fields + fields_length;
+        memcpy(key, strings, id_length);
+        key[id_length] = '\0';
+        char* name = key + id_length + 1;
+        memcpy(name, strings + id_length, name_length);
+        name[name_length] = '\0';
+
+        if (type == WAL_PUT) {
+            double price;
+            int32_t quantity;
+            memcpy(&price, fields + sizeof(uint32_t), sizeof(double));
+            memcpy(&quantity, fields + sizeof(uint32_t) + sizeof(double), sizeof(int32_t));
+            upsert_item(hashtable, key, name, price, quantity);
+        } else if (type == WAL_REMOVE) {
+            remove_item(hashtable, key);
+        } else {
+            int32_t quantity;
+            memcpy(&quantity, fields, sizeof(int32_t));
+            Item* item = get_item(hashtable, key);
+            if (item != NULL && item->itemQuantity != quantity) {
+                adjust_quantity(hashtable, key, quantity - item->itemQuantity);
+            }
+        }
+        offset += record_length;
+    }
+    free(key);
+    return offset;
+}
+
+/**
+ * Reads the whole log and replays it, then cuts off a torn tail.
+ * @return false if the log exists but could not be read.
+ */
+static bool __wal_recover(NeuHashtable* hashtable, int fd) {
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        return false;
+    }
+    size_t size = (size_t)st.st_size;
+    if (size == 0) {
+        return true;
+    }
+    char* log = (char*)malloc(size);
+    if (log == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    size_t read_total = 0;
+    while (read_total < size) {
+        ssize_t got = pread(fd, log + read_total, size - read_total, (off_t)read_total);
+        if (got <= 0) {
+            if (got < 0 && errno == EINTR) {
+                continue;
+            }
+            free(log);
+            return false;
+        }
+        read_total += (size_t)got;
+    }
+    size_t intact = __wal_replay(hashtable, log, size);
+    free(log);
+    if (intact < size && (ftruncate(fd, (off_t)intact) != 0 || fsync(fd) != 0)) {
+        return false;
+    }
+    return true;
+}
+
+static char* __wal_log_path(const char* path) {
+    size_t length = strlen(path);
+    char* log_path = (char*)malloc(length + 5);
+    if (log_path == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(log_path, path, length);
+    memcpy(log_path + length, ".wal", 5);
+    return log_path;
+}
+
+/**
+ * Opens a durable hashtable: maps the snapshot at path, if there is one,
+ * replays the log at path.wal on top of it and keeps logging every add,
+ * upsert, quantity change and remove from then on. Items changed through a
+ * pointer returned by get_item are not logged.
+ *
+ * @param path The snapshot file. The log is path.wal.
+ * @param mode The engine to use if there is no snapshot yet. A snapshot
+ *             brings back the engine it was saved from.
+ * @param commit_interval_ms How often buffered changes are written and
+ *             synced, in milliseconds. 0 syncs each change before it returns.
+ * @return The table, or NULL with errno set. HASHTABLE_MODE_CACHE gives EINVAL.
+ */
+NeuHashtable* open_hashtable_durable(const char* path, HashtableMode mode, unsigned commit_interval_ms) {
+    if (mode == HASHTABLE_MODE_CACHE) {
+        errno = EINVAL; // evictions would have to be logged too, and a cache is refilled anyway
+        return NULL;
+    }
+    NeuHashtable* hashtable = open_hashtable_mmap(path);
+    if (hashtable == NULL && errno != ENOENT) {
+        return NULL;
+    }
+    if (hashtable == NULL) {
+        hashtable = create_hashtable_mode(INITIAL_CAPACITY, mode);
+    }
+
+    char* log_path = __wal_log_path(path);
+    int fd = open(log_path, O_RDWR | O_CREAT | O_APPEND, 0644);
+    free(log_path);
+    if (fd < 0 || !__wal_recover(hashtable, fd)) {
+        int saved_errno = errno;
+        if (fd >= 0) {
+            close(fd);
+        }
+        free_hashtable(hashtable);
+        errno = saved_errno;
+        return NULL;
+    }
+
+    NeuWal* wal = (NeuWal*)calloc(1, sizeof(NeuWal));
+    if (wal == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    wal->fd = fd;
+    wal->snapshot_path = strdup(path);
+    wal->commit_interval_ms = commit_interval_ms;
+    pthread_mutex_init(&wal->lock, NULL);
+    pthread_mutex_init(&wal->io_lock, NULL);
+    pthread_cond_init(&wal->wake, NULL);
+    if (commit_interval_ms > 0 && pthread_create(&wal->flusher, NULL, __wal_flusher, wal) != 0) {
+        fprintf(stderr, "Failed to start thread\n");
+        exit(EXIT_FAILURE);
+    }
+    hashtable->wal = wal;
+    return hashtable;
+}
+
+/**
+ * Writes and syncs every change logged so far, without waiting for the
+ * next group commit.
+ * @param hashtable A pointer to a table from open_hashtable_durable.
+ * @return true if everything logged so far is on disk. On failure errno is set.
+ */
+bool sync_hashtable(NeuHashtable* hashtable) {
+    if (hashtable->wal == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+    if (!__wal_commit(hashtable->wal) || hashtable->wal->failed) {
+        errno = hashtable->wal->errno_value;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Saves the table to its snapshot and empties the log, so the next open
+ * replays only the changes made after this call.
+ * @param hashtable A pointer to a table from open_hashtable_durable.
+ * @return true on success. On failure errno is set and the log is kept.
+ */
+bool checkpoint_hashtable(NeuHashtable* hashtable) {
+    NeuWal* wal = hashtable->wal;
+    if (wal == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+    if (!sync_hashtable(hashtable)) {
+        return false;
+    }
+    // the flusher must not append between the snapshot and the truncate.
+    // save_hashtable only succeeds once the renamed snapshot's directory is
+    // flushed, so the log is never emptied while the old snapshot could
+    // still come back after a crash
+    pthread_mutex_lock(&wal->io_lock);
+    bool ok = save_hashtable(hashtable, wal->snapshot_path) && ftruncate(wal->fd, 0) == 0 && fsync(wal->fd) == 0;
+    pthread_mutex_unlock(&wal->io_lock);
+    return ok;
+}
+
+/**
+ * Commits what is left in the buffer, stops the flusher and closes the log.
+ */
+void __wal_close(NeuHashtable* hashtable) {
+    NeuWal* wal = hashtable->wal;
+    if (wal->commit_interval_ms > 0) {
+        pthread_mutex_lock(&wal->lock);
+        wal->stopping = true;
+        pthread_cond_signal(&wal->wake);
+        pthread_mutex_unlock(&wal->lock);
+        pthread_join(wal->flusher, NULL);
+    }
+    __wal_commit(wal);
+    close(wal->fd);
+    pthread_mutex_destroy(&wal->lock);
+    pthread_mutex_destroy(&wal->io_lock);
+    pthread_cond_destroy(&wal->wake);
+    free(wal->buffer);
+    free(wal->spare);
+    free(wal->snapshot_path);
+    free(wal);
+    hashtable->wal = NULL;
+}
@@ -0,0 +1,315 @@
+/**
+ * Hashtable split into independent shards, with a parallel bulk load.
+ *
+ * sharded_bulk_load runs in two passes, each on its own set of threads:
+ *
+ *  1. Partition. Every thread takes an equal slice of the input, hashes
+ *     each key once, and sorts its slice by shard with a counting sort.
+ *  2. Insert. Every thread owns the shards s with s % threads == its index.
+ *     It grows each of its shards once to fit everything headed there, then
+ *     inserts that shard's items from every slice, in input order, reusing
+ *     the hashes from the first pass.
+ *
+ * No shard is written by two threads, so neither pass takes a lock, and the
+ * only shared writes are to disjoint parts of the scratch arrays.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "NeuShardedHashtable.h"
+#include "NeuHashtableInternal.h"
+
+/**
+ * Picks a shard from the high bits of hash * 2^64/phi, so a hash with weak
+ * high bits (like hash_djb2 on short keys) still spreads over every shard.
+ */
+static inline size_t __shard_index(const NeuShardedHashtable* hashtable, size_t hash) {
+    if (hashtable->shard_bits == 0) {
+        return 0;
+    }
+    return (size_t)(((uint64_t)hash * 0x9E3779B97F4A7C15ULL) >> (64 - hashtable->shard_bits));
+}
+
+/**
+ * Creates a sharded hashtable.
+ * @param capacity The initial capacity of the whole table, split evenly over the shards.
+ * @param num_shards The number of shards, rounded up to a power of two, at most SHARDED_MAX_SHARDS.
+ *                   A few per core is a good choice.
+ * @param mode The engine every shard uses.
+ * @return A pointer to the newly created table.
+ */
+NeuShardedHashtable* create_sharded_hashtable(int capacity, size_t num_shards, HashtableMode mode) {
+    NeuShardedHashtable* hashtable = (NeuShardedHashtable*)calloc(1, sizeof(NeuShardedHashtable));
+    if (hashtable == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    if (num_shards > SHARDED_MAX_SHARDS) {
+        num_shards = SHARDED_MAX_SHARDS;
+    }
+    hashtable->num_shards = 1;
+    while (hashtable->num_shards < num_shards) {
+        hashtable->num_shards <<= 1;
+        hashtable->shard_bits++;
+    }
+    hashtable->shards = (NeuHashtable**)malloc(hashtable->num_shards * sizeof(NeuHashtable*));
+    if (hashtable->shards == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    hashtable->hash_function = hash_wyhash;
+    hashtable->seed = hash_random_seed();
+    int shard_capacity = capacity / (int)hashtable->num_shards;
+    for (size_t s = 0; s < hashtable->num_shards; s++) {
+        hashtable->shards[s] = create_hashtable_mode(shard_capacity > 0 ? shard_capacity : 1, mode);
+        set_hash_function(hashtable->shards[s], hashtable->hash_function, hashtable->seed);
+    }
+    return hashtable;
+}
+
+/**
+ * Frees every shard and the table.
+ * @param hashtable A pointer to the table to free.
+ */
+void free_sharded_hashtable(NeuShardedHashtable* hashtable) {
+    if (hashtable == NULL) {
+        return;
+    }
+    for (size_t s = 0; s < hashtable->num_shards; s++) {
+        free_hashtable(hashtable->shards[s]);
+    }
+    free(hashtable->shards);
+    free(hashtable);
+}
+
+/**
+ * Adds an item to the shard that owns its ID.
+ * @param hashtable A pointer to the table.
+ * @param itemID The ID of the item.
+ * @param itemName The name of the item.
+ * @param itemPrice The price of the item.
+ * @param itemQuantity The quantity of the item.
+ */
+void sharded_add_item(NeuShardedHashtable* hashtable, const char* itemID, const char* itemName, double itemPrice, int itemQuantity) {
+    size_t length = strlen(itemID);
+    size_t hash = hashtable->hash_function(itemID, length, hashtable->seed);
+    bool inserted;
+    __find_or_add_hashed(hashtable->shards[__shard_index(hashtable, hash)], hash, itemID, length, itemName, itemPrice, itemQuantity, &inserted);
+    if (!inserted) {
+        fprintf(stderr, "Item with ID %s already exists\n", itemID);
+    }
+}
+
+/**
+ * Gets an item by ID.
+ * @param hashtable A pointer to the table.
+ * @param itemID The ID of the item to retrieve.
+ * @return A pointer to the item, or NULL if not found. The same lifetime
+ *         rules as get_item apply for the engine the shards use.
+ */
+Item* sharded_get_item(NeuShardedHashtable* hashtable, const char* itemID) {
+    size_t length = strlen(itemID);
+    size_t hash = hashtable->hash_function(itemID, length, hashtable->seed);
+    return __get_item_hashed(hashtable->shards[__shard_index(hashtable, hash)], itemID, length, hash);
+}
+
+/**
+ * Removes an item by ID.
+ * @param hashtable A pointer to the table.
+ * @param itemID The ID of the item to remove.
+ */
+void sharded_remove_item(NeuShardedHashtable* hashtable, const char* itemID) {
+    size_t hash = hashtable->hash_function(itemID, strlen(itemID), hashtable->seed);
+    remove_item(hashtable->shards[__shard_index(hashtable, hash)], itemID);
+}
+
+/**
+ * Gets the number of items in every shard together.
+ */
+size_t sharded_get_size(NeuShardedHashtable* hashtable) {
+    size_t size = 0;
+    for (size_t s = 0; s < hashtable->num_shards; s++) {
+        size += hashtable->shards[s]->size;
+    }
+    return size;
+}
+
+/**
+ * State shared by the threads of one sharded_bulk_load.
+ */
+typedef struct {
+    NeuShardedHashtable* hashtable;
+    const Item* items;
+    size_t count;
+    int threads;
+    size_t* hashes;   // hash of every item, by input index
+    size_t* order;    // input indexes, each thread's slice sorted by shard
+    size_t* offsets;  // threads rows of num_shards + 1 positions into order
+} NeuBulkLoad;
+
+typedef struct {
+    NeuBulkLoad* load;
+    int index;
+    size_t added;
+} NeuBulkWorker;
+
+static size_t __slice_start(const NeuBulkLoad* load, int thread) {
+    return load->count * (size_t)thread / (size_t)load->threads;
+}
+
+/**
+ * First pass: hashes one slice of the input and counting sorts it by shard.
+ */
+static void* __bulk_partition(void* arg) {
+    NeuBulkWorker* worker = (NeuBulkWorker*)arg;
+    NeuBulkLoad* load = worker->load;
+    NeuShardedHashtable* hashtable = load->hashtable;
+    size_t start = __slice_start(load, worker->index);
+    size_t end = __slice_start(load, worker->index + 1);
+    size_t* offsets = load->offsets + (size_t)worker->index * (hashtable->num_shards + 1);
+
+    memset(offsets, 0, (hashtable->num_shards + 1) * sizeof(size_t));
+    for (size_t i = start; i < end; i++) {
+        const char* itemID = load->items[i].itemID;
+        load->hashes[i] = hashtable->hash_function(itemID, strlen(itemID), hashtable->seed);
+        offsets[__shard_index(hashtable, load->hashes[i]) + 1]++;
+    }
+    offsets[0] = start;
+    for (size_t s = 0; s < hashtable->num_shards; s++) {
+        offsets[s + 1] += offsets[s];
+    }
+    // offsets[s] is moved forward while placing, so it ends at the old
+    // offsets[s + 1]; shifting the row back afterwards restores the starts
+    for (size_t i = start; i < end; i++) {
+        load->order[offsets[__shard_index(hashtable, load->hashes[i])]++] = i;
+    }
+    memmove(offsets + 1, offsets, hashtable->num_shards * sizeof(size_t));
+    offsets[0] = start;
+    return NULL;
+}
+
+/**
+ * Second pass: fills the shards this thread owns from every slice.
+ */
+static void* __bulk_insert(void* arg) {
+    NeuBulkWorker* worker = (NeuBulkWorker*)arg;
+    NeuBulkLoad* load = worker->load;
+    NeuShardedHashtable* hashtable = load->hashtable;
+    size_t row = hashtable->num_shards + 1;
+
+    for (size_t s = (size_t)worker->index; s < hashtable->num_shards; s += (size_t)load->threads) {
+        NeuHashtable* shard = hashtable->shards[s];
+        size_t incoming = 0;
+        for (int t = 0; t < load->threads; t++) {
+            incoming += load->offsets[t * row + s + 1] - load->offsets[t * row + s];
+        }
+        __reserve_capacity(shard, shard->size + incoming);
+
+        for (int t = 0; t < load->threads; t++) {
+            for (size_t k = load->offsets[t * row + s]; k < load->offsets[t * row + s + 1]; k++) {
+                const Item* item = &load->items[load->order[k]];
+                bool inserted;
+                __find_or_add_hashed(shard, load->hashes[load->order[k]], item->itemID, strlen(item->itemID),
+                                     item->itemName, item->itemPrice, item->itemQuantity, &inserted);
+                if (inserted) {
+                    worker->added++;
+                } else {
+                    fprintf(stderr, "Item with ID %s already exists\n", item->itemID);
+                }
+            }
+        }
+    }
+    return NULL;
+}
+
+static void __run_workers(NeuBulkWorker* workers, int threads, void* (*pass)(void*)) {
+    pthread_t ids[SHARDED_MAX_THREADS];
+    for (int t = 1; t < threads; t++) {
+        if (pthread_create(&ids[t], NULL, pass, &workers[t]) != 0) {
+            fprintf(stderr, "Failed to start thread\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    pass(&workers[0]); // the calling thread does the first share
+    for (int t = 1; t < threads; t++) {
+        pthread_join(ids[t], NULL);
+    }
+}
+
+/**
+ * Adds many items using several threads. Each thread hashes and partitions
+ * a slice of the input, then fills its own shards, so no locks are taken.
+ * Each shard grows at most once. Items whose ID is already in the table, or
+ * earlier in the input, are skipped.
+ *
+ * @param hashtable A pointer to the table. No other thread may use it during the load.
+ * @param items The items to add. Their strings are copied into the table.
+ * @param count The number of items.
+ * @param threads The number of threads to use, including the caller, at most SHARDED_MAX_THREADS.
+ * @return The number of items that were added.
+ */
+size_t sharded_bulk_load(NeuShardedHashtable* hashtable, const Item* items, size_t count, int threads) {
+    if (threads < 1) {
+        threads = 1;
+    }
+    if (threads > SHARDED_MAX_THREADS) {
+        threads = SHARDED_MAX_THREADS;
+    }
+    NeuBulkLoad load;
+    load.hashtable = hashtable;
+    load.items = items;
+    load.count = count;
+    load.threads = threads;
+    load.hashes = (size_t*)malloc(count * sizeof(size_t));
+    load.order = (size_t*)malloc(count * sizeof(size_t));
+    load.offsets = (size_t*)malloc((size_t)threads * (hashtable->num_shards + 1) * sizeof(size_t));
+    NeuBulkWorker* workers = (NeuBulkWorker*)calloc((size_t)threads, sizeof(NeuBulkWorker));
+    if ((count > 0 && (load.hashes == NULL || load.order == NULL)) || load.offsets == NULL || workers == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int t = 0; t < threads; t++) {
+        workers[t].load = &load;
+        workers[t].index = t;
+    }
+
+    __run_workers(workers, threads, __bulk_partition);
+    __run_workers(workers, threads, __bulk_insert);
+
+    size_t added = 0;
+    for (int t = 0; t < threads; t++) {
+        added += workers[t].added;
+    }
+    free(workers);
+    free(load.offsets);
+    free(load.order);
+    free(load.hashes);
+    return added;
+}
+
+typedef struct {
+    NeuShardedVisitor visit;
+    void* context;
+} NeuShardedVisit;
+
+static void __sharded_visit(const Item* item, size_t hash, void* context) {
+    NeuShardedVisit* visit = (NeuShardedVisit*)context;
+    visit->visit(item, visit->context);
+}
+
+/**
+ * Calls visit once for every item of every shard, one shard after another.
+ * The table must not be changed until it returns.
+ * @param hashtable A pointer to the table.
+ * @param visit Called with each item and context.
+ * @param context Passed through to visit.
+ */
+void sharded_for_each(NeuShardedHashtable* hashtable, NeuShardedVisitor visit, void* context) {
+    NeuShardedVisit wrapper = {visit, context};
+    for (size_t s = 0; s < hashtable->num_shards; s++) {
+        __for_each_item(hashtable->shards[s], __sharded_visit, &wrapper);
+    }
+}
@@ -0,0 +1,45 @@
+#ifndef NEU_SHARDED_HASHTABLE_H
+#define NEU_SHARDED_HASHTABLE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "NeuHashtable.h"
+
+#define SHARDED_MAX_SHARDS 1024
+#define SHARDED_MAX_THREADS 64
+
+/**
+ * A hashtable split into independent NeuHashtable shards. A key's shard is
+ * picked by the high bits of its hash, and every shard uses the same hash
+ * function and seed, so a key is hashed once for both the shard and the
+ * bucket inside it.
+ *
+ * The table itself is not thread safe. Its point is sharded_bulk_load,
+ * which fills the shards from several threads at once: each shard is only
+ * ever written by one thread, so no locks are needed.
+ */
+typedef struct {
+    NeuHashtable** shards;
+    size_t num_shards; // a power of two
+    int shard_bits;    // log2(num_shards)
+    NeuHashFunction hash_function;
+    uint64_t seed;
+} NeuShardedHashtable;
+
+/**
+ * Called once for every item by sharded_for_each.
+ */
+typedef void (*NeuShardedVisitor)(const Item* item, void* context);
+
+NeuShardedHashtable* create_sharded_hashtable(int capacity, size_t num_shards, HashtableMode mode);
+void free_sharded_hashtable(NeuShardedHashtable* hashtable);
+void sharded_add_item(NeuShardedHashtable* hashtable, const char* itemID, const char* itemName, double itemPrice, int itemQuantity);
+Item* sharded_get_item(NeuShardedHashtable* hashtable, const char* itemID);
+void sharded_remove_item(NeuShardedHashtable* hashtable, const char* itemID);
+size_t sharded_bulk_load(NeuShardedHashtable* hashtable, const Item* items, size_t count, int threads);
+size_t sharded_get_size(NeuShardedHashtable* hashtable);
+void sharded_for_each(NeuShardedHashtable* hashtable, NeuShardedVisitor visit, void* context);
+
+#endif /* NEU_SHARDED_HASHTABLE_H */
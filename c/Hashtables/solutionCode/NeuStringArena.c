@@ -0,0 +1,133 @@
+/**
+ * Length prefixed string arena used to store item IDs and names
+ * outside of the hashtable nodes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "NeuStringArena.h"
+
+#define ARENA_ALIGN sizeof(uint32_t) // keeps every length prefix aligned
+
+/**
+ * Initializes an empty arena. No memory is allocated until the first string.
+ * @param arena A pointer to the arena to initialize.
+ */
+void arena_init(NeuStringArena* arena) {
+    memset(arena, 0, sizeof(NeuStringArena));
+}
+
+/**
+ * Frees every chunk of the arena. Strings handed out become invalid.
+ * @param arena A pointer to the arena.
+ */
+void arena_free(NeuStringArena* arena) {
+    NeuArenaChunk* chunk = arena->chunks;
+    while (chunk != NULL) {
+        NeuArenaChunk* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    free(arena->intern_set);
+    arena_init(arena);
+}
+
+static NeuArenaChunk* __arena_add_chunk(NeuStringArena* arena, size_t min_bytes) {
+    size_t capacity = min_bytes > ARENA_CHUNK_SIZE ? min_bytes : ARENA_CHUNK_SIZE;
+    NeuArenaChunk* chunk = (NeuArenaChunk*)malloc(sizeof(NeuArenaChunk) + capacity);
+    if (chunk == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    chunk->used = 0;
+    chunk->capacity = capacity;
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+    arena->bytes_reserved += capacity;
+    return chunk;
+}
+
+/**
+ * Copies a string into the arena.
+ * @param arena A pointer to the arena.
+ * @param str The string to copy.
+ * @param length The length of str, not counting the '\0'.
+ * @return A pointer to the copy, valid until the arena is freed.
+ */
+const char* arena_store(NeuStringArena* arena, const char* str, size_t length) {
+    size_t needed = sizeof(uint32_t) + length + 1;
+    needed = (needed + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+    NeuArenaChunk* chunk = arena->chunks;
+    if (chunk == NULL || chunk->capacity - chunk->used < needed) {
+        chunk = __arena_add_chunk(arena, needed);
+    }
+    char* record = chunk->data + chunk->used;
+    chunk->used += needed;
+    arena->bytes_used += needed;
+
+    uint32_t prefix = (uint32_t)length;
+    memcpy(record, &prefix, sizeof(uint32_t));
+    memcpy(record + sizeof(uint32_t), str, length);
+    record[sizeof(uint32_t) + length] = '\0';
+    return record + sizeof(uint32_t);
+}
+
+static size_t __arena_string_hash(const char* str, size_t length) {
+    size_t hash = 5381;
+    for (size_t i = 0; i < length; i++) {
+        hash = ((hash << 5) + hash) + (unsigned char)str[i];
+    }
+    return hash;
+}
+
+static void __arena_grow_intern_set(NeuStringArena* arena) {
+    size_t new_capacity = arena->intern_capacity == 0 ? ARENA_INTERN_INITIAL_CAPACITY : arena->intern_capacity * 2;
+    const char** new_set = (const char**)calloc(new_capacity, sizeof(const char*));
+    if (new_set == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < arena->intern_capacity; i++) {
+        const char* str = arena->intern_set[i];
+        if (str == NULL) {
+            continue;
+        }
+        size_t index = __arena_string_hash(str, arena_length(str)) & (new_capacity - 1);
+        while (new_set[index] != NULL) {
+            index = (index + 1) & (new_capacity - 1);
+        }
+        new_set[index] = str;
+    }
+    free(arena->intern_set);
+    arena->intern_set = new_set;
+    arena->intern_capacity = new_capacity;
+}
+
+/**
+ * Returns the arena copy of a string, storing it only if an equal string
+ * was not interned before.
+ * @param arena A pointer to the arena.
+ * @param str The string to intern.
+ * @param length The length of str, not counting the '\0'.
+ * @return A pointer to the shared copy, valid until the arena is freed.
+ */
+const char* arena_intern(NeuStringArena* arena, const char* str, size_t length) {
+    if (arena->intern_count * 2 >= arena->intern_capacity) {
+        __arena_grow_intern_set(arena); // keep the set at most half full
+    }
+    size_t index = __arena_string_hash(str, length) & (arena->intern_capacity - 1);
+    while (arena->intern_set[index] != NULL) {
+        const char* existing = arena->intern_set[index];
+        if (arena_length(existing) == length && memcmp(existing, str, length) == 0) {
+            return existing;
+        }
+        index = (index + 1) & (arena->intern_capacity - 1);
+    }
+    const char* copy = arena_store(arena, str, length);
+    arena->intern_set[index] = copy;
+    arena->intern_count++;
+    return copy;
+}
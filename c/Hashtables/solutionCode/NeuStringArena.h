@@ -0,0 +1,51 @@
+#ifndef NEU_STRING_ARENA_H
+#define NEU_STRING_ARENA_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define ARENA_CHUNK_SIZE (64 * 1024)
+#define ARENA_INTERN_INITIAL_CAPACITY 64
+
+/**
+ * One block of arena memory. Strings are bump allocated from data and are
+ * never moved, so pointers into a chunk stay valid until the arena is freed.
+ */
+typedef struct NeuArenaChunk {
+    struct NeuArenaChunk* next;
+    size_t used;
+    size_t capacity;
+    char data[];
+} NeuArenaChunk;
+
+/**
+ * A bump allocator for strings. Every string is stored as a 4 byte length
+ * followed by the bytes and a '\0', so the returned pointer works as a
+ * normal C string and its length is known without strlen.
+ *
+ * Strings added with arena_intern are deduplicated through a small open
+ * addressing set, so repeated values (like item names) are stored once.
+ */
+typedef struct {
+    NeuArenaChunk* chunks;  // newest chunk first, the one being filled
+    size_t bytes_used;      // bytes handed out, including length prefixes
+    size_t bytes_reserved;  // bytes allocated for chunks
+    const char** intern_set;
+    size_t intern_capacity;
+    size_t intern_count;
+} NeuStringArena;
+
+void arena_init(NeuStringArena* arena);
+void arena_free(NeuStringArena* arena);
+const char* arena_store(NeuStringArena* arena, const char* str, size_t length);
+const char* arena_intern(NeuStringArena* arena, const char* str, size_t length);
+
+/**
+ * Gets the length of a string returned by the arena in O(1).
+ */
+static inline size_t arena_length(const char* str) {
+    return ((const uint32_t*)str)[-1];
+}
+
+#endif /* NEU_STRING_ARENA_H */
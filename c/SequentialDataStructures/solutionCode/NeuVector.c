@@ -12,6 +12,8 @@
 
 #include "NeuVector.h"
 
+void __neu_vector_resize(NeuVector* vector, size_t new_capacity);
+
 /**
  * Creates a new vector with the specified initial capacity.
  * 
@@ -23,13 +25,14 @@ NeuVector* create_vector(size_t initial_capacity) {
     if (vector == NULL) {
         return NULL; // Memory allocation failed
     }
-    vector->data = (int*)malloc(initial_capacity * sizeof(int));
-    if (vector->data == NULL) {
-        free(vector); // Free the vector structure if data allocation fails
-        return NULL; // Memory allocation failed
+    init_vector(vector);
+    if (initial_capacity > NEU_VECTOR_INLINE_CAPACITY) {
+        __neu_vector_resize(vector, initial_capacity);
+        if (vector->capacity < initial_capacity) {
+            free(vector);
+            return NULL; // Memory allocation failed
+        }
     }
-    vector->size = 0; // Initialize size to 0
-    vector->capacity = initial_capacity; // Set the initial capacity
     return vector; // Return the newly created vector
 }
 
@@ -40,11 +43,38 @@ NeuVector* create_vector(size_t initial_capacity) {
  */
 void free_vector(NeuVector* vector) {
     if (vector != NULL) {
-        free(vector->data); // Free the data array
+        destroy_vector(vector); // Free the data array if it spilled to the heap
         free(vector); // Free the vector structure
     }
 }
 
+/**
+ * Sets up a vector in memory the caller owns, usually a local variable, so
+ * a vector of up to NEU_VECTOR_INLINE_CAPACITY elements needs no malloc at
+ * all. Call destroy_vector when done instead of free_vector. The vector
+ * must not be copied by value or moved while its elements are inline.
+ * 
+ * @param vector A pointer to the vector to set up.
+ */
+void init_vector(NeuVector* vector) {
+    vector->data = vector->inline_data; // Start in the inline buffer
+    vector->size = 0;
+    vector->capacity = NEU_VECTOR_INLINE_CAPACITY;
+}
+
+/**
+ * Frees the elements of a vector set up with init_vector, if they spilled
+ * to the heap. The vector is empty and inline again afterwards.
+ * 
+ * @param vector A pointer to the vector.
+ */
+void destroy_vector(NeuVector* vector) {
+    if (vector->data != vector->inline_data) {
+        free(vector->data); // Free the data array
+    }
+    init_vector(vector);
+}
+
 
 /**
  * Resizes the vector to the specified new capacity.
@@ -54,7 +84,16 @@ void free_vector(NeuVector* vector) {
  */
 void __neu_vector_resize(NeuVector* vector, size_t new_capacity) {
     if (new_capacity > vector->capacity) {
-        int* new_data = (int*)realloc(vector->data, new_capacity * sizeof(int));
+        int* new_data;
+        if (vector->data == vector->inline_data) {
+            // the inline buffer cannot be reallocated, spill it to the heap
+            new_data = (int*)malloc(new_capacity * sizeof(int));
+            if (new_data != NULL) {
+                memcpy(new_data, vector->inline_data, vector->size * sizeof(int));
+            }
+        } else {
+            new_data = (int*)realloc(vector->data, new_capacity * sizeof(int));
+        }
         if (new_data != NULL) {
             vector->data = new_data; // Update the data pointer
             vector->capacity = new_capacity; // Update the capacity
@@ -73,23 +112,11 @@ void __neu_vector_resize(NeuVector* vector, size_t new_capacity) {
  * @return 0 if successful, or -1 if memory allocation fails.
  */
 void append_vector_element(NeuVector* vector, int value) {
-    insert_vector_element(vector, vector->size, value); // Insert at the end
-}
-
-/**
- * Finds the first occurrence of a value in the vector.
- * 
- * @param vector A pointer to the vector.
- * @param value The value to find.
- * @return The index of the first occurrence of the value, or -1 if the value is not found.
- */
-int contains_element(NeuVector* vector, int value) {
-    for (size_t i = 0; i < vector->size; ++i) {
-        if (vector->data[i] == value) {
-            return i; // Return the index of the first occurrence
-        }
+    if (vector->size < vector->capacity) {
+        vector->data[vector->size++] = value; // Room left, nothing to shift
+        return;
     }
-    return -1; // not found
+    insert_vector_element(vector, vector->size, value); // Insert at the end
 }
 
 /**
@@ -110,6 +137,10 @@ int get_vector_capacity(NeuVector* vector) {
  * @return The value of the element at the specified index.
  */
 int get_vector_element(NeuVector* vector, size_t index) {
+#ifdef NEU_VECTOR_ASSERT_BOUNDS
+    NEU_VECTOR_ASSERT_INDEX(index, vector->size);
+    return vector->data[index];
+#else
     if (vector == NULL || vector->size == 0 || vector->data == NULL) {
         fprintf(stderr, "Vector is empty.\n");
         errno = ENODATA;
@@ -122,6 +153,7 @@ int get_vector_element(NeuVector* vector, size_t index) {
     }
     errno = 0; // Clear errno before accessing the vector
     return vector->data[index]; // Return the element at the specified index
+#endif
 }
 
 /**
@@ -134,6 +166,30 @@ int get_vector_size(NeuVector* vector) {
     return vector->size; // Return the size of the vector
 }
 
+/**
+ * Grows the vector so it can hold at least min_capacity elements. The
+ * capacity at least doubles, so appends one at a time stay amortized O(1).
+ * 
+ * @param vector A pointer to the vector.
+ * @param min_capacity The number of elements the vector must fit.
+ * @return 1 if the vector has room, 0 if memory allocation failed.
+ */
+int __neu_vector_grow(NeuVector* vector, size_t min_capacity) {
+    if (min_capacity <= vector->capacity) {
+        return 1;
+    }
+    size_t new_capacity = vector->capacity * SCALE_FACTOR;
+    if (new_capacity < min_capacity) {
+        new_capacity = min_capacity;
+    }
+    __neu_vector_resize(vector, new_capacity);
+    if (vector->capacity < min_capacity) {
+        errno = ENOMEM;
+        return 0;
+    }
+    return 1;
+}
+
 /**
  * Inserts an element at the specified index in the vector.
  * 
@@ -142,18 +198,68 @@ int get_vector_size(NeuVector* vector) {
  * @param value The value to insert.
  */
 void insert_vector_element(NeuVector* vector, size_t index, int value) {
+    insert_vector_range(vector, index, &value, 1);
+}
+
+/**
+ * Inserts count elements at the specified index in the vector, growing it
+ * at most once and shifting the tail with a single memmove.
+ * 
+ * @param vector A pointer to the vector.
+ * @param index The index at which to insert the first element.
+ * @param values The elements to insert. They may point into the vector itself.
+ * @param count The number of elements to insert.
+ */
+void insert_vector_range(NeuVector* vector, size_t index, const int* values, size_t count) {
     if (index > vector->size) {
         fprintf(stderr, "Index out of bounds.\n");
+        errno = ERANGE;
         return; // Index is out of bounds
     }
-    if (vector->size == vector->capacity) {
-        __neu_vector_resize(vector, vector->capacity * SCALE_FACTOR); // Double the capacity if full
+    if (count == 0) {
+        return;
+    }
+    int* copy = NULL;
+    if (values >= vector->data && values < vector->data + vector->size) {
+        // the source moves when the vector grows or the tail shifts, so copy it first
+        copy = (int*)malloc(count * sizeof(int));
+        if (copy == NULL) {
+            fprintf(stderr, "Memory allocation failed.\n");
+            errno = ENOMEM;
+            return;
+        }
+        memcpy(copy, values, count * sizeof(int));
+        values = copy;
     }
-    for (size_t i = vector->size; i > index; --i) {
-        vector->data[i] = vector->data[i - 1]; // Shift elements to the right
+    if (__neu_vector_grow(vector, vector->size + count)) {
+        errno = 0;
+        memmove(vector->data + index + count, vector->data + index, (vector->size - index) * sizeof(int)); // Shift the tail to the right
+        memcpy(vector->data + index, values, count * sizeof(int)); // Copy the new elements into the gap
+        vector->size += count; // Increase the size of the vector
     }
-    vector->data[index] = value; // Insert the new element
-    vector->size++; // Increase the size of the vector
+    free(copy);
+}
+
+/**
+ * Appends count elements from an array to the end of the vector.
+ * 
+ * @param vector A pointer to the vector.
+ * @param values The elements to append.
+ * @param count The number of elements to append.
+ */
+void append_vector_array(NeuVector* vector, const int* values, size_t count) {
+    insert_vector_range(vector, vector->size, values, count);
+}
+
+/**
+ * Makes sure the vector can hold capacity elements without growing again.
+ * Never shrinks the vector.
+ * 
+ * @param vector A pointer to the vector.
+ * @param capacity The number of elements to make room for.
+ */
+void vector_reserve(NeuVector* vector, size_t capacity) {
+    __neu_vector_resize(vector, capacity);
 }
 
 /**
@@ -196,15 +302,30 @@ int remove_vector_element(NeuVector* vector, size_t index) {
         errno = ERANGE;
         return -1; // Index is out of bounds
     }
-    errno = 0; // Clear errno before accessing the vector
     int data = vector->data[index]; // Store the value to be removed
-    for (size_t i = index; i < vector->size - 1; ++i) {
-        vector->data[i] = vector->data[i + 1]; // Shift elements to the left
-    }
-    vector->size--; // Decrease the size of the vector
+    erase_vector_range(vector, index, 1);
     return data;
 }
 
+/**
+ * Removes count elements starting at the specified index, shifting the
+ * elements after them to the left with a single memmove.
+ * 
+ * @param vector A pointer to the vector.
+ * @param index The index of the first element to remove.
+ * @param count The number of elements to remove.
+ */
+void erase_vector_range(NeuVector* vector, size_t index, size_t count) {
+    if (index > vector->size || count > vector->size - index) {
+        fprintf(stderr, "Index out of bounds.\n");
+        errno = ERANGE;
+        return; // Range is out of bounds
+    }
+    errno = 0; // Clear errno before accessing the vector
+    memmove(vector->data + index, vector->data + index + count, (vector->size - index - count) * sizeof(int)); // Shift elements to the left
+    vector->size -= count; // Decrease the size of the vector
+}
+
 /**
  * Sets the element at the specified index in the vector.
  * 
@@ -213,6 +334,10 @@ int remove_vector_element(NeuVector* vector, size_t index) {
  * @param value The value to set at the specified index.
  */
 void set_vector_element(NeuVector* vector, size_t index, int value) {
+#ifdef NEU_VECTOR_ASSERT_BOUNDS
+    NEU_VECTOR_ASSERT_INDEX(index, vector->size);
+    vector->data[index] = value;
+#else
     if (index >= vector->size) {
         fprintf(stderr, "Index out of bounds.\n");
         errno = ERANGE;
@@ -220,6 +345,7 @@ void set_vector_element(NeuVector* vector, size_t index, int value) {
     }
     errno = 0; // Clear errno before accessing the vector
     vector->data[index] = value; // Set the element at the specified index
+#endif
 }
 
 
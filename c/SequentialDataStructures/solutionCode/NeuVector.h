@@ -1,30 +1,369 @@
 #ifndef NEU_VECTOR_H
 #define NEU_VECTOR_H
 
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #define SCALE_FACTOR 2 // Factor by which to increase capacity when needed
+#define NEU_VECTOR_INLINE_CAPACITY 16 // Elements a NeuVector holds in its own struct before using the heap
+#define NEU_VECTOR_MIN_BYTES 64 // Smallest buffer a generated vector grows to, one cache line
+#define NEU_VECTOR_NOT_FOUND ((size_t)-1) // returned by the generated find functions
+#define NEU_VECTOR_EQUALS(a, b) ((a) == (b))
+
+/**
+ * Build with -DNEU_VECTOR_ASSERT_BOUNDS to turn the bounds checks of the get
+ * and set functions into asserts, and to assert in the unchecked accessors
+ * too. Adding -DNDEBUG then removes the checks entirely, so loops over the
+ * accessors compile to plain array loops. Without the flag the get and set
+ * functions report errors and the unchecked accessors check nothing.
+ */
+#ifdef NEU_VECTOR_ASSERT_BOUNDS
+#define NEU_VECTOR_ASSERT_INDEX(index, size) assert((index) < (size))
+#define NEU_VECTOR_CHECK_INDEX(index, size, on_error) NEU_VECTOR_ASSERT_INDEX(index, size)
+#else
+#define NEU_VECTOR_ASSERT_INDEX(index, size) ((void)0)
+#define NEU_VECTOR_CHECK_INDEX(index, size, on_error)    \
+    do {                                                 \
+        if ((index) >= (size)) {                         \
+            fprintf(stderr, "Index out of bounds.\n");   \
+            errno = ERANGE;                              \
+            on_error;                                    \
+        }                                                \
+    } while (0)
+#endif
+
+/**
+ * The instruction set used by the search kernels in NeuVectorSearch.c.
+ */
+typedef enum {
+    VECTOR_SEARCH_SCALAR, // portable C
+    VECTOR_SEARCH_SSE4,   // 4 elements per compare
+    VECTOR_SEARCH_AVX2    // 8 elements per compare
+} VectorSearchLevel;
 
 typedef struct {
-    int *data; // Pointer to the array of integers
+    int *data; // Pointer to the array of integers, inline_data until the vector outgrows it
     size_t size; // Number of elements in the vector
     size_t capacity; // Capacity of the vector (size of allocated memory)
+    int inline_data[NEU_VECTOR_INLINE_CAPACITY]; // Small vectors keep their elements here, saving a malloc
 } NeuVector; // using NewVector, to prevent confusion with system libraries
 
+/**
+ * A view of a run of elements, for loops that work on the array directly.
+ * It points into the vector, so it is only valid until the vector grows,
+ * shrinks or is freed.
+ */
+typedef struct {
+    int *data;
+    size_t size;
+} NeuVectorSpan;
+
 NeuVector* create_vector(size_t initial_capacity);
 void free_vector(NeuVector* vector);
+void init_vector(NeuVector* vector);
+void destroy_vector(NeuVector* vector);
 int get_vector_size(NeuVector* vector);
 int get_vector_capacity(NeuVector* vector);
 int get_vector_element(NeuVector* vector, size_t index);
 void set_vector_element(NeuVector* vector, size_t index, int value);
 void insert_vector_element(NeuVector* vector, size_t index, int value);
 void append_vector_element(NeuVector* vector, int value);
+void insert_vector_range(NeuVector* vector, size_t index, const int* values, size_t count);
+void erase_vector_range(NeuVector* vector, size_t index, size_t count);
+void append_vector_array(NeuVector* vector, const int* values, size_t count);
+void vector_reserve(NeuVector* vector, size_t capacity);
 int pop_vector_element(NeuVector* vector);
 int remove_vector_element(NeuVector* vector, size_t index);
 int contains_element(NeuVector* vector, int value);
+size_t count_vector_element(NeuVector* vector, int value);
+int get_vector_min_max(NeuVector* vector, int* min, int* max);
+size_t contains_elements(NeuVector* vector, const int* values, size_t count, int* found);
+VectorSearchLevel set_vector_search_level(VectorSearchLevel level);
+VectorSearchLevel get_vector_search_level(void);
 void print_vector(NeuVector* vector);
 const char* vector_to_string(NeuVector* vector);
 
+/**
+ * Gets the element at index without checking the index.
+ * The caller makes sure index < vector->size.
+ */
+static inline int vector_at(const NeuVector* vector, size_t index) {
+    NEU_VECTOR_ASSERT_INDEX(index, vector->size);
+    return vector->data[index];
+}
+
+/**
+ * Sets the element at index without checking the index.
+ * The caller makes sure index < vector->size.
+ */
+static inline void vector_put(NeuVector* vector, size_t index, int value) {
+    NEU_VECTOR_ASSERT_INDEX(index, vector->size);
+    vector->data[index] = value;
+}
+
+/**
+ * Gets the vector's elements as an array, valid until the vector grows.
+ */
+static inline int* vector_data(NeuVector* vector) {
+    return vector->data;
+}
+
+/**
+ * Gets a span over every element of the vector.
+ */
+static inline NeuVectorSpan vector_span(NeuVector* vector) {
+    NeuVectorSpan span = {vector->data, vector->size};
+    return span;
+}
+
+/**
+ * Gets a span over count elements starting at index. A range that does not
+ * fit in the vector is cut off at its end.
+ */
+static inline NeuVectorSpan vector_subspan(NeuVector* vector, size_t index, size_t count) {
+    NeuVectorSpan span = {vector->data, 0};
+    if (index <= vector->size) {
+        span.data = vector->data + index;
+        span.size = count < vector->size - index ? count : vector->size - index;
+    }
+    return span;
+}
+
+
+/**
+ * Declares a vector type `name` of T elements, and its functions:
+ *
+ *   name*  name_create(size_t initial_capacity);   NULL if allocation fails
+ *   void   name_free(name* vector);
+ *   size_t name_size(const name* vector);
+ *   size_t name_capacity(const name* vector);
+ *   T*     name_get(name* vector, size_t index);     NULL if out of bounds
+ *   void   name_set(name* vector, size_t index, T value);
+ *   T      name_at(const name* vector, size_t index);  unchecked, like vector_at
+ *   T*     name_data(name* vector);
+ *   void   name_append(name* vector, T value);
+ *   void   name_insert(name* vector, size_t index, T value);
+ *   void   name_insert_range(name* vector, size_t index, T const* values, size_t count);
+ *   void   name_append_array(name* vector, T const* values, size_t count);
+ *   void   name_erase_range(name* vector, size_t index, size_t count);
+ *   T      name_remove(name* vector, size_t index);  a zeroed T if out of bounds
+ *   T      name_pop(name* vector);
+ *   void   name_reserve(name* vector, size_t capacity);
+ *   size_t name_find(const name* vector, T value);   NEU_VECTOR_NOT_FOUND if missing
+ *   size_t name_count(const name* vector, T value);
+ *
+ * Errors are reported like the int NeuVector: a message on stderr and
+ * errno set to ERANGE or ENOMEM. Every function is static inline and works
+ * on T directly, so copies are sized by sizeof(T) at compile time and no
+ * element goes through a void pointer. The first growth allocates at least
+ * NEU_VECTOR_MIN_BYTES, so vectors of small elements skip the 1, 2, 4, ...
+ * reallocations, and later growth doubles the capacity.
+ *
+ * Arrays are taken as `T const*`, so T may itself be a pointer type.
+ *
+ * find and count compare elements with equals(T, T), which must be true
+ * for equal elements. It is called directly, so a macro or inline function
+ * is inlined into the loops. Types that support == can use
+ * NEU_VECTOR_DECLARE below; structs need their own equals.
+ *
+ * Use it once per element type in a header or source file, for example
+ *   NEU_VECTOR_DECLARE_EQ(NeuPointVector, NeuPoint, neu_point_equals)
+ */
+#define NEU_VECTOR_DECLARE_EQ(name, T, equals)                                                                   \
+    typedef struct {                                                                                             \
+        T* data;                                                                                                 \
+        size_t size;                                                                                             \
+        size_t capacity;                                                                                         \
+    } name;                                                                                                      \
+                                                                                                                 \
+    static inline name* name##_create(size_t initial_capacity) {                                                 \
+        name* vector = (name*)malloc(sizeof(name));                                                              \
+        if (vector == NULL) {                                                                                    \
+            return NULL; /* Memory allocation failed */                                                          \
+        }                                                                                                        \
+        vector->data = NULL;                                                                                     \
+        if (initial_capacity > 0) {                                                                              \
+            vector->data = (T*)malloc(initial_capacity * sizeof(T));                                             \
+            if (vector->data == NULL) {                                                                          \
+                free(vector);                                                                                    \
+                return NULL; /* Memory allocation failed */                                                      \
+            }                                                                                                    \
+        }                                                                                                        \
+        vector->size = 0;                                                                                        \
+        vector->capacity = initial_capacity;                                                                     \
+        return vector;                                                                                           \
+    }                                                                                                            \
+                                                                                                                 \
+    static inline void name##_free(name* vector) {                                                               \
+        if (vector != NULL) {                                                                                    \
+            free(vector->data);                                                                                  \
+            free(vector);                                                                                        \
+        }                                                                                                        \
+    }                                                                                                            \
+                                                                                                                 \
+    static inline size_t name##_size(const name* vector) {                                                       \
+        return vector->size;                                                                                     \
+    }                                                                                                            \
+                                                                                                                 \
+    static inline size_t name##_capacity(const name* vector) {                                                   \
+        return vector->capacity;                                                                                 \
+    }                                                                                                            \
+                                                                                                                 \
+    static inline int name##__resize(name* vector, size_t new_capacity) {                                        \
+        if (new_capacity > vector->capacity) {                                                                   \
+            T* new_data = (T*)realloc(vector->data, new_capacity * sizeof(T));                                   \
+            if (new_data == NULL) {                                                                              \
+                fprintf(stderr, "Memory allocation failed during resize.\n");                                    \
+                errno = ENOMEM;                                                                                  \
+                return 0;                                                                                        \
+            }                                                                                                    \
+            vector->data = new_data;                                                                             \
+            vector->capacity = new_capacity;                                                                     \
+        }                                                                                                        \
+        return 1;                                                                                                \
+    }                                                                                                            \
+                                                                                                                 \
+    /* grows to at least min_capacity, doubling, and never below NEU_VECTOR_MIN_BYTES */                         \
+    static inline int name##__grow(name* vector, size_t min_capacity) {                                          \
+        if (min_capacity <= vector->capacity) {                                                                  \
+            return 1;                                                                                            \
+        }                                                                                                        \
+        size_t new_capacity = vector->capacity * SCALE_FACTOR;                                                   \
+        if (new_capacity < NEU_VECTOR_MIN_BYTES / sizeof(T)) {                                                   \
+            new_capacity = NEU_VECTOR_MIN_BYTES / sizeof(T);                                                     \
+        }                                                                                                        \
+        if (new_capacity < min_capacity) {                                                                       \
+            new_capacity = min_capacity;                                                                         \
+        }                                                                                                        \
+        return name##__resize(vector, new_capacity);                                                             \
+    }                                                                                                            \
+                                                                                                                 \
+    static inline void name##_reserve(name* vector, size_t capacity) {                                           \
+        name##__resize(vector, capacity);                                                                        \
+    }                                                                                                            \
+                                                                                                                 \
+    static inline T* name##_get(name* vector, size_t index) {                                                    \
+        NEU_VECTOR_CHECK_INDEX(index, vector->size, return NULL);                                                \
+        return &vector->data[index];                                                                             \
+    }                                                                                                            \
+                                                                                                                 \
+    static inline void name##_set(name* vector, size_t index, T value) {                                         \
+        NEU_VECTOR_CHECK_INDEX(index, vector->size, return);                                                     \
+        vector->data[index] = value;                                                                             \
+    }                                                                                                            \
+                                                                                                                 \
+    /* unchecked, the caller makes sure index < size */                                                          \
+    static inline T name##_at(const name* vector, size_t index) {                                                \
+        NEU_VECTOR_ASSERT_INDEX(index, vector->size);                                                            \
+        return vector->data[index];                                                                              \
+    }                                                                                                            \
+                                                                                                                 \
+    static inline T* name##_data(name* vector) {                                                                 \
+        return vector->data;                                                                                     \
+    }                                                                                                            \
+                                                                                                                 \
+    static inline void name##_append(name* vector, T value) {                                                    \
+        if (vector->size == vector->capacity && !name##__grow(vector, vector->size + 1)) {                       \
+            return;                                                                                              \
+        }                                                                                                        \
+        vector->data[vector->size++] = value;                                                                    \
+    }                                                                                                            \
+                                                                                                                 \
+    static inline void name##_insert_range(name* vector, size_t index, T const* values, size_t count) {          \
+        if (index > vector->size) {                                                                              \
+            fprintf(stderr, "Index out of bounds.\n");                                                           \
+            errno = ERANGE;                                                                                      \
+            return;                                                                                              \
+        }                                                                                                        \
+        if (count == 0) {                                                                                        \
+            return;                                                                                              \
+        }                                                                                                        \
+        T* copy = NULL;                                                                                          \
+        if (values >= vector->data && values < vector->data + vector->size) {                                    \
+            /* the source moves when the vector grows or the tail shifts */                                      \
+            copy = (T*)malloc(count * sizeof(T));                                                                \
+            if (copy == NULL) {                                                                                  \
+                fprintf(stderr, "Memory allocation failed.\n");                                                  \
+                errno = ENOMEM;                                                                                  \
+                return;                                                                                          \
+            }                                                                                                    \
+            memcpy(copy, values, count * sizeof(T));                                                             \
+            values = copy;                                                                                       \
+        }                                                                                                        \
+        if (name##__grow(vector, vector->size + count)) {                                                        \
+            memmove(vector->data + index + count, vector->data + index, (vector->size - index) * sizeof(T));     \
+            memcpy(vector->data + index, values, count * sizeof(T));                                             \
+            vector->size += count;                                                                               \
+        }                                                                                                        \
+        free(copy);                                                                                              \
+    }                                                                                                            \
+                                                                                                                 \
+    static inline void name##_insert(name* vector, size_t index, T value) {                                      \
+        name##_insert_range(vector, index, &value, 1);                                                           \
+    }                                                                                                            \
+                                                                                                                 \
+    static inline void name##_append_array(name* vector, T const* values, size_t count) {                        \
+        name##_insert_range(vector, vector->size, values, count);                                                \
+    }                                                                                                            \
+                                                                                                                 \
+    static inline void name##_erase_range(name* vector, size_t index, size_t count) {                            \
+        if (index > vector->size || count > vector->size - index) {                                              \
+            fprintf(stderr, "Index out of bounds.\n");                                                           \
+            errno = ERANGE;                                                                                      \
+            return;                                                                                              \
+        }                                                                                                        \
+        memmove(vector->data + index, vector->data + index + count, (vector->size - index - count) * sizeof(T)); \
+        vector->size -= count;                                                                                   \
+    }                                                                                                            \
+                                                                                                                 \
+    static inline T name##_remove(name* vector, size_t index) {                                                  \
+        T value;                                                                                                 \
+        if (index >= vector->size) {                                                                             \
+            fprintf(stderr, "Index out of bounds.\n");                                                           \
+            errno = ERANGE;                                                                                      \
+            memset(&value, 0, sizeof(T));                                                                        \
+            return value;                                                                                        \
+        }                                                                                                        \
+        value = vector->data[index];                                                                             \
+        name##_erase_range(vector, index, 1);                                                                    \
+        return value;                                                                                            \
+    }                                                                                                            \
+                                                                                                                 \
+    static inline T name##_pop(name* vector) {                                                                   \
+        return name##_remove(vector, vector->size - 1);                                                          \
+    }                                                                                                            \
+                                                                                                                 \
+    static inline size_t name##_find(const name* vector, T value) {                                              \
+        for (size_t i = 0; i < vector->size; ++i) {                                                              \
+            if (equals(vector->data[i], value)) {                                                                \
+                return i;                                                                                        \
+            }                                                                                                    \
+        }                                                                                                        \
+        return NEU_VECTOR_NOT_FOUND;                                                                             \
+    }                                                                                                            \
+                                                                                                                 \
+    static inline size_t name##_count(const name* vector, T value) {                                             \
+        size_t count = 0;                                                                                        \
+        for (size_t i = 0; i < vector->size; ++i) {                                                              \
+            count += equals(vector->data[i], value) ? 1 : 0;                                                     \
+        }                                                                                                        \
+        return count;                                                                                            \
+    }
+
+/**
+ * NEU_VECTOR_DECLARE_EQ with ==, for element types that support it:
+ * numbers, pointers and enums.
+ */
+#define NEU_VECTOR_DECLARE(name, T) NEU_VECTOR_DECLARE_EQ(name, T, NEU_VECTOR_EQUALS)
 
+/**
+ * Vectors of doubles and of pointers, which the int NeuVector cannot hold.
+ * A pointer vector does not own what its elements point to.
+ */
+NEU_VECTOR_DECLARE(NeuDoubleVector, double)
+NEU_VECTOR_DECLARE(NeuPointerVector, void*)
 
 #endif // NEU_VECTOR_H
\ No newline at end of file
@@ -0,0 +1,444 @@
+/**
+ * Search kernels for NeuVector: find the first match, count matches, find
+ * the minimum and maximum, and test a batch of values for membership.
+ *
+ * Every kernel has a portable scalar version and, on x86, an SSE4.1 and an
+ * AVX2 version that compare 4 or 8 integers per instruction. The versions
+ * are compiled with target attributes, so no extra compiler flags are
+ * needed, and the best one the CPU supports is picked once when the
+ * program starts.
+ **/
+
+#include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define NEU_VECTOR_X86 1
+#include <immintrin.h>
+#endif
+
+#include "NeuVector.h"
+
+#define BATCH_CHUNK 8             // batch values compared per pass over the vector
+#define BATCH_CHECK_INTERVAL 4096 // elements between checks for an early exit
+#define COUNT_BLOCK (1 << 28)     // elements counted before 32-bit lane counters could overflow
+
+/**
+ * One implementation of every kernel.
+ */
+typedef struct {
+    size_t (*find)(const int* data, size_t size, int value); // size if not found
+    size_t (*count)(const int* data, size_t size, int value);
+    void (*min_max)(const int* data, size_t size, int* min, int* max); // size > 0
+    void (*contains_batch)(const int* data, size_t size, const int* values, size_t count, int* found); // count <= BATCH_CHUNK
+} NeuSearchKernels;
+
+static size_t __scalar_find(const int* data, size_t size, int value) {
+    for (size_t i = 0; i < size; ++i) {
+        if (data[i] == value) {
+            return i;
+        }
+    }
+    return size;
+}
+
+static size_t __scalar_count(const int* data, size_t size, int value) {
+    size_t count = 0;
+    for (size_t i = 0; i < size; ++i) {
+        count += data[i] == value;
+    }
+    return count;
+}
+
+static void __scalar_min_max(const int* data, size_t size, int* min, int* max) {
+    int low = data[0];
+    int high = data[0];
+    for (size_t i = 1; i < size; ++i) {
+        low = data[i] < low ? data[i] : low;
+        high = data[i] > high ? data[i] : high;
+    }
+    *min = low;
+    *max = high;
+}
+
+static void __scalar_contains_batch(const int* data, size_t size, const int* values, size_t count, int* found) {
+    for (size_t i = 0; i < size;) {
+        size_t end = size - i > BATCH_CHECK_INTERVAL ? i + BATCH_CHECK_INTERVAL : size;
+        for (; i < end; ++i) {
+            for (size_t j = 0; j < count; ++j) {
+                found[j] |= data[i] == values[j];
+            }
+        }
+        int done = 1;
+        for (size_t j = 0; j < count; ++j) {
+            done &= found[j];
+        }
+        if (done) {
+            return; // every value was found
+        }
+    }
+}
+
+static const NeuSearchKernels __scalar_kernels = {
+    __scalar_find, __scalar_count, __scalar_min_max, __scalar_contains_batch
+};
+
+#ifdef NEU_VECTOR_X86
+
+__attribute__((target("sse4.1")))
+static size_t __sse4_find(const int* data, size_t size, int value) {
+    __m128i needle = _mm_set1_epi32(value);
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i a = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(data + i)), needle);
+        __m128i b = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(data + i + 4)), needle);
+        __m128i c = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(data + i + 8)), needle);
+        __m128i d = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(data + i + 12)), needle);
+        if (!_mm_testz_si128(_mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d)), _mm_set1_epi32(-1))) {
+            break; // the match is in this block, the scalar loop finds it
+        }
+    }
+    return i + __scalar_find(data + i, size - i, value);
+}
+
+__attribute__((target("sse4.1")))
+static size_t __sse4_count(const int* data, size_t size, int value) {
+    __m128i needle = _mm_set1_epi32(value);
+    size_t count = 0;
+    size_t i = 0;
+    while (i + 4 <= size) {
+        size_t end = size - i > COUNT_BLOCK ? i + COUNT_BLOCK : size;
+        __m128i lanes = _mm_setzero_si128();
+        for (; i + 4 <= end; i += 4) {
+            // a match compares to -1, so subtracting it counts one
+            lanes = _mm_sub_epi32(lanes, _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(data + i)), needle));
+        }
+        lanes = _mm_add_epi32(lanes, _mm_shuffle_epi32(lanes, _MM_SHUFFLE(1, 0, 3, 2)));
+        lanes = _mm_add_epi32(lanes, _mm_shuffle_epi32(lanes, _MM_SHUFFLE(2, 3, 0, 1)));
+        count += (unsigned)_mm_cvtsi128_si32(lanes);
+    }
+    return count + __scalar_count(data + i, size - i, value);
+}
+
+__attribute__((target("sse4.1")))
+static void __sse4_min_max(const int* data, size_t size, int* min, int* max) {
+    if (size < 4) {
+        __scalar_min_max(data, size, min, max);
+        return;
+    }
+    __m128i low = _mm_loadu_si128((const __m128i*)data);
+    __m128i high = low;
+    size_t i = 4;
+    for (; i + 4 <= size; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+        low = _mm_min_epi32(low, v);
+        high = _mm_max_epi32(high, v);
+    }
+    // the last 4 elements overlap the loop, which does not change the result
+    __m128i tail = _mm_loadu_si128((const __m128i*)(data + size - 4));
+    low = _mm_min_epi32(low, tail);
+    high = _mm_max_epi32(high, tail);
+    low = _mm_min_epi32(low, _mm_shuffle_epi32(low, _MM_SHUFFLE(1, 0, 3, 2)));
+    low = _mm_min_epi32(low, _mm_shuffle_epi32(low, _MM_SHUFFLE(2, 3, 0, 1)));
+    high = _mm_max_epi32(high, _mm_shuffle_epi32(high, _MM_SHUFFLE(1, 0, 3, 2)));
+    high = _mm_max_epi32(high, _mm_shuffle_epi32(high, _MM_SHUFFLE(2, 3, 0, 1)));
+    *min = _mm_cvtsi128_si32(low);
+    *max = _mm_cvtsi128_si32(high);
+}
+
+__attribute__((target("sse4.1")))
+static void __sse4_contains_batch(const int* data, size_t size, const int* values, size_t count, int* found) {
+    __m128i needles[BATCH_CHUNK];
+    __m128i hits[BATCH_CHUNK];
+    for (size_t j = 0; j < BATCH_CHUNK; ++j) {
+        // a short batch repeats its first value, so the loops below have a fixed length
+        needles[j] = _mm_set1_epi32(values[j < count ? j : 0]);
+        hits[j] = _mm_setzero_si128();
+    }
+    size_t i = 0;
+    while (i + 4 <= size) {
+        size_t end = size - i > BATCH_CHECK_INTERVAL ? i + BATCH_CHECK_INTERVAL : size;
+        for (; i + 4 <= end; i += 4) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+            for (size_t j = 0; j < BATCH_CHUNK; ++j) {
+                hits[j] = _mm_or_si128(hits[j], _mm_cmpeq_epi32(v, needles[j]));
+            }
+        }
+        int done = 1;
+        for (size_t j = 0; j < count; ++j) {
+            done &= !_mm_testz_si128(hits[j], hits[j]);
+        }
+        if (done) {
+            for (size_t j = 0; j < count; ++j) {
+                found[j] = 1;
+            }
+            return; // every value was found, the rest of the vector cannot change that
+        }
+    }
+    for (size_t j = 0; j < count; ++j) {
+        found[j] |= !_mm_testz_si128(hits[j], hits[j]);
+    }
+    // only the last few elements, less than one register wide, are left
+    __scalar_contains_batch(data + i, size - i, values, count, found);
+}
+
+static const NeuSearchKernels __sse4_kernels = {
+    __sse4_find, __sse4_count, __sse4_min_max, __sse4_contains_batch
+};
+
+__attribute__((target("avx2")))
+static size_t __avx2_find(const int* data, size_t size, int value) {
+    __m256i needle = _mm256_set1_epi32(value);
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i a = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)(data + i)), needle);
+        __m256i b = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)(data + i + 8)), needle);
+        __m256i c = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)(data + i + 16)), needle);
+        __m256i d = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)(data + i + 24)), needle);
+        __m256i any = _mm256_or_si256(_mm256_or_si256(a, b), _mm256_or_si256(c, d));
+        if (!_mm256_testz_si256(any, any)) {
+            unsigned mask = (unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(a));
+            if (mask != 0) {
+                return i + __builtin_ctz(mask);
+            }
+            mask = (unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(b));
+            if (mask != 0) {
+                return i + 8 + __builtin_ctz(mask);
+            }
+            mask = (unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(c));
+            if (mask != 0) {
+                return i + 16 + __builtin_ctz(mask);
+            }
+            return i + 24 + __builtin_ctz((unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(d)));
+        }
+    }
+    return i + __scalar_find(data + i, size - i, value);
+}
+
+__attribute__((target("avx2")))
+static size_t __avx2_count(const int* data, size_t size, int value) {
+    __m256i needle = _mm256_set1_epi32(value);
+    size_t count = 0;
+    size_t i = 0;
+    while (i + 16 <= size) {
+        size_t end = size - i > COUNT_BLOCK ? i + COUNT_BLOCK : size;
+        __m256i a = _mm256_setzero_si256();
+        __m256i b = _mm256_setzero_si256();
+        for (; i + 16 <= end; i += 16) {
+            // a match compares to -1, so subtracting it counts one
+            a = _mm256_sub_epi32(a, _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)(data + i)), needle));
+            b = _mm256_sub_epi32(b, _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)(data + i + 8)), needle));
+        }
+        __m256i sum = _mm256_add_epi32(a, b);
+        __m128i lanes = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+        lanes = _mm_add_epi32(lanes, _mm_shuffle_epi32(lanes, _MM_SHUFFLE(1, 0, 3, 2)));
+        lanes = _mm_add_epi32(lanes, _mm_shuffle_epi32(lanes, _MM_SHUFFLE(2, 3, 0, 1)));
+        count += (unsigned)_mm_cvtsi128_si32(lanes);
+    }
+    return count + __scalar_count(data + i, size - i, value);
+}
+
+__attribute__((target("avx2")))
+static void __avx2_min_max(const int* data, size_t size, int* min, int* max) {
+    if (size < 8) {
+        __sse4_min_max(data, size, min, max);
+        return;
+    }
+    __m256i low = _mm256_loadu_si256((const __m256i*)data);
+    __m256i high = low;
+    size_t i = 8;
+    for (; i + 8 <= size; i += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(data + i));
+        low = _mm256_min_epi32(low, v);
+        high = _mm256_max_epi32(high, v);
+    }
+    // the last 8 elements overlap the loop, which does not change the result
+    __m256i tail = _mm256_loadu_si256((const __m256i*)(data + size - 8));
+    low = _mm256_min_epi32(low, tail);
+    high = _mm256_max_epi32(high, tail);
+    __m128i low4 = _mm_min_epi32(_mm256_castsi256_si128(low), _mm256_extracti128_si256(low, 1));
+    __m128i high4 = _mm_max_epi32(_mm256_castsi256_si128(high), _mm256_extracti128_si256(high, 1));
+    low4 = _mm_min_epi32(low4, _mm_shuffle_epi32(low4, _MM_SHUFFLE(1, 0, 3, 2)));
+    low4 = _mm_min_epi32(low4, _mm_shuffle_epi32(low4, _MM_SHUFFLE(2, 3, 0, 1)));
+    high4 = _mm_max_epi32(high4, _mm_shuffle_epi32(high4, _MM_SHUFFLE(1, 0, 3, 2)));
+    high4 = _mm_max_epi32(high4, _mm_shuffle_epi32(high4, _MM_SHUFFLE(2, 3, 0, 1)));
+    *min = _mm_cvtsi128_si32(low4);
+    *max = _mm_cvtsi128_si32(high4);
+}
+
+__attribute__((target("avx2")))
+static void __avx2_contains_batch(const int* data, size_t size, const int* values, size_t count, int* found) {
+    __m256i needles[BATCH_CHUNK];
+    __m256i hits[BATCH_CHUNK];
+    for (size_t j = 0; j < BATCH_CHUNK; ++j) {
+        // a short batch repeats its first value, so the loops below have a fixed length
+        needles[j] = _mm256_set1_epi32(values[j < count ? j : 0]);
+        hits[j] = _mm256_setzero_si256();
+    }
+    size_t i = 0;
+    while (i + 8 <= size) {
+        size_t end = size - i > BATCH_CHECK_INTERVAL ? i + BATCH_CHECK_INTERVAL : size;
+        for (; i + 8 <= end; i += 8) {
+            __m256i v = _mm256_loadu_si256((const __m256i*)(data + i));
+            for (size_t j = 0; j < BATCH_CHUNK; ++j) {
+                hits[j] = _mm256_or_si256(hits[j], _mm256_cmpeq_epi32(v, needles[j]));
+            }
+        }
+        int done = 1;
+        for (size_t j = 0; j < count; ++j) {
+            done &= !_mm256_testz_si256(hits[j], hits[j]);
+        }
+        if (done) {
+            for (size_t j = 0; j < count; ++j) {
+                found[j] = 1;
+            }
+            return; // every value was found, the rest of the vector cannot change that
+        }
+    }
+    for (size_t j = 0; j < count; ++j) {
+        found[j] |= !_mm256_testz_si256(hits[j], hits[j]);
+    }
+    // only the last few elements, less than one register wide, are left
+    __scalar_contains_batch(data + i, size - i, values, count, found);
+}
+
+static const NeuSearchKernels __avx2_kernels = {
+    __avx2_find, __avx2_count, __avx2_min_max, __avx2_contains_batch
+};
+
+#endif // NEU_VECTOR_X86
+
+static const NeuSearchKernels* __kernels = &__scalar_kernels;
+static VectorSearchLevel __level = VECTOR_SEARCH_SCALAR;
+
+/**
+ * Gets the best kernel level the CPU supports.
+ */
+static VectorSearchLevel __best_search_level(void) {
+#ifdef NEU_VECTOR_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return VECTOR_SEARCH_AVX2;
+    }
+    if (__builtin_cpu_supports("sse4.1")) {
+        return VECTOR_SEARCH_SSE4;
+    }
+#endif
+    return VECTOR_SEARCH_SCALAR;
+}
+
+/**
+ * Picks the kernels before main runs, so the choice is never raced.
+ */
+__attribute__((constructor))
+static void __init_search_kernels(void) {
+    set_vector_search_level(VECTOR_SEARCH_AVX2);
+}
+
+/**
+ * Selects the kernels used by the search functions, for example to compare
+ * them or to rule out a SIMD bug. Must not be called while another thread
+ * is searching.
+ *
+ * @param level The highest level to use. Levels the CPU does not support
+ *              fall back to the best one it does.
+ * @return The level now in use.
+ */
+VectorSearchLevel set_vector_search_level(VectorSearchLevel level) {
+    VectorSearchLevel best = __best_search_level();
+    __level = level < best ? level : best;
+    switch (__level) {
+#ifdef NEU_VECTOR_X86
+        case VECTOR_SEARCH_AVX2:
+            __kernels = &__avx2_kernels;
+            break;
+        case VECTOR_SEARCH_SSE4:
+            __kernels = &__sse4_kernels;
+            break;
+#endif
+        default:
+            __kernels = &__scalar_kernels;
+            break;
+    }
+    return __level;
+}
+
+/**
+ * Gets the level of the kernels in use.
+ *
+ * @return VECTOR_SEARCH_SCALAR, VECTOR_SEARCH_SSE4 or VECTOR_SEARCH_AVX2.
+ */
+VectorSearchLevel get_vector_search_level(void) {
+    return __level;
+}
+
+/**
+ * Finds the first occurrence of a value in the vector.
+ *
+ * @param vector A pointer to the vector.
+ * @param value The value to find.
+ * @return The index of the first occurrence of the value, or -1 if the value is not found.
+ */
+int contains_element(NeuVector* vector, int value) {
+    size_t index = __kernels->find(vector->data, vector->size, value);
+    return index < vector->size ? (int)index : -1;
+}
+
+/**
+ * Counts the occurrences of a value in the vector.
+ *
+ * @param vector A pointer to the vector.
+ * @param value The value to count.
+ * @return The number of elements equal to value.
+ */
+size_t count_vector_element(NeuVector* vector, int value) {
+    return __kernels->count(vector->data, vector->size, value);
+}
+
+/**
+ * Finds the smallest and largest element of the vector in one pass.
+ *
+ * @param vector A pointer to the vector.
+ * @param min Set to the smallest element.
+ * @param max Set to the largest element.
+ * @return 0 if successful, or -1 if the vector is empty.
+ */
+int get_vector_min_max(NeuVector* vector, int* min, int* max) {
+    if (vector == NULL || vector->size == 0 || vector->data == NULL) {
+        fprintf(stderr, "Vector is empty.\n");
+        errno = ENODATA;
+        return -1; // Vector is empty
+    }
+    errno = 0;
+    __kernels->min_max(vector->data, vector->size, min, max);
+    return 0;
+}
+
+/**
+ * Checks which of a batch of values occur in the vector. The vector is read
+ * once for every BATCH_CHUNK values instead of once per value, and each
+ * pass stops early once all of its values were found.
+ *
+ * @param vector A pointer to the vector.
+ * @param values The values to look for.
+ * @param count The number of values.
+ * @param found Set to 1 for each value that occurs in the vector, else 0.
+ * @return The number of values found.
+ */
+size_t contains_elements(NeuVector* vector, const int* values, size_t count, int* found) {
+    size_t total = 0;
+    if (count == 0) {
+        return 0;
+    }
+    memset(found, 0, count * sizeof(int));
+    for (size_t start = 0; start < count; start += BATCH_CHUNK) {
+        size_t chunk = count - start < BATCH_CHUNK ? count - start : BATCH_CHUNK;
+        __kernels->contains_batch(vector->data, vector->size, values + start, chunk, found + start);
+        for (size_t j = start; j < start + chunk; ++j) {
+            total += found[j];
+        }
+    }
+    return total;
+}
@@ -10,9 +10,25 @@
 #include <string.h>
 #include <time.h>
 #include <locale.h>
+#include <limits.h>
 
 #include "NeuVector.h"
 
+typedef struct {
+    int x;
+    int y;
+    char label[12];
+} NeuPoint;
+
+static inline int neu_point_equals(NeuPoint a, NeuPoint b) {
+    return a.x == b.x && a.y == b.y && strcmp(a.label, b.label) == 0;
+}
+
+NEU_VECTOR_DECLARE_EQ(NeuPointVector, NeuPoint, neu_point_equals)
+NEU_VECTOR_DECLARE(NeuIntVector, int)
+
+#define BATCH_VALUES 16 // values per contains_elements call in the search speed test
+
 void add_elements(NeuVector* vector, int start, int end) {
     for (int i = start; i < end; i++) {
         append_vector_element(vector, i);
@@ -91,6 +107,208 @@ void test_push_elements() {
     free_vector(vector); // Free the vector
 }
 
+void test_range_elements() {
+    NeuVector* vector = create_vector(0); // Create an empty vector, the first append has to grow it
+    int values[] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+    int middle[] = {97, 98, 99};
+    printf("Appending an array of 10 elements, inserting 3 at index 4...\n");
+    append_vector_array(vector, values, 10);
+    insert_vector_range(vector, 4, middle, 3);
+    const char *actual = vector_to_string(vector);
+    if (strcmp(actual, "[0, 1, 2, 3, 97, 98, 99, 4, 5, 6, 7, 8, 9]") == 0) {
+        printf("Test passed: Range inserted correctly.\n");
+    } else {
+        printf("Test failed: Range not inserted correctly. %s\n", actual);
+    }
+    free((char *) actual);
+
+    printf("Erasing 3 elements at index 4, inserting the vector's own first 2 elements at the end...\n");
+    erase_vector_range(vector, 4, 3);
+    insert_vector_range(vector, vector->size, vector->data, 2);
+    actual = vector_to_string(vector);
+    if (strcmp(actual, "[0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 0, 1]") == 0) {
+        printf("Test passed: Range erased correctly.\n");
+    } else {
+        printf("Test failed: Range not erased correctly. %s\n", actual);
+    }
+    free((char *) actual);
+
+    printf("Reserving room for 1000 elements...\n");
+    vector_reserve(vector, 1000);
+    size_t capacity = vector->capacity;
+    add_elements(vector, 0, 900);
+    erase_vector_range(vector, 10, 1000); // out of bounds, nothing is erased
+    if (capacity == 1000 && vector->capacity == 1000 && vector->size == 912) {
+        printf("Test passed: Capacity reserved correctly.\n");
+    } else {
+        printf("Test failed: Capacity not reserved correctly.\n");
+    }
+    free_vector(vector); // Free the vector
+}
+
+void test_search_elements() {
+    const char* names[] = {"scalar", "SSE4", "AVX2"};
+    VectorSearchLevel best = set_vector_search_level(VECTOR_SEARCH_AVX2);
+    int values[] = {7, 1000, -5, INT_MAX, 42, 3, 999, 8, 12345};
+    for (int level = VECTOR_SEARCH_SCALAR; level <= (int)best; level++) {
+        set_vector_search_level((VectorSearchLevel)level);
+        printf("Searching with %s kernels...\n", names[level]);
+        int passed = 1;
+        // every length up to 100, so each kernel's tail handling is covered
+        for (int size = 3; size <= 100; size++) {
+            NeuVector* vector = create_vector(size);
+            for (int i = 0; i < size; i++) {
+                append_vector_element(vector, i % 10); // 0..9 repeated
+            }
+            vector->data[size / 2] = INT_MAX;
+            vector->data[size - 1] = -5;
+            int min, max, found[9];
+            size_t matches = contains_elements(vector, values, 9, found);
+            size_t expected_matches = 0;
+            for (int j = 0; j < 9; j++) {
+                int first = -1;
+                size_t count = 0;
+                for (int i = size - 1; i >= 0; i--) {
+                    if (vector->data[i] == values[j]) {
+                        first = i;
+                        count++;
+                    }
+                }
+                passed = passed && contains_element(vector, values[j]) == first &&
+                         count_vector_element(vector, values[j]) == count && found[j] == (first >= 0);
+                expected_matches += first >= 0;
+            }
+            passed = passed && matches == expected_matches && get_vector_min_max(vector, &min, &max) == 0 &&
+                     min == -5 && max == INT_MAX;
+            free_vector(vector);
+        }
+        // a vector longer than one early exit check, with the first batch found at the front and
+        // the second batch found only in the last element or not at all
+        NeuVector* vector = create_vector(20003);
+        for (int i = 0; i < 20003; i++) {
+            append_vector_element(vector, i);
+        }
+        int batch[10] = {0, 1, 2, 3, 4, 5, 6, 7, 20002, -1};
+        int found[10];
+        passed = passed && contains_elements(vector, batch, 10, found) == 9 && found[0] && found[7] && found[8] &&
+                 !found[9];
+        free_vector(vector);
+        if (passed) {
+            printf("Test passed: %s kernels search correctly.\n", names[level]);
+        } else {
+            printf("Test failed: %s kernels do not search correctly.\n", names[level]);
+        }
+    }
+    set_vector_search_level(best);
+}
+
+void test_unchecked_access() {
+    NeuVector* vector = create_vector(5);
+    printf("Adding elements 0 to 9, doubling them through a span...\n");
+    add_elements(vector, 0, 10);
+    NeuVectorSpan span = vector_span(vector);
+    for (size_t i = 0; i < span.size; i++) {
+        span.data[i] *= 2;
+    }
+    vector_put(vector, 0, vector_at(vector, 9) + 1);
+    NeuVectorSpan middle = vector_subspan(vector, 4, 3);
+    NeuVectorSpan end = vector_subspan(vector, 8, 100);
+    NeuVectorSpan past = vector_subspan(vector, 11, 1);
+    const char *actual = vector_to_string(vector);
+    if (strcmp(actual, "[19, 2, 4, 6, 8, 10, 12, 14, 16, 18]") == 0 && vector_data(vector) == span.data &&
+        middle.size == 3 && middle.data[0] == 8 && end.size == 2 && end.data[1] == 18 && past.size == 0) {
+        printf("Test passed: Unchecked access works correctly.\n");
+    } else {
+        printf("Test failed: Unchecked access does not work correctly. %s\n", actual);
+    }
+    free((char *) actual);
+    free_vector(vector);
+}
+
+void test_small_vectors() {
+    printf("Filling a vector past its inline buffer...\n");
+    NeuVector* vector = create_vector(5);
+    add_elements(vector, 0, NEU_VECTOR_INLINE_CAPACITY);
+    int was_inline = vector->data == vector->inline_data && vector->capacity == NEU_VECTOR_INLINE_CAPACITY;
+    add_elements(vector, NEU_VECTOR_INLINE_CAPACITY, 40);
+    int spilled = vector->data != vector->inline_data && vector->size == 40 && vector_at(vector, 39) == 39 &&
+                  vector_at(vector, 0) == 0 && vector_at(vector, NEU_VECTOR_INLINE_CAPACITY) == NEU_VECTOR_INLINE_CAPACITY;
+    free_vector(vector);
+
+    printf("Using a vector on the stack...\n");
+    NeuVector local;
+    init_vector(&local);
+    int values[] = {1, 2, 3};
+    append_vector_array(&local, values, 3);
+    insert_vector_range(&local, 0, values, 3);
+    int on_stack = local.data == local.inline_data && local.size == 6 && vector_at(&local, 3) == 1;
+    for (int i = 0; i < 100; i++) {
+        append_vector_element(&local, i);
+    }
+    on_stack = on_stack && local.data != local.inline_data && local.size == 106 && vector_at(&local, 105) == 99;
+    destroy_vector(&local);
+    on_stack = on_stack && local.data == local.inline_data && local.size == 0;
+
+    NeuVector* large = create_vector(100);
+    int large_ok = large != NULL && large->data != large->inline_data && large->capacity == 100;
+    free_vector(large);
+
+    if (was_inline && spilled && on_stack && large_ok) {
+        printf("Test passed: Small vectors work correctly.\n");
+    } else {
+        printf("Test failed: Small vectors do not work correctly. %d %d %d %d\n", was_inline, spilled, on_stack, large_ok);
+    }
+}
+
+void test_generic_vectors() {
+    printf("Filling double, pointer and struct vectors...\n");
+    NeuDoubleVector* doubles = NeuDoubleVector_create(0);
+    double halves[] = {0.5, 1.5, 2.5};
+    for (int i = 0; i < 100; i++) {
+        NeuDoubleVector_append(doubles, i * 0.25);
+    }
+    NeuDoubleVector_insert_range(doubles, 10, halves, 3);
+    NeuDoubleVector_erase_range(doubles, 0, 10);
+    int doubles_ok = NeuDoubleVector_size(doubles) == 93 && *NeuDoubleVector_get(doubles, 1) == 1.5 &&
+                     *NeuDoubleVector_get(doubles, 3) == 2.5 && NeuDoubleVector_pop(doubles) == 24.75 &&
+                     NeuDoubleVector_find(doubles, 2.5) == 2 && NeuDoubleVector_count(doubles, 2.5) == 2 &&
+                     NeuDoubleVector_find(doubles, 100.0) == NEU_VECTOR_NOT_FOUND;
+#ifndef NEU_VECTOR_ASSERT_BOUNDS
+    doubles_ok = doubles_ok && NeuDoubleVector_get(doubles, 92) == NULL; // would assert
+#endif
+    NeuDoubleVector_free(doubles);
+
+    NeuPointerVector* pointers = NeuPointerVector_create(2);
+    const char* words[] = {"alpha", "beta", "gamma"};
+    NeuPointerVector_append_array(pointers, (void* const*)words, 3);
+    NeuPointerVector_insert_range(pointers, 1, pointers->data, 3); // from the vector itself
+    int pointers_ok = NeuPointerVector_size(pointers) == 6 && NeuPointerVector_remove(pointers, 2) == words[1] &&
+                      strcmp((const char*)*NeuPointerVector_get(pointers, 3), "beta") == 0 &&
+                      NeuPointerVector_find(pointers, (void*)words[2]) == 2 && NeuPointerVector_count(pointers, (void*)words[0]) == 2;
+    NeuPointerVector_free(pointers);
+
+    NeuPointVector* points = NeuPointVector_create(1);
+    for (int i = 0; i < 50; i++) {
+        NeuPoint point = {i, -i, ""};
+        snprintf(point.label, sizeof(point.label), "P%d", i);
+        NeuPointVector_insert(points, 0, point); // newest first
+    }
+    NeuPointVector_reserve(points, 200);
+    NeuPoint* first = NeuPointVector_get(points, 0);
+    NeuPoint* last = NeuPointVector_get(points, 49);
+    NeuPoint wanted = {10, -10, "P10"};
+    int points_ok = first->x == 49 && strcmp(first->label, "P49") == 0 && last->y == 0 &&
+                    NeuPointVector_capacity(points) == 200 && NeuPointVector_find(points, wanted) == 39 &&
+                    NeuPointVector_count(points, wanted) == 1;
+    NeuPointVector_free(points);
+
+    if (doubles_ok && pointers_ok && points_ok) {
+        printf("Test passed: Generic vectors work correctly.\n");
+    } else {
+        printf("Test failed: Generic vectors do not work correctly. %d %d %d\n", doubles_ok, pointers_ok, points_ok);
+    }
+}
+
 void speed_test_add(int num_elements) {
     NeuVector* vector = create_vector(5); // Create a vector with initial capacity of 5
  
@@ -108,13 +326,258 @@ void speed_test_add(int num_elements) {
     free_vector(vector); // Free the vector
 }
 
+/**
+ * Compares one element at a time with the range functions: building a
+ * vector from an array, and inserting and erasing a block at the front.
+ */
+void speed_test_range(int num_elements) {
+    int block = 1000; // elements inserted and erased at the front
+    int* values = (int*)malloc(num_elements * sizeof(int));
+    if (values == NULL) {
+        fprintf(stderr, "Memory allocation failed.\n");
+        return;
+    }
+    for (int i = 0; i < num_elements; i++) {
+        values[i] = i;
+    }
+    printf("Speed test: %'d elements, %'d element block at the front\n", num_elements, block);
+
+    NeuVector* vector = create_vector(5);
+    clock_t start_time = clock();
+    add_elements(vector, 0, num_elements);
+    double append_one = (double)(clock() - start_time) / CLOCKS_PER_SEC;
+    start_time = clock();
+    for (int i = 0; i < block; i++) {
+        insert_vector_element(vector, i, values[i]);
+    }
+    double insert_one = (double)(clock() - start_time) / CLOCKS_PER_SEC;
+    start_time = clock();
+    for (int i = 0; i < block; i++) {
+        remove_vector_element(vector, 0);
+    }
+    double erase_one = (double)(clock() - start_time) / CLOCKS_PER_SEC;
+    free_vector(vector);
+
+    vector = create_vector(5);
+    start_time = clock();
+    append_vector_array(vector, values, num_elements);
+    double append_range = (double)(clock() - start_time) / CLOCKS_PER_SEC;
+    start_time = clock();
+    insert_vector_range(vector, 0, values, block);
+    double insert_range = (double)(clock() - start_time) / CLOCKS_PER_SEC;
+    start_time = clock();
+    erase_vector_range(vector, 0, block);
+    double erase_range = (double)(clock() - start_time) / CLOCKS_PER_SEC;
+    free_vector(vector);
+    free(values);
+
+    printf("%-8s %14s %14s\n", "", "one at a time", "range");
+    printf("%-8s %14.6f %14.6f\n", "append", append_one, append_range);
+    printf("%-8s %14.6f %14.6f\n", "insert", insert_one, insert_range);
+    printf("%-8s %14.6f %14.6f\n", "erase", erase_one, erase_range);
+}
+
+/**
+ * Measures each search kernel at every level the CPU supports, in GB/s of
+ * vector data read. The searched values are never in the vector, so every
+ * call reads all of it.
+ */
+void speed_test_search(int num_elements) {
+    const char* names[] = {"scalar", "SSE4", "AVX2"};
+    NeuVector* vector = create_vector(num_elements);
+    for (int i = 0; i < num_elements; i++) {
+        append_vector_element(vector, rand() % 1000000);
+    }
+    int batch[BATCH_VALUES];
+    int found[BATCH_VALUES];
+    int early[8]; // all at the front, so the batch search can stop after its first block
+    for (int i = 0; i < BATCH_VALUES; i++) {
+        batch[i] = -1 - i;
+    }
+    for (int i = 0; i < 8; i++) {
+        early[i] = vector->data[i];
+    }
+    double bytes = (double)num_elements * sizeof(int);
+    int repeats = (int)(1e9 / bytes) + 1; // read about 1 GB per kernel
+    volatile size_t sink = 0;
+
+    printf("Speed test: searching %'d elements, %d repeats (GB/s)\n", num_elements, repeats);
+    printf("%-8s %10s %10s %10s %10s %16s\n", "level", "find", "count", "min/max", "batch 16", "found early (us)");
+    VectorSearchLevel best = set_vector_search_level(VECTOR_SEARCH_AVX2);
+    for (int level = VECTOR_SEARCH_SCALAR; level <= (int)best; level++) {
+        set_vector_search_level((VectorSearchLevel)level);
+        double seconds[5];
+        for (int kernel = 0; kernel < 5; kernel++) {
+            clock_t start_time = clock();
+            for (int r = 0; r < repeats; r++) {
+                int min, max;
+                switch (kernel) {
+                    case 0: sink += contains_element(vector, -1); break;
+                    case 1: sink += count_vector_element(vector, -1); break;
+                    case 2: sink += get_vector_min_max(vector, &min, &max) + min; break;
+                    case 3: sink += contains_elements(vector, batch, BATCH_VALUES, found); break;
+                    default: sink += contains_elements(vector, early, 8, found); break;
+                }
+            }
+            seconds[kernel] = (double)(clock() - start_time) / CLOCKS_PER_SEC;
+        }
+        // the batch test reads the vector once per 8 values
+        // the found early column is time per call, it should not depend on the vector's size
+        printf("%-8s %10.2f %10.2f %10.2f %10.2f %16.2f\n", names[level], bytes * repeats / seconds[0] / 1e9,
+               bytes * repeats / seconds[1] / 1e9, bytes * repeats / seconds[2] / 1e9,
+               bytes * repeats * ((BATCH_VALUES + 7) / 8) / seconds[3] / 1e9, seconds[4] / repeats * 1e6);
+    }
+    set_vector_search_level(best);
+    free_vector(vector);
+}
+
+/**
+ * Compares NeuVector with the macro generated NeuIntVector: appending
+ * elements one at a time and reading them back through the get functions.
+ */
+void speed_test_generic(int num_elements) {
+    printf("Speed test: appending and reading %'d elements (seconds)\n", num_elements);
+    NeuVector* vector = create_vector(5);
+    clock_t start_time = clock();
+    add_elements(vector, 0, num_elements);
+    double append_time = (double)(clock() - start_time) / CLOCKS_PER_SEC;
+    long long sum = 0;
+    start_time = clock();
+    for (int i = 0; i < num_elements; i++) {
+        sum += get_vector_element(vector, i);
+    }
+    double get_time = (double)(clock() - start_time) / CLOCKS_PER_SEC;
+    free_vector(vector);
+
+    NeuIntVector* generic = NeuIntVector_create(5);
+    start_time = clock();
+    for (int i = 0; i < num_elements; i++) {
+        NeuIntVector_append(generic, i);
+    }
+    double generic_append_time = (double)(clock() - start_time) / CLOCKS_PER_SEC;
+    long long generic_sum = 0;
+    start_time = clock();
+    for (int i = 0; i < num_elements; i++) {
+        generic_sum += *NeuIntVector_get(generic, i);
+    }
+    double generic_get_time = (double)(clock() - start_time) / CLOCKS_PER_SEC;
+    NeuIntVector_free(generic);
+
+    printf("%-12s %10s %10s\n", "", "append", "get");
+    printf("%-12s %10.6f %10.6f\n", "NeuVector", append_time, get_time);
+    printf("%-12s %10.6f %10.6f\n", "NeuIntVector", generic_append_time, generic_get_time);
+    if (sum != generic_sum) {
+        printf("Sums differ: %lld %lld\n", sum, generic_sum);
+    }
+}
+
+/**
+ * Sums the vector through get_vector_element, the inline vector_at and a
+ * span. Build with VECTOR_FLAGS="-DNEU_VECTOR_ASSERT_BOUNDS -DNDEBUG" to see
+ * get_vector_element without its checks.
+ */
+void speed_test_access(int num_elements) {
+    NeuVector* vector = create_vector(num_elements);
+    add_elements(vector, 0, num_elements);
+    int repeats = 10;
+    long long sums[3] = {0, 0, 0};
+    double seconds[3];
+    printf("Speed test: summing %'d elements %d times (seconds)\n", num_elements, repeats);
+
+    clock_t start_time = clock();
+    for (int r = 0; r < repeats; r++) {
+        for (size_t i = 0; i < vector->size; i++) {
+            sums[0] += get_vector_element(vector, i);
+        }
+    }
+    seconds[0] = (double)(clock() - start_time) / CLOCKS_PER_SEC;
+    start_time = clock();
+    for (int r = 0; r < repeats; r++) {
+        for (size_t i = 0; i < vector->size; i++) {
+            sums[1] += vector_at(vector, i);
+        }
+    }
+    seconds[1] = (double)(clock() - start_time) / CLOCKS_PER_SEC;
+    start_time = clock();
+    for (int r = 0; r < repeats; r++) {
+        NeuVectorSpan span = vector_span(vector);
+        for (size_t i = 0; i < span.size; i++) {
+            sums[2] += span.data[i];
+        }
+    }
+    seconds[2] = (double)(clock() - start_time) / CLOCKS_PER_SEC;
+
+    printf("%-20s %10.6f\n", "get_vector_element", seconds[0]);
+    printf("%-20s %10.6f\n", "vector_at", seconds[1]);
+    printf("%-20s %10.6f\n", "vector_span", seconds[2]);
+    if (sums[0] != sums[1] || sums[1] != sums[2]) {
+        printf("Sums differ: %lld %lld %lld\n", sums[0], sums[1], sums[2]);
+    }
+    free_vector(vector);
+}
+
+/**
+ * Creates, fills with 8 elements and frees a vector num_elements times:
+ * on the heap with the elements inline (one malloc), on the stack (no
+ * malloc), and with a capacity past the inline buffer (two mallocs).
+ */
+void speed_test_small(int num_elements) {
+    long long sum = 0;
+    printf("Speed test: %'d short-lived vectors of 8 elements (seconds)\n", num_elements);
+
+    clock_t start_time = clock();
+    for (int i = 0; i < num_elements; i++) {
+        NeuVector* vector = create_vector(2 * NEU_VECTOR_INLINE_CAPACITY);
+        add_elements(vector, i, i + 8);
+        sum += vector_at(vector, 7);
+        free_vector(vector);
+    }
+    double heap_time = (double)(clock() - start_time) / CLOCKS_PER_SEC;
+
+    start_time = clock();
+    for (int i = 0; i < num_elements; i++) {
+        NeuVector* vector = create_vector(8);
+        add_elements(vector, i, i + 8);
+        sum += vector_at(vector, 7);
+        free_vector(vector);
+    }
+    double inline_time = (double)(clock() - start_time) / CLOCKS_PER_SEC;
+
+    start_time = clock();
+    for (int i = 0; i < num_elements; i++) {
+        NeuVector vector;
+        init_vector(&vector);
+        add_elements(&vector, i, i + 8);
+        sum += vector_at(&vector, 7);
+        destroy_vector(&vector);
+    }
+    double stack_time = (double)(clock() - start_time) / CLOCKS_PER_SEC;
+
+    printf("%-28s %10.6f\n", "heap data (2 mallocs)", heap_time);
+    printf("%-28s %10.6f\n", "inline data (1 malloc)", inline_time);
+    printf("%-28s %10.6f\n", "init_vector (no malloc)", stack_time);
+    printf("checksum %lld\n", sum);
+}
+
 int main(int argc, char* argv[]) {
     if(argc > 1) {
         if (setlocale(LC_NUMERIC, "C.utf8") == NULL) {
             printf("Failed to set default locale\n");
         }
         int num_elements = atoi(argv[1]); // Convert argument to integer
-        speed_test_add(num_elements); // Run speed test with specified number of elements
+        if (argc > 2 && strcmp(argv[2], "range") == 0) {
+            speed_test_range(num_elements); // Compare single element and range operations
+        } else if (argc > 2 && strcmp(argv[2], "small") == 0) {
+            speed_test_small(num_elements); // heap, inline and stack vectors
+        } else if (argc > 2 && strcmp(argv[2], "access") == 0) {
+            speed_test_access(num_elements); // checked vs unchecked element access
+        } else if (argc > 2 && strcmp(argv[2], "generic") == 0) {
+            speed_test_generic(num_elements); // NeuVector vs the macro generated vector
+        } else if (argc > 2 && strcmp(argv[2], "search") == 0) {
+            speed_test_search(num_elements); // GB/s of each search kernel
+        } else {
+            speed_test_add(num_elements); // Run speed test with specified number of elements
+        }
         return EXIT_SUCCESS; // Exit after speed test
     } // else run other tests
     test_add_elements(); // Test adding elements
@@ -122,6 +585,11 @@ int main(int argc, char* argv[]) {
     test_pop_elements(); // Test popping elements
     test_push_elements(); // Test pushing elements
     test_insert_elements(); // Test inserting elements
+    test_range_elements(); // Test range insert, erase, append and reserve
+    test_search_elements(); // Test the search kernels at every level
+    test_unchecked_access(); // Test the inline accessors and spans
+    test_small_vectors(); // Test the inline buffer and stack vectors
+    test_generic_vectors(); // Test the macro generated vectors
  
     return EXIT_SUCCESS;
     